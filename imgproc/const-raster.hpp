@@ -37,6 +37,8 @@
 #include <opencv2/core/core.hpp>
 #endif // IMGPROC_HAS_OPENCV
 
+#include <type_traits>
+
 #include "utility/has_member.hpp"
 
 #include "math/math.hpp"
@@ -44,6 +46,8 @@
 #include "math/boost_gil_all.hpp"
 
 #include "rastermask/quadtree.hpp"
+#include "rastermask/frozenqtree.hpp"
+#include "rastermask/coverage.hpp"
 
 namespace imgproc {
 namespace gil = boost::gil;
@@ -82,6 +86,10 @@ namespace gil = boost::gil;
  *      // Works with whole value (i.e. pixel) at once.
  *      // NB: Return value can be anything value_type is convertible to.
  *      value_type undefined() const
+ *
+ *      // Optional: returns validity of all pixels in window
+ *      // [x1, x2] x [y1, y2] at once (or TileCoverage::mixed if unknown).
+ *      quadtree::TileCoverage coverage(int x1, int y1, int x2, int y2) const;
  * };
  *
  * NB: Reconstruction function (from reconstruct.hpp) doesn't return
@@ -126,6 +134,35 @@ struct ReconstructResult
     typedef decltype(reinterpret_cast<ConstRaster*>(0x1)->undefined()) type;
 };
 
+/** Direct row access support.
+ *
+ *  Specialized (and derived from std::true_type) for unmasked rasters whose
+ *  rows are stored as interleaved 8/16-bit integer channels (1, 3 or 4 of
+ *  them). Specialization provides:
+ *
+ *      // number of interleaved channels
+ *      static constexpr int channels;
+ *
+ *      // pointer to first channel of pixel (x, y); next channels.width()
+ *      // pixels follow contiguously
+ *      static const channel_type* row(const ConstRaster &r, int x, int y);
+ *
+ *  Matches exact raster types only, i.e. rasters with a mask plugin (derived
+ *  from the unmasked ones) fall back to the generic ConstRaster interface.
+ */
+template <typename ConstRaster, typename Enable = void>
+struct InterleavedRaster : std::false_type {};
+
+/** Helper: is given channel type and count suitable for direct row access?
+ */
+template <typename ChannelType, int Channels>
+struct InterleavedChannels
+    : std::integral_constant<bool, (std::is_integral<ChannelType>::value
+                                    && (sizeof(ChannelType) <= 2)
+                                    && ((Channels == 1) || (Channels == 3)
+                                        || (Channels == 4)))>
+{};
+
 } // namespace detail
 
 /** CRTP base for pixel in-bounds validation
@@ -142,16 +179,64 @@ struct BoundsValidator {
     }
 };
 
-/** ConstRaster plugin to add raster mask support.
+/** ConstRaster plugin to add raster mask support. Mask is any type with
+ *  bool get(int x, int y) const.
+ *
+ *  Mask is only read, i.e. raster can be shared by multiple threads as long
+ *  as nobody modifies the mask (see quadtree::RasterMask). Use
+ *  frozenqtree::RasterMask (immutable snapshot, faster get()) when mask is
+ *  shared by many threads or rasters.
  */
-class MaskedPlugin {
+template <typename Mask>
+class BasicMaskedPlugin {
 public:
-    MaskedPlugin(const quadtree::RasterMask &mask) : mask_(mask) {}
-    MaskedPlugin(quadtree::RasterMask &&mask) = delete;
-    MaskedPlugin(const quadtree::RasterMask &&mask) = delete;
+    BasicMaskedPlugin(const Mask &mask) : mask_(mask) {}
+    BasicMaskedPlugin(Mask &&mask) = delete;
+    BasicMaskedPlugin(const Mask &&mask) = delete;
     bool valid(int x, int y) const { return mask_.get(x, y); }
 private:
-    const quadtree::RasterMask &mask_;
+    const Mask &mask_;
+};
+
+typedef BasicMaskedPlugin<quadtree::RasterMask> MaskedPlugin;
+typedef BasicMaskedPlugin<frozenqtree::RasterMask> FrozenMaskedPlugin;
+
+/** ConstRaster plugin to add raster mask support with precomputed tile
+ *  coverage (see quadtree::MaskCoverage).
+ *
+ *  Pixel validation descends the mask only in mixed tiles. Window coverage
+ *  lets reconstruction skip per-pixel validation inside fully valid tiles
+ *  and return undefined value at once inside fully invalid ones.
+ *
+ *  Coverage (and mask) is only read, i.e. raster can be shared by multiple
+ *  threads as long as nobody modifies the mask.
+ */
+class CoverageMaskedPlugin {
+public:
+    CoverageMaskedPlugin(const quadtree::MaskCoverage &coverage)
+        : coverage_(coverage) {}
+    CoverageMaskedPlugin(quadtree::MaskCoverage &&coverage) = delete;
+    CoverageMaskedPlugin(const quadtree::MaskCoverage &&coverage) = delete;
+
+    bool valid(int x, int y) const { return coverage_.get(x, y); }
+
+    /** Window coverage; window not inside raster of given size is never
+     *  valid.
+     */
+    quadtree::TileCoverage coverage(int width, int height
+                                    , int x1, int y1, int x2, int y2) const
+    {
+        const auto c(coverage_.window(x1, y1, x2, y2));
+        if ((c == quadtree::TileCoverage::valid)
+            && ((x1 < 0) || (y1 < 0) || (x2 >= width) || (y2 >= height)))
+        {
+            return quadtree::TileCoverage::mixed;
+        }
+        return c;
+    }
+
+private:
+    const quadtree::MaskCoverage &coverage_;
 };
 
 /************************************************************************
@@ -206,20 +291,64 @@ private:
     value_type undef_;
 };
 
+namespace detail {
+
 template <typename ValueType>
+struct InterleavedRaster
+    <CvConstRaster<ValueType>
+     , typename std::enable_if
+       <InterleavedChannels<typename CvConstRaster<ValueType>::channel_type
+                            , CvConstRaster<ValueType>::value_type::channels>
+        ::value>::type>
+    : std::true_type
+{
+    typedef CvConstRaster<ValueType> raster_type;
+    typedef typename raster_type::channel_type channel_type;
+
+    static constexpr int channels = raster_type::value_type::channels;
+
+    static const channel_type* row(const raster_type &r, int x, int y) {
+        return reinterpret_cast<const channel_type*>(&r(x, y));
+    }
+};
+
+} // namespace detail
+
+template <typename ValueType, typename Mask = quadtree::RasterMask>
 class MaskedCvConstRaster
-    : public MaskedPlugin
+    : public BasicMaskedPlugin<Mask>
     , public CvConstRaster<ValueType>
 {
 public:
-    MaskedCvConstRaster(const cv::Mat &mat
-                        , const quadtree::RasterMask &mask)
-        : MaskedPlugin(mask), CvConstRaster<ValueType>(mat)
+    MaskedCvConstRaster(const cv::Mat &mat, const Mask &mask)
+        : BasicMaskedPlugin<Mask>(mask), CvConstRaster<ValueType>(mat)
     {}
 
     bool valid(int x, int y) const {
         return (CvConstRaster<ValueType>::valid(x, y)
-                && MaskedPlugin::valid(x, y));
+                && BasicMaskedPlugin<Mask>::valid(x, y));
+    }
+};
+
+template <typename ValueType>
+class CoverageMaskedCvConstRaster
+    : public CoverageMaskedPlugin
+    , public CvConstRaster<ValueType>
+{
+public:
+    CoverageMaskedCvConstRaster(const cv::Mat &mat
+                                , const quadtree::MaskCoverage &coverage)
+        : CoverageMaskedPlugin(coverage), CvConstRaster<ValueType>(mat)
+    {}
+
+    bool valid(int x, int y) const {
+        return (CvConstRaster<ValueType>::valid(x, y)
+                && CoverageMaskedPlugin::valid(x, y));
+    }
+
+    quadtree::TileCoverage coverage(int x1, int y1, int x2, int y2) const {
+        return CoverageMaskedPlugin::coverage
+            (this->width(), this->height(), x1, y1, x2, y2);
     }
 };
 
@@ -286,6 +415,36 @@ cvConstRaster(const cv::Mat_<ValueType> &mat, const quadtree::RasterMask &mask)
     return { mat, mask };
 }
 
+template <typename ValueType>
+MaskedCvConstRaster<ValueType, frozenqtree::RasterMask>
+cvConstRaster(const cv::Mat &mat, const frozenqtree::RasterMask &mask)
+{
+    return { mat, mask };
+}
+
+template <typename ValueType>
+MaskedCvConstRaster<ValueType, frozenqtree::RasterMask>
+cvConstRaster(const cv::Mat_<ValueType> &mat
+              , const frozenqtree::RasterMask &mask)
+{
+    return { mat, mask };
+}
+
+template <typename ValueType>
+CoverageMaskedCvConstRaster<ValueType>
+cvConstRaster(const cv::Mat &mat, const quadtree::MaskCoverage &coverage)
+{
+    return { mat, coverage };
+}
+
+template <typename ValueType>
+CoverageMaskedCvConstRaster<ValueType>
+cvConstRaster(const cv::Mat_<ValueType> &mat
+              , const quadtree::MaskCoverage &coverage)
+{
+    return { mat, coverage };
+}
+
 template <typename ValueType, typename MaskValueType>
 CvMaskedCvConstRaster<ValueType, MaskValueType>
 cvConstRaster(const cv::Mat &mat, const cv::Mat &mask)
@@ -366,23 +525,73 @@ private:
     const ViewType& view_;
 };
 
+namespace detail {
+
 template <typename ViewType>
+struct InterleavedRaster
+    <GilConstRaster<ViewType>
+     , typename std::enable_if
+       <std::is_pointer<typename ViewType::x_iterator>::value
+        && InterleavedChannels<typename GilConstRaster<ViewType>::channel_type
+                               , gil::num_channels<ViewType>::value>
+        ::value>::type>
+    : std::true_type
+{
+    typedef GilConstRaster<ViewType> raster_type;
+    typedef typename raster_type::channel_type channel_type;
+
+    static constexpr int channels = gil::num_channels<ViewType>::value;
+
+    static const channel_type* row(const raster_type &r, int x, int y) {
+        return reinterpret_cast<const channel_type*>(&r(x, y));
+    }
+};
+
+} // namespace detail
+
+template <typename ViewType, typename Mask = quadtree::RasterMask>
 class MaskedGilConstRaster
-    : public MaskedPlugin
+    : public BasicMaskedPlugin<Mask>
+    , public GilConstRaster<ViewType>
+{
+public:
+    MaskedGilConstRaster(const ViewType &view, const Mask &mask)
+        : BasicMaskedPlugin<Mask>(mask), GilConstRaster<ViewType>(view)
+    {}
+
+    MaskedGilConstRaster(ViewType&&, const Mask&) = delete;
+    MaskedGilConstRaster(const ViewType&&, const Mask&) = delete;
+
+    bool valid(int x, int y) const {
+        return (GilConstRaster<ViewType>::valid(x, y)
+                && BasicMaskedPlugin<Mask>::valid(x, y));
+    }
+};
+
+template <typename ViewType>
+class CoverageMaskedGilConstRaster
+    : public CoverageMaskedPlugin
     , public GilConstRaster<ViewType>
 {
 public:
-    MaskedGilConstRaster(const ViewType &view
-                         , const quadtree::RasterMask &mask)
-        : MaskedPlugin(mask), GilConstRaster<ViewType>(view)
+    CoverageMaskedGilConstRaster(const ViewType &view
+                                 , const quadtree::MaskCoverage &coverage)
+        : CoverageMaskedPlugin(coverage), GilConstRaster<ViewType>(view)
     {}
 
-    MaskedGilConstRaster(ViewType&&, const quadtree::RasterMask&) = delete;
-    MaskedGilConstRaster(const ViewType&&, const quadtree::RasterMask&) = delete;
+    CoverageMaskedGilConstRaster(ViewType&&
+                                 , const quadtree::MaskCoverage&) = delete;
+    CoverageMaskedGilConstRaster(const ViewType&&
+                                 , const quadtree::MaskCoverage&) = delete;
 
     bool valid(int x, int y) const {
-        return (MaskedGilConstRaster<ViewType>::valid(x, y)
-                && MaskedPlugin::valid(x, y));
+        return (GilConstRaster<ViewType>::valid(x, y)
+                && CoverageMaskedPlugin::valid(x, y));
+    }
+
+    quadtree::TileCoverage coverage(int x1, int y1, int x2, int y2) const {
+        return CoverageMaskedPlugin::coverage
+            (this->width(), this->height(), x1, y1, x2, y2);
     }
 };
 
@@ -419,6 +628,42 @@ MaskedGilConstRaster<gil::image_view<Loc> >
 gilConstRaster(const gil::image_view<Loc>&&
                , const quadtree::RasterMask&) = delete;
 
+template <typename Loc>
+MaskedGilConstRaster<gil::image_view<Loc>, frozenqtree::RasterMask>
+gilConstRaster(const gil::image_view<Loc> &view
+               , const frozenqtree::RasterMask &mask)
+{
+    return { view, mask };
+}
+
+template <typename Loc>
+MaskedGilConstRaster<gil::image_view<Loc>, frozenqtree::RasterMask>
+gilConstRaster(gil::image_view<Loc>&&
+               , const frozenqtree::RasterMask&) = delete;
+
+template <typename Loc>
+MaskedGilConstRaster<gil::image_view<Loc>, frozenqtree::RasterMask>
+gilConstRaster(const gil::image_view<Loc>&&
+               , const frozenqtree::RasterMask&) = delete;
+
+template <typename Loc>
+CoverageMaskedGilConstRaster<gil::image_view<Loc> >
+gilConstRaster(const gil::image_view<Loc> &view
+               , const quadtree::MaskCoverage &coverage)
+{
+    return { view, coverage };
+}
+
+template <typename Loc>
+CoverageMaskedGilConstRaster<gil::image_view<Loc> >
+gilConstRaster(gil::image_view<Loc>&&
+               , const quadtree::MaskCoverage&) = delete;
+
+template <typename Loc>
+CoverageMaskedGilConstRaster<gil::image_view<Loc> >
+gilConstRaster(const gil::image_view<Loc>&&
+               , const quadtree::MaskCoverage&) = delete;
+
 } // namespace imgproc
 
 #endif // imgproc_const_raster_hpp_included_
@@ -0,0 +1,320 @@
+/**
+ * Copyright (c) 2018 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "dbglog/dbglog.hpp"
+#include "utility/openmp.hpp"
+
+#include "distance.hpp"
+
+namespace gil = boost::gil;
+
+namespace imgproc {
+
+namespace {
+
+/** Columns are processed in bands of this width in the vertical pass.
+ */
+const int ColumnBandWidth(64);
+
+/** Sentinel for "no valid pixel" in vertical distances.
+ */
+const unsigned int Infinity(std::numeric_limits<unsigned int>::max() / 2);
+
+/** Storage of distances in output view.
+ */
+template <typename View> struct Traits;
+
+template <> struct Traits<gil::gray32f_view_t> {
+    static float store(unsigned int d) {
+        return ((d >= Infinity) ? std::numeric_limits<float>::infinity()
+                : float(d));
+    }
+
+    static unsigned int load(float v) {
+        return (std::isinf(v) ? Infinity : unsigned(v));
+    }
+
+    static double squared(float v) { return double(v) * v; }
+
+    static float distance(double d2) { return std::sqrt(d2); }
+};
+
+/** Vertical distances are saturated as well; saturated value still yields
+ *  saturated distance, i.e. result is exact up to 65535.
+ */
+template <> struct Traits<gil::gray16_view_t> {
+    static std::uint16_t store(unsigned int d) {
+        return std::min(d, 65535u);
+    }
+
+    static unsigned int load(std::uint16_t v) { return v; }
+
+    static double squared(std::uint16_t v) { return double(v) * v; }
+
+    static std::uint16_t distance(double d2) {
+        return std::min(std::round(std::sqrt(d2)), 65535.0);
+    }
+};
+
+/** Vertical pass: distance to the nearest valid pixel in the same column.
+ *  Column bands are processed in parallel, each band sweeps rows down and up.
+ */
+template <typename View, typename Valid>
+void columns(const View &out, const Valid &valid)
+{
+    typedef Traits<View> T;
+
+    const int width(out.width());
+    const int height(out.height());
+    const int bands((width + ColumnBandWidth - 1) / ColumnBandWidth);
+
+    UTILITY_OMP(parallel for schedule(dynamic))
+    for (int b = 0; b < bands; ++b) {
+        const int x0(b * ColumnBandWidth);
+        const int x1(std::min(width, x0 + ColumnBandWidth));
+        unsigned int d[ColumnBandWidth];
+
+        // down: distance to the nearest valid pixel above
+        std::fill_n(d, x1 - x0, Infinity);
+        for (int y(0); y < height; ++y) {
+            auto row(out.row_begin(y));
+            for (int x(x0); x < x1; ++x) {
+                auto &dd(d[x - x0]);
+                dd = valid(x, y) ? 0 : std::min(dd + 1, Infinity);
+                row[x][0] = T::store(dd);
+            }
+        }
+
+        // up: combine with distance to the nearest valid pixel below
+        std::fill_n(d, x1 - x0, Infinity);
+        for (int y(height - 1); y >= 0; --y) {
+            auto row(out.row_begin(y));
+            for (int x(x0); x < x1; ++x) {
+                auto &dd(d[x - x0]);
+                dd = std::min(T::load(row[x][0]), std::min(dd + 1, Infinity));
+                row[x][0] = T::store(dd);
+            }
+        }
+    }
+}
+
+/** Horizontal pass: lower envelope of parabolas rooted at vertical distances
+ *  of each row. Rows are processed in parallel.
+ */
+template <typename View>
+void rows(const View &out)
+{
+    typedef Traits<View> T;
+
+    const int width(out.width());
+    const int height(out.height());
+    const double inf(std::numeric_limits<double>::infinity());
+
+    UTILITY_OMP(parallel)
+    {
+        std::vector<double> f(width);
+        std::vector<int> v(width);
+        std::vector<double> z(width + 1);
+
+        UTILITY_OMP(for schedule(dynamic, 16))
+        for (int y = 0; y < height; ++y) {
+            auto row(out.row_begin(y));
+
+            // build envelope from columns with any valid pixel
+            int k(-1);
+            for (int q(0); q < width; ++q) {
+                f[q] = T::squared(row[q][0]);
+                if (std::isinf(f[q])) { continue; }
+
+                if (k < 0) {
+                    k = 0;
+                    v[0] = q;
+                    z[0] = -inf;
+                    z[1] = inf;
+                    continue;
+                }
+
+                double s;
+                for (;;) {
+                    const int p(v[k]);
+                    s = ((f[q] + double(q) * q) - (f[p] + double(p) * p))
+                        / (2.0 * (q - p));
+                    if (s > z[k]) { break; }
+                    --k;
+                }
+
+                ++k;
+                v[k] = q;
+                z[k] = s;
+                z[k + 1] = inf;
+            }
+
+            if (k < 0) {
+                // no valid pixel at all
+                for (int q(0); q < width; ++q) {
+                    row[q][0] = T::distance(inf);
+                }
+                continue;
+            }
+
+            // sample envelope
+            for (int q(0), j(0); q < width; ++q) {
+                while (z[j + 1] < q) { ++j; }
+                const double dx(q - v[j]);
+                row[q][0] = T::distance(dx * dx + f[v[j]]);
+            }
+        }
+    }
+}
+
+template <typename View>
+void checkDimensions(const math::Size2 &size, const View &out)
+{
+    if ((size.width != int(out.width()))
+        || (size.height != int(out.height())))
+    {
+        LOGTHROW(err1, std::runtime_error)
+            << "Distance transform output has different dimensions than "
+            "the mask.";
+    }
+}
+
+template <typename View, typename Valid>
+void transform(const math::Size2 &size, const View &out, const Valid &valid)
+{
+    checkDimensions(size, out);
+
+    columns(out, valid);
+    rows(out);
+}
+
+template <typename View>
+void transform(const bitfield::RasterMask &mask, const View &out)
+{
+    transform(mask.dims(), out, [&mask](int x, int y)
+    {
+        return mask.get(x, y);
+    });
+}
+
+/** Quadtree mask is rasterized directly into output (valid pixels are zero)
+ *  which then serves as the validity source of the vertical pass; each pixel
+ *  is read before it is overwritten.
+ */
+template <typename View>
+void transform(const quadtree::RasterMask &mask, const View &out)
+{
+    typedef Traits<View> T;
+
+    checkDimensions(mask.dims(), out);
+
+    mask.forEachQuad([&out](unsigned int x, unsigned int y, unsigned int w
+                            , unsigned int h, bool white)
+    {
+        const auto value(T::store(white ? 0 : Infinity));
+        for (auto j(y), ej(y + h); j < ej; ++j) {
+            auto row(out.row_begin(j));
+            for (auto i(x), ei(x + w); i < ei; ++i) { row[i][0] = value; }
+        }
+    });
+
+    columns(out, [&out](int x, int y) { return !T::load(out(x, y)[0]); });
+    rows(out);
+}
+
+} // namespace
+
+void distanceTransform(const bitfield::RasterMask &mask
+                       , const gil::gray32f_view_t &out)
+{
+    transform(mask, out);
+}
+
+void distanceTransform(const bitfield::RasterMask &mask
+                       , const gil::gray16_view_t &out)
+{
+    transform(mask, out);
+}
+
+void distanceTransform(const quadtree::RasterMask &mask
+                       , const gil::gray32f_view_t &out)
+{
+    transform(mask, out);
+}
+
+void distanceTransform(const quadtree::RasterMask &mask
+                       , const gil::gray16_view_t &out)
+{
+    transform(mask, out);
+}
+
+#if IMGPROC_HAS_OPENCV
+cv::Mat distanceTransform(const cv::Mat &mask, int type)
+{
+    if (mask.type() != CV_8UC1) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Distance transform needs CV_8UC1 mask.";
+    }
+
+    const math::Size2 size(mask.cols, mask.rows);
+    auto valid([&mask](int x, int y) -> bool
+    {
+        return mask.at<std::uint8_t>(y, x);
+    });
+
+    cv::Mat out(mask.rows, mask.cols, type);
+    switch (type) {
+    case CV_32FC1:
+        transform(size, gil::interleaved_view
+                  (out.cols, out.rows
+                   , reinterpret_cast<gil::gray32f_pixel_t*>(out.data)
+                   , out.step), valid);
+        break;
+
+    case CV_16UC1:
+        transform(size, gil::interleaved_view
+                  (out.cols, out.rows
+                   , reinterpret_cast<gil::gray16_pixel_t*>(out.data)
+                   , out.step), valid);
+        break;
+
+    default:
+        LOGTHROW(err1, std::runtime_error)
+            << "Distance transform supports only CV_32FC1 and CV_16UC1 "
+            "output.";
+    }
+
+    return out;
+}
+#endif
+
+} // namespace imgproc
@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2018 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file distance.hpp
+ *
+ * Exact Euclidean distance transform of raster masks.
+ */
+
+#ifndef imgproc_distance_hpp_included_
+#define imgproc_distance_hpp_included_
+
+#if IMGPROC_HAS_OPENCV
+#include <opencv2/core/core.hpp>
+#endif
+
+#include "math/boost_gil_all.hpp"
+
+#include "rastermask/bitfield.hpp"
+#include "rastermask/quadtree.hpp"
+
+namespace imgproc {
+
+/** Computes distance of each pixel to the nearest valid (white) pixel of the
+ *  mask, valid pixels get zero. Distance is exact Euclidean distance between
+ *  pixel centers computed in linear time (Felzenszwalb & Huttenlocher);
+ *  columns and rows are processed in parallel.
+ *
+ *  Output view must have the same dimensions as the mask. Output itself is
+ *  used as the only intermediate storage, i.e. there is no other per-pixel
+ *  memory overhead (quadtree mask is rasterized directly into the output).
+ *
+ *  Float output: pixels without any valid pixel get +infinity (i.e. only when
+ *  mask is empty).
+ *
+ *  16-bit output: distances are rounded and saturated at 65535.
+ */
+void distanceTransform(const bitfield::RasterMask &mask
+                       , const boost::gil::gray32f_view_t &out);
+
+void distanceTransform(const bitfield::RasterMask &mask
+                       , const boost::gil::gray16_view_t &out);
+
+void distanceTransform(const quadtree::RasterMask &mask
+                       , const boost::gil::gray32f_view_t &out);
+
+void distanceTransform(const quadtree::RasterMask &mask
+                       , const boost::gil::gray16_view_t &out);
+
+#if IMGPROC_HAS_OPENCV
+/** Distance transform of cv::Mat mask (CV_8UC1, nonzero is valid). Output
+ *  type is either CV_32FC1 or CV_16UC1, see above for details.
+ */
+cv::Mat distanceTransform(const cv::Mat &mask, int type = CV_32FC1);
+#endif
+
+} // namespace imgproc
+
+#endif // imgproc_distance_hpp_included_
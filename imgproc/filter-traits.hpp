@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file filter-traits.hpp
+ *
+ * Compile-time properties of 2D filters.
+ */
+
+#ifndef imgproc_filter_traits_hpp_included_
+#define imgproc_filter_traits_hpp_included_
+
+#include <type_traits>
+
+#include "math/filters.hpp"
+
+namespace imgproc {
+
+/** Marks separable filters, i.e. filter(x, y) = f(x) * g(y) and therefore
+ *  filter(x, y) * filter(0, 0) = filter(x, 0) * filter(0, y).
+ *
+ *  Only marked filters are resampled by separable filtering in transform()
+ *  and can be wrapped in TabulatedFilter2. Specialize for your own filter
+ *  when it is separable.
+ */
+template <typename Filter2>
+struct SeparableFilter2 : std::false_type {};
+
+template <> struct SeparableFilter2<math::SincHamming2> : std::true_type {};
+
+} // namespace imgproc
+
+#endif // imgproc_filter_traits_hpp_included_
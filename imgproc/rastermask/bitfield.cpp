@@ -30,9 +30,13 @@
 
 #include <iostream>
 #include <stdexcept>
-#include <numeric>
+#include <vector>
 #include <cmath>
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #include "dbglog/dbglog.hpp"
 #include "utility/binaryio.hpp"
 #include "math/math.hpp"
@@ -85,21 +89,12 @@ void RasterMask::load(std::istream &f)
     size_.width = width;
     size_.height = height;
     bytes_ = (size_.height * size_.width + 7) >> 3;
-    mask_.reset(new std::uint8_t[bytes_]);
+    mask_.reset(allocate(bytes_));
 
     read(f, mask_.get(), bytes_);
 
     resetTrail();
-
-    // compute count_
-    count_ = std::accumulate
-        (mask_.get(), mask_.get() + bytes_, 0u
-         , [](unsigned int value, std::uint8_t byte) {
-            return (value + (byte & 0x01) + ((byte & 0x02) >> 1)
-                    + ((byte & 0x04) >> 2) + ((byte & 0x08) >> 3)
-                    + ((byte & 0x10) >> 4) + ((byte & 0x20) >> 5)
-                    + ((byte & 0x40) >> 6) + ((byte & 0x80) >> 7));
-        });
+    recount();
 }
 
 namespace {
@@ -175,6 +170,371 @@ void RasterMask::writeData(std::ostream &f) const
 void RasterMask::readData(std::istream &f)
 {
     read(f, mask_.get(), bytes_);
+    resetTrail();
+    recount();
+}
+
+namespace {
+
+/** Mask data are processed in 64-bit words. Pixel with offset i is bit
+ *  (i & 63) of word (i >> 6) (on little-endian machines the byte layout is
+ *  the same).
+ */
+typedef std::uint64_t Word;
+const unsigned int WordBits(64);
+
+inline std::size_t wordCount(std::size_t bytes) { return (bytes + 7) >> 3; }
+
+inline Word loadWord(const std::uint8_t *data, std::size_t index)
+{
+    Word w;
+    std::memcpy(&w, data + (index << 3), sizeof(w));
+    return w;
+}
+
+inline void storeWord(std::uint8_t *data, std::size_t index, Word w)
+{
+    std::memcpy(data + (index << 3), &w, sizeof(w));
+}
+
+inline std::size_t popcount(Word w) { return __builtin_popcountll(w); }
+
+struct Or {
+    static Word apply(Word a, Word b) { return a | b; }
+#ifdef __AVX2__
+    static __m256i apply(__m256i a, __m256i b) {
+        return _mm256_or_si256(a, b);
+    }
+#endif
+};
+
+struct And {
+    static Word apply(Word a, Word b) { return a & b; }
+#ifdef __AVX2__
+    static __m256i apply(__m256i a, __m256i b) {
+        return _mm256_and_si256(a, b);
+    }
+#endif
+};
+
+struct AndNot {
+    static Word apply(Word a, Word b) { return a & ~b; }
+#ifdef __AVX2__
+    static __m256i apply(__m256i a, __m256i b) {
+        return _mm256_andnot_si256(b, a);
+    }
+#endif
+};
+
+/** dst = Op(dst, src) over given number of words, returns number of set
+ *  bits in the result.
+ */
+template <typename Op>
+std::size_t combine(std::uint8_t *dst, const std::uint8_t *src
+                    , std::size_t words)
+{
+    std::size_t count(0);
+    std::size_t i(0);
+
+#ifdef __AVX2__
+    for (; (i + 4) <= words; i += 4) {
+        auto *d(reinterpret_cast<__m256i*>(dst + (i << 3)));
+        const auto *s(reinterpret_cast<const __m256i*>(src + (i << 3)));
+        _mm256_storeu_si256
+            (d, Op::apply(_mm256_loadu_si256(d), _mm256_loadu_si256(s)));
+
+        // result is hot in cache, count per word
+        count += (popcount(loadWord(dst, i)) + popcount(loadWord(dst, i + 1))
+                  + popcount(loadWord(dst, i + 2)) + popcount(loadWord(dst, i + 3)));
+    }
+#endif
+
+    for (; i < words; ++i) {
+        const auto w(Op::apply(loadWord(dst, i), loadWord(src, i)));
+        storeWord(dst, i, w);
+        count += popcount(w);
+    }
+
+    return count;
+}
+
+/** data = ~data over given number of words.
+ */
+void negate(std::uint8_t *data, std::size_t words)
+{
+    std::size_t i(0);
+
+#ifdef __AVX2__
+    const auto ones(_mm256_set1_epi64x(-1));
+    for (; (i + 4) <= words; i += 4) {
+        auto *d(reinterpret_cast<__m256i*>(data + (i << 3)));
+        _mm256_storeu_si256(d, _mm256_xor_si256(_mm256_loadu_si256(d), ones));
+    }
+#endif
+
+    for (; i < words; ++i) { storeWord(data, i, ~loadWord(data, i)); }
+}
+
+/** Extracts width bits starting at given bit offset into aligned words.
+ *  Bits past width are set to fill.
+ */
+void extractRow(const std::uint8_t *data, std::size_t offset, int width
+                , Word *row, Word fill)
+{
+    const std::size_t words((width + WordBits - 1) / WordBits);
+    for (std::size_t k(0); k < words; ++k, offset += WordBits) {
+        const auto byte(offset >> 3);
+        const auto shift(offset & 0x7);
+
+        Word w;
+        std::memcpy(&w, data + byte, sizeof(w));
+        if (shift) { w = (w >> shift) | (Word(data[byte + 8]) << (64 - shift)); }
+        row[k] = w;
+    }
+
+    if (const auto rest = (width % WordBits)) {
+        const auto valid((Word(1) << rest) - 1);
+        row[words - 1] = (row[words - 1] & valid) | (fill & ~valid);
+    }
+}
+
+/** ORs width bits of row into data at given bit offset. Bits past width must
+ *  be zero.
+ */
+void depositRow(std::uint8_t *data, std::size_t offset, int width
+                , const Word *row)
+{
+    const std::size_t words((width + WordBits - 1) / WordBits);
+    for (std::size_t k(0); k < words; ++k, offset += WordBits) {
+        const auto index(offset / WordBits);
+        const auto shift(offset % WordBits);
+
+        storeWord(data, index, loadWord(data, index) | (row[k] << shift));
+        if (shift) {
+            storeWord(data, index + 1
+                  , loadWord(data, index + 1) | (row[k] >> (WordBits - shift)));
+        }
+    }
+}
+
+/** Horizontal erosion: pixel survives if both its horizontal neighbours are
+ *  set. Pixels outside the row are considered set.
+ */
+void erodeRow(const Word *row, Word *out, std::size_t words)
+{
+    for (std::size_t k(0); k < words; ++k) {
+        const Word left((row[k] << 1) | (k ? (row[k - 1] >> 63) : 1));
+        const Word right((row[k] >> 1)
+                         | (((k + 1) < words) ? (row[k + 1] << 63)
+                            : (Word(1) << 63)));
+        out[k] = row[k] & left & right;
+    }
+}
+
+} // namespace
+
+void RasterMask::clearPadding()
+{
+    resetTrail();
+    std::memset(mask_.get() + bytes_, 0, (wordCount(bytes_) << 3) - bytes_);
+}
+
+namespace {
+
+/** Calls op(wordIndex, mask) for each word touched by given bit range.
+ */
+template <typename Op>
+void forEachWord(std::size_t offset, std::size_t length, const Op &op)
+{
+    if (!length) { return; }
+
+    const auto first(offset / WordBits);
+    const auto last((offset + length - 1) / WordBits);
+    const Word head(~Word(0) << (offset % WordBits));
+    const Word tail(~Word(0) >> (WordBits - 1
+                                 - ((offset + length - 1) % WordBits)));
+
+    if (first == last) {
+        op(first, head & tail);
+        return;
+    }
+
+    op(first, head);
+    for (auto i(first + 1); i < last; ++i) { op(i, ~Word(0)); }
+    op(last, tail);
+}
+
+} // namespace
+
+void RasterMask::fillBits(std::size_t offset, std::size_t length, bool value)
+{
+    auto *data(mask_.get());
+    if (value) {
+        forEachWord(offset, length, [&](std::size_t i, Word mask)
+        {
+            storeWord(data, i, loadWord(data, i) | mask);
+        });
+    } else {
+        forEachWord(offset, length, [&](std::size_t i, Word mask)
+        {
+            storeWord(data, i, loadWord(data, i) & ~mask);
+        });
+    }
+}
+
+std::size_t RasterMask::countBits(std::size_t offset, std::size_t length)
+    const
+{
+    const auto *data(mask_.get());
+    std::size_t count(0);
+    forEachWord(offset, length, [&](std::size_t i, Word mask)
+    {
+        count += popcount(loadWord(data, i) & mask);
+    });
+    return count;
+}
+
+bool RasterMask::clipSpan(int &x, int y, int &length) const
+{
+    if ((y < 0) || (y >= size_.height)) { return false; }
+    if (x < 0) {
+        length += x;
+        x = 0;
+    }
+    length = std::min(length, size_.width - x);
+    return length > 0;
+}
+
+void RasterMask::setSpan(int x, int y, int length, bool value)
+{
+    if (!clipSpan(x, y, length)) { return; }
+
+    const auto offset(std::size_t(size_.width) * y + x);
+    const auto before(countBits(offset, length));
+    fillBits(offset, length, value);
+    count_ = count_ - before + (value ? length : 0);
+}
+
+std::size_t RasterMask::countSpan(int x, int y, int length) const
+{
+    if (!clipSpan(x, y, length)) { return 0; }
+    return countBits(std::size_t(size_.width) * y + x, length);
+}
+
+void RasterMask::recount()
+{
+    std::size_t count(0);
+    const auto *data(mask_.get());
+    for (std::size_t i(0), e(wordCount(bytes_)); i != e; ++i) {
+        count += popcount(loadWord(data, i));
+    }
+    count_ = count;
+}
+
+void RasterMask::invert()
+{
+    negate(mask_.get(), wordCount(bytes_));
+    clearPadding();
+    count_ = math::area(size_) - count_;
+}
+
+namespace {
+
+void checkDims(const math::Size2 &a, const math::Size2 &b
+               , const char *what)
+{
+    if ((a.width != b.width) || (a.height != b.height)) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Attempt to " << what << " mask with diferent dimensions.";
+    }
+}
+
+} // namespace
+
+void RasterMask::merge(const RasterMask &op)
+{
+    checkDims(size_, op.size_, "merge");
+    count_ = combine<Or>(mask_.get(), op.mask_.get(), wordCount(bytes_));
+}
+
+void RasterMask::intersect(const RasterMask &op)
+{
+    checkDims(size_, op.size_, "intersect");
+    count_ = combine<And>(mask_.get(), op.mask_.get(), wordCount(bytes_));
+}
+
+void RasterMask::subtract(const RasterMask &op)
+{
+    checkDims(size_, op.size_, "subtract");
+    count_ = combine<AndNot>(mask_.get(), op.mask_.get(), wordCount(bytes_));
+}
+
+bool RasterMask::onBoundary(int x, int y) const
+{
+    if (!get(x, y)) { return false; }
+
+    for (int j(-1); j <= 1; ++j) {
+        for (int i(-1); i <= 1; ++i) {
+            if (!(i || j)) { continue; }
+            const int xx(x + i), yy(y + j);
+            if ((xx < 0) || (yy < 0) || (xx >= size_.width)
+                || (yy >= size_.height))
+            {
+                continue;
+            }
+            if (!get(xx, yy)) { return true; }
+        }
+    }
+
+    return false;
+}
+
+RasterMask RasterMask::boundary() const
+{
+    RasterMask result(size_, EMPTY);
+    if (!size_.width || !size_.height) { return result; }
+
+    const auto width(size_.width);
+    const std::size_t words((width + WordBits - 1) / WordBits);
+    const Word ones(~Word(0));
+
+    // raw rows (current, next) and horizontally eroded rows (previous,
+    // current, next); rows outside the mask are considered full
+    std::vector<Word> raw(words), rawNext(words), out(words);
+    std::vector<Word> prev(words, ones), cur(words), next(words);
+
+    const auto *data(mask_.get());
+    extractRow(data, 0, width, raw.data(), ones);
+    erodeRow(raw.data(), cur.data(), words);
+
+    const Word lastValid((width % WordBits)
+                         ? ((Word(1) << (width % WordBits)) - 1) : ones);
+
+    for (int y(0); y < size_.height; ++y) {
+        if ((y + 1) < size_.height) {
+            extractRow(data, std::size_t(width) * (y + 1), width
+                       , rawNext.data(), ones);
+            erodeRow(rawNext.data(), next.data(), words);
+        } else {
+            std::fill(next.begin(), next.end(), ones);
+        }
+
+        // boundary pixel: set but not surviving 3x3 erosion
+        for (std::size_t k(0); k < words; ++k) {
+            out[k] = raw[k] & ~(prev[k] & cur[k] & next[k]);
+        }
+        out[words - 1] &= lastValid;
+
+        depositRow(result.mask_.get(), std::size_t(width) * y, width
+                   , out.data());
+
+        std::swap(prev, cur);
+        std::swap(cur, next);
+        std::swap(raw, rawNext);
+    }
+
+    result.recount();
+    return result;
 }
 
 } } // namespace imgproc::bitfield
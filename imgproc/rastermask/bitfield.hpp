@@ -48,6 +48,10 @@
 
 /**** bit-field version of rastermask ****/
 
+namespace imgproc { namespace quadtree {
+class RasterMask;
+} } // imgproc::quadtree
+
 namespace imgproc { namespace bitfield {
 
 class RasterMask {
@@ -80,21 +84,37 @@ public:
     bool empty() const { return count_; }
 
     /** invert a mask (negate pixels) */
-    void invert() {
-        std::transform(mask_.get(), mask_.get() + bytes_
-                       , mask_.get(), [](std::uint8_t b) { return ~b; });
-    }
+    void invert();
 
-    /** FIXME: IMPLEMENT ME
-     *  do a set difference with two masks. */
+    /** do a set difference with two masks. */
     void subtract( const RasterMask & op );
 
+    /** do a set union with two masks. */
+    void merge(const RasterMask &op);
+
+    /** do a set intersection with two masks. */
+    void intersect(const RasterMask &op);
+
+    /** Recomputes number of set pixels from mask data.
+     */
+    void recount();
+
     /** implement! obtain mask value at given pos. */
     bool get(int x, int y) const;
 
     /** set mask value at given pos. */
     void set(int x, int y, bool value = true);
 
+    /** Sets length pixels of row y starting at x to given value. Span is
+     *  clipped to the row; whole words are set at once.
+     */
+    void setSpan(int x, int y, int length, bool value = true);
+
+    /** Returns number of set pixels in length pixels of row y starting at x.
+     *  Span is clipped to the row; whole words are counted at once.
+     */
+    std::size_t countSpan(int x, int y, int length) const;
+
     /** Optimized version of set(x, y, true);
      */
     void add(int x, int y);
@@ -103,11 +123,15 @@ public:
      */
     void remove(int x, int y);
 
-    /** FIXME: IMPLEMENT ME
-     *  test if a given pixel is a boundary pixel (neighboring unset
+    /** test if a given pixel is a boundary pixel (neighboring unset
      *  pixel in mask */
     bool onBoundary( int x, int y ) const;
 
+    /** Returns mask of all boundary pixels (see onBoundary). Whole rows are
+     *  processed at once.
+     */
+    RasterMask boundary() const;
+
     /** dump mask to stream */
     void dump(std::ostream &f) const;
 
@@ -133,6 +157,30 @@ public:
     }
 
 private:
+    /** Allocates zeroed storage for given byte count. Storage is padded to
+     *  whole 64-bit words plus one spare word to allow word-level access.
+     */
+    static std::uint8_t* allocate(std::size_t bytes);
+
+    /** Clears all bits past the last pixel, including word padding.
+     */
+    void clearPadding();
+
+    /** Fills length bits starting at given bit offset with value. Pixel
+     *  count is not updated. Only words touched by the range are written.
+     */
+    void fillBits(std::size_t offset, std::size_t length, bool value);
+
+    /** Counts set bits in given range.
+     */
+    std::size_t countBits(std::size_t offset, std::size_t length) const;
+
+    /** Clips span to row, returns false if nothing is left.
+     */
+    bool clipSpan(int &x, int y, int &length) const;
+
+    friend class quadtree::RasterMask;
+
     math::Size2 size_;
     std::size_t bytes_;
     boost::scoped_array<std::uint8_t> mask_;
@@ -169,7 +217,7 @@ RasterMask fromRaster(const ConstRaster &raster, const Threshold &threshold);
 
 inline RasterMask::RasterMask(const math::Size2 &size, InitMode mode)
     : size_(size), bytes_(byteCount(size_))
-    , mask_(new std::uint8_t[bytes_])
+    , mask_(allocate(bytes_))
     , count_((mode == EMPTY) ? 0 : math::area(size_))
 {
     std::memset(mask_.get(), (mode == EMPTY) ? 0x00 : 0xff, bytes_);
@@ -179,7 +227,7 @@ inline RasterMask::RasterMask(const math::Size2 &size, InitMode mode)
 inline RasterMask::RasterMask(int width, int height
                               , InitMode mode)
     : size_(width, height), bytes_(byteCount(size_))
-    , mask_(new std::uint8_t[bytes_])
+    , mask_(allocate(bytes_))
     , count_((mode == EMPTY) ? 0 : math::area(size_))
 {
     std::memset(mask_.get(), (mode == EMPTY) ? 0x00 : 0xff, bytes_);
@@ -189,7 +237,7 @@ inline RasterMask::RasterMask(int width, int height
 /** initialize a mask of the same order, optionally copying mask. */
 inline RasterMask::RasterMask(const RasterMask &o, InitMode mode)
     : size_(o.size_), bytes_(o.bytes_)
-    , mask_(new std::uint8_t[bytes_])
+    , mask_(allocate(bytes_))
     , count_((mode == EMPTY) ? 0 : math::area(size_))
 {
     if (mode == SOURCE) {
@@ -197,6 +245,9 @@ inline RasterMask::RasterMask(const RasterMask &o, InitMode mode)
         std::memcpy(mask_.get(), o.mask_.get(), bytes_);
         resetTrail();
         count_ = o.count_;
+    } else if (mode == FULL) {
+        std::memset(mask_.get(), 0xff, bytes_);
+        resetTrail();
     }
 }
 
@@ -208,7 +259,7 @@ inline RasterMask& RasterMask::operator=(const RasterMask &o) {
 
     size_ = o.size_;
     bytes_ = o.bytes_;
-    mask_.reset(new std::uint8_t[bytes_]);
+    mask_.reset(allocate(bytes_));
 
     // deep copy
     std::memcpy(mask_.get(), o.mask_.get(), bytes_);
@@ -220,7 +271,7 @@ inline RasterMask& RasterMask::create(const math::Size2 &size, InitMode mode)
 {
     size_ = size;
     bytes_ = (size.height * size.width + 7) >> 3;
-    mask_.reset(new std::uint8_t[bytes_]);
+    mask_.reset(allocate(bytes_));
     count_ = ((mode == EMPTY) ? 0 : size.height * size.width);
     std::memset(mask_.get(), (mode == EMPTY) ? 0x00 : 0xff, bytes_);
     resetTrail();
@@ -291,6 +342,11 @@ inline void RasterMask::remove(int x, int y)
     }
 }
 
+inline std::uint8_t* RasterMask::allocate(std::size_t bytes)
+{
+    return new std::uint8_t[(((bytes + 7) >> 3) + 1) << 3]();
+}
+
 inline void RasterMask::resetTrail()
 {
     mask_[bytes_ - 1] &=
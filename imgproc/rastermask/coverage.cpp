@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file rastermask/coverage.cpp
+ *
+ * Tile-level coverage of quadtree raster mask.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "dbglog/dbglog.hpp"
+
+#include "coverage.hpp"
+
+namespace imgproc { namespace quadtree {
+
+namespace {
+
+unsigned int checkTileDepth(unsigned int tileDepth)
+{
+    // tile pixel count must fit into 32 bits
+    if (tileDepth > 15) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Tile depth " << tileDepth << " too large (max 15).";
+    }
+    return tileDepth;
+}
+
+} // namespace
+
+MaskCoverage::MaskCoverage(const RasterMask &mask, unsigned int tileDepth)
+    : mask_(mask), tileDepth_(checkTileDepth(tileDepth))
+    , sizeX_(mask.dims().width), sizeY_(mask.dims().height)
+    , tilesX_((sizeX_ + (1 << tileDepth_) - 1) >> tileDepth_)
+    , tilesY_((sizeY_ + (1 << tileDepth_) - 1) >> tileDepth_)
+{
+    // count white pixels in each tile
+    std::vector<std::uint32_t> counts(std::size_t(tilesX_) * tilesY_);
+    mask.forEachQuad([&](unsigned int x, unsigned int y
+                         , unsigned int xsize, unsigned int ysize, bool)
+    {
+        const auto ex(x + xsize);
+        const auto ey(y + ysize);
+        const auto tx1((ex - 1) >> tileDepth_);
+        const auto ty1((ey - 1) >> tileDepth_);
+
+        for (auto ty(y >> tileDepth_); ty <= ty1; ++ty) {
+            // quad/tile intersection
+            const auto h(std::min(ey, (ty + 1) << tileDepth_)
+                         - std::max(y, ty << tileDepth_));
+            for (auto tx(x >> tileDepth_); tx <= tx1; ++tx) {
+                const auto w(std::min(ex, (tx + 1) << tileDepth_)
+                             - std::max(x, tx << tileDepth_));
+                counts[ty * tilesX_ + tx] += w * h;
+            }
+        }
+    }, RasterMask::Filter::white);
+
+    // classify tiles, tiles at right/bottom border are clipped by mask
+    tiles_.resize(counts.size());
+    for (int ty(0); ty < tilesY_; ++ty) {
+        const auto h(std::min(sizeY_, (ty + 1) << tileDepth_)
+                     - (ty << tileDepth_));
+        for (int tx(0); tx < tilesX_; ++tx) {
+            const auto w(std::min(sizeX_, (tx + 1) << tileDepth_)
+                         - (tx << tileDepth_));
+            const auto count(counts[ty * tilesX_ + tx]);
+            tiles_[ty * tilesX_ + tx]
+                = (!count ? TileCoverage::invalid
+                   : ((count == std::uint32_t(w * h)) ? TileCoverage::valid
+                      : TileCoverage::mixed));
+        }
+    }
+}
+
+TileCoverage MaskCoverage::window(int x1, int y1, int x2, int y2) const
+{
+    // clip window to mask
+    const bool inside((x1 >= 0) && (y1 >= 0)
+                      && (x2 < sizeX_) && (y2 < sizeY_));
+    x1 = std::max(x1, 0);
+    y1 = std::max(y1, 0);
+    x2 = std::min(x2, sizeX_ - 1);
+    y2 = std::min(y2, sizeY_ - 1);
+    if ((x1 > x2) || (y1 > y2)) { return TileCoverage::invalid; }
+
+    const int tx1(x2 >> tileDepth_);
+    const int ty1(y2 >> tileDepth_);
+
+    // all tiles must have the same coverage, pixels outside of mask are
+    // invalid
+    const auto coverage(at(x1 >> tileDepth_, y1 >> tileDepth_));
+    if ((coverage == TileCoverage::mixed)
+        || (!inside && (coverage == TileCoverage::valid)))
+    {
+        return TileCoverage::mixed;
+    }
+
+    for (int ty(y1 >> tileDepth_); ty <= ty1; ++ty) {
+        for (int tx(x1 >> tileDepth_); tx <= tx1; ++tx) {
+            if (at(tx, ty) != coverage) { return TileCoverage::mixed; }
+        }
+    }
+
+    return coverage;
+}
+
+} } // namespace imgproc::quadtree
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file rastermask/coverage.hpp
+ *
+ * Tile-level coverage of quadtree raster mask.
+ */
+
+#ifndef imgproc_rastermask_coverage_hpp_included_
+#define imgproc_rastermask_coverage_hpp_included_
+
+#include <vector>
+#include <cstdint>
+
+#include "math/geometry_core.hpp"
+
+#include "quadtree.hpp"
+
+namespace imgproc { namespace quadtree {
+
+/** Coverage of a region (tile, window) by mask.
+ */
+enum class TileCoverage : std::uint8_t {
+    invalid   // no pixel is set (or region lies outside of mask)
+    , valid   // all pixels are set
+    , mixed   // anything else
+};
+
+/** Mask split into square tiles of 2^tileDepth pixels, each tile classified
+ *  as fully valid, fully invalid or mixed. Classification is computed from
+ *  white quads (forEachQuad) in one pass, i.e. in O(quads + tiles) time.
+ *
+ *  Allows answering questions about whole regions (e.g. filtering windows)
+ *  without descending the tree for every pixel; get() descends the tree only
+ *  for pixels in mixed tiles.
+ *
+ *  Mask is only referenced and must not be modified while coverage is in
+ *  use. Coverage itself is immutable, i.e. it can be shared by multiple
+ *  threads.
+ */
+class MaskCoverage {
+public:
+    explicit MaskCoverage(const RasterMask &mask, unsigned int tileDepth = 4);
+    MaskCoverage(RasterMask &&mask, unsigned int tileDepth = 4) = delete;
+    MaskCoverage(const RasterMask &&mask, unsigned int tileDepth = 4)
+        = delete;
+
+    const RasterMask& mask() const { return mask_; }
+
+    /** Tile size in pixels.
+     */
+    unsigned int tileSize() const { return 1u << tileDepth_; }
+
+    /** Coverage of tile containing given pixel. Pixels outside of mask lie
+     *  in invalid tiles.
+     */
+    TileCoverage tile(int x, int y) const;
+
+    /** Coverage of window [x1, x2] x [y1, y2] (inclusive). Window reaching
+     *  outside of mask is never valid.
+     */
+    TileCoverage window(int x1, int y1, int x2, int y2) const;
+
+    /** Returns value of given pixel; same as mask().get(x, y).
+     */
+    bool get(int x, int y) const;
+
+private:
+    TileCoverage at(int tx, int ty) const { return tiles_[ty * tilesX_ + tx]; }
+
+    const RasterMask &mask_;
+    unsigned int tileDepth_;
+    int sizeX_, sizeY_;
+    int tilesX_, tilesY_;
+    std::vector<TileCoverage> tiles_;
+};
+
+// inlines
+
+inline TileCoverage MaskCoverage::tile(int x, int y) const
+{
+    if ((x < 0) || (y < 0) || (x >= sizeX_) || (y >= sizeY_)) {
+        return TileCoverage::invalid;
+    }
+    return at(x >> tileDepth_, y >> tileDepth_);
+}
+
+inline bool MaskCoverage::get(int x, int y) const
+{
+    switch (tile(x, y)) {
+    case TileCoverage::invalid: return false;
+    case TileCoverage::valid: return true;
+    default: break;
+    }
+    return mask_.get(x, y);
+}
+
+} } // namespace imgproc::quadtree
+
+#endif // imgproc_rastermask_coverage_hpp_included_
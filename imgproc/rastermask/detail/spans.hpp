@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2018 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file rastermask/detail/spans.hpp
+ *
+ * Helper for emitting maximal horizontal runs from quad-tree rows.
+ */
+
+#ifndef imgproc_rastermask_detail_spans_hpp_included_
+#define imgproc_rastermask_detail_spans_hpp_included_
+
+#include <algorithm>
+
+namespace imgproc { namespace detail {
+
+/** Collects pieces of single row (in left to right order) into maximal runs
+ *  of the same value and calls op(y, x0, x1, value) for each run [x0, x1).
+ *  Pieces are clipped to [x0, x1) given to constructor. Last run is emitted
+ *  by flush().
+ */
+template <typename Op>
+class SpanBuilder {
+public:
+    SpanBuilder(const Op &op, unsigned int y, unsigned int x0
+                , unsigned int x1)
+        : op_(op), y_(y), x0_(x0), x1_(x1)
+        , start_(), end_(), value_(), valid_(false)
+    {}
+
+    void add(unsigned int start, unsigned int end, bool value) {
+        start = std::max(start, x0_);
+        end = std::min(end, x1_);
+        if (start >= end) { return; }
+
+        if (valid_ && (value == value_) && (start == end_)) {
+            end_ = end;
+            return;
+        }
+
+        flush();
+        start_ = start;
+        end_ = end;
+        value_ = value;
+        valid_ = true;
+    }
+
+    void flush() {
+        if (!valid_) { return; }
+        valid_ = false;
+        op_(y_, start_, end_, value_);
+    }
+
+    /** Returns true if given range intersects clipping range. */
+    bool inside(unsigned int start, unsigned int end) const {
+        return (start < x1_) && (end > x0_);
+    }
+
+private:
+    const Op &op_;
+    unsigned int y_;
+    unsigned int x0_;
+    unsigned int x1_;
+    unsigned int start_;
+    unsigned int end_;
+    bool value_;
+    bool valid_;
+};
+
+} } // namespace imgproc::detail
+
+#endif // imgproc_rastermask_detail_spans_hpp_included_
@@ -0,0 +1,206 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file rastermask/frozenqtree.cpp
+ * @author Vaclav Blazek <vaclav.blazek@citationtech.net>
+ *
+ * Frozen (immutable) quad-tree raster mask snapshot
+ */
+
+#include "frozenqtree.hpp"
+
+namespace imgproc { namespace frozenqtree {
+
+namespace {
+
+/** Lookup table is never smaller than this (in cells) unless the whole
+ *  mask is smaller.
+ */
+const std::size_t MinTableSize(4096);
+
+/** First children block starts here, i.e. indices cannot be confused with
+ *  leaf values.
+ */
+const std::size_t FirstBlock(4);
+
+} // namespace
+
+RasterMask::RasterMask()
+    : sizeX_(), sizeY_(), depth_(), quadSize_(1), count_()
+{
+    std::shared_ptr<Tree> tree(new Tree());
+    tree->root = Black;
+    tree->table.assign(1, Black);
+    tree->tableDepth = 0;
+    tree_ = tree;
+}
+
+RasterMask::RasterMask(const quadtree::RasterMask &mask)
+    : sizeX_(mask.sizeX_), sizeY_(mask.sizeY_)
+    , depth_(mask.depth_), quadSize_(mask.quadSize_)
+    , count_(mask.count_)
+{
+    typedef quadtree::RasterMask::Node Node;
+    typedef quadtree::RasterMask::NodeType NodeType;
+
+    std::shared_ptr<Tree> tree(new Tree());
+    auto &nodes(tree->nodes);
+    nodes.assign(FirstBlock, Black);
+
+    // depth-first conversion, children of each node are allocated together
+    struct Converter {
+        Converter(std::vector<std::uint32_t> &nodes) : nodes(nodes) {}
+
+        std::uint32_t convert(const Node &node) {
+            switch (node.type) {
+            case NodeType::WHITE: return White;
+            case NodeType::BLACK: return Black;
+            case NodeType::GRAY: break;
+            }
+
+            const std::uint32_t index(nodes.size());
+            nodes.resize(index + 4);
+
+            // NB: vector can be reallocated by children, assign afterwards
+            const auto &c(*node.children);
+            const auto ul(convert(c.ul));
+            const auto ur(convert(c.ur));
+            const auto ll(convert(c.ll));
+            const auto lr(convert(c.lr));
+
+            nodes[index] = ul;
+            nodes[index + 1] = ur;
+            nodes[index + 2] = ll;
+            nodes[index + 3] = lr;
+            return index;
+        }
+
+        std::vector<std::uint32_t> &nodes;
+    };
+
+    tree->root = Converter(nodes).convert(mask.root_);
+    nodes.shrink_to_fit();
+
+    // table is not larger than node array
+    const auto limit(std::max(nodes.size(), MinTableSize));
+    unsigned int tableDepth(0);
+    while ((tableDepth < depth_)
+           && ((std::size_t(4) << (2 * tableDepth)) <= limit))
+    {
+        ++tableDepth;
+    }
+    tree->tableDepth = tableDepth;
+
+    // fill table
+    const std::size_t tableSize(std::size_t(1) << tableDepth);
+    auto &table(tree->table);
+    table.resize(tableSize * tableSize);
+
+    struct Filler {
+        Filler(const std::vector<std::uint32_t> &nodes
+               , std::vector<std::uint32_t> &table, unsigned int tableDepth)
+            : nodes(nodes), table(table), tableDepth(tableDepth)
+        {}
+
+        /** Fills table cells covered by given entry at given depth.
+         */
+        void fill(std::uint32_t entry, unsigned int depth, std::size_t x
+                  , std::size_t y)
+        {
+            const auto shift(tableDepth - depth);
+
+            if (!shift) {
+                table[(y << tableDepth) + x] = entry;
+                return;
+            }
+
+            if (entry <= White) {
+                // leaf: fill its square
+                const std::size_t size(std::size_t(1) << shift);
+                x <<= shift;
+                y <<= shift;
+                for (std::size_t j(y), ej(y + size); j < ej; ++j) {
+                    auto *row(&table[(j << tableDepth) + x]);
+                    std::fill(row, row + size, entry);
+                }
+                return;
+            }
+
+            ++depth;
+            fill(nodes[entry], depth, 2 * x, 2 * y);
+            fill(nodes[entry + 1], depth, 2 * x + 1, 2 * y);
+            fill(nodes[entry + 2], depth, 2 * x, 2 * y + 1);
+            fill(nodes[entry + 3], depth, 2 * x + 1, 2 * y + 1);
+        }
+
+        const std::vector<std::uint32_t> &nodes;
+        std::vector<std::uint32_t> &table;
+        const unsigned int tableDepth;
+    };
+
+    Filler(nodes, table, tableDepth).fill(tree->root, 0, 0, 0);
+
+    tree_ = tree;
+}
+
+quadtree::RasterMask RasterMask::asQuadtree() const
+{
+    typedef quadtree::RasterMask::Node Node;
+    typedef quadtree::RasterMask::NodeType NodeType;
+
+    quadtree::RasterMask mask(size(), quadtree::RasterMask::EMPTY);
+
+    struct Converter {
+        Converter(quadtree::RasterMask &mask
+                  , const std::vector<std::uint32_t> &nodes)
+            : mask(mask), nodes(nodes)
+        {}
+
+        void convert(Node &node, std::uint32_t entry) {
+            if (entry <= White) {
+                node.type = (entry == White) ? NodeType::WHITE
+                    : NodeType::BLACK;
+                return;
+            }
+
+            node.type = NodeType::GRAY;
+            node.children = mask.malloc();
+            convert(node.children->ul, nodes[entry]);
+            convert(node.children->ur, nodes[entry + 1]);
+            convert(node.children->ll, nodes[entry + 2]);
+            convert(node.children->lr, nodes[entry + 3]);
+        }
+
+        quadtree::RasterMask &mask;
+        const std::vector<std::uint32_t> &nodes;
+    };
+
+    Converter(mask, tree_->nodes).convert(mask.root_, tree_->root);
+    mask.recount();
+    return mask;
+}
+
+} } // namespace imgproc::frozenqtree
@@ -0,0 +1,262 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file rastermask/frozenqtree.hpp
+ * @author Vaclav Blazek <vaclav.blazek@citationtech.net>
+ *
+ * Frozen (immutable) quad-tree raster mask snapshot
+ */
+
+#ifndef imgproc_rastermask_frozenqtree_hpp_included_
+#define imgproc_rastermask_frozenqtree_hpp_included_
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "math/geometry_core.hpp"
+
+#include "quadtree.hpp"
+#include "detail/spans.hpp"
+
+/**** frozen quad-tree version of rastermask ****/
+
+/** Layout:
+ *
+ *  Tree is stored in a single array of 32-bit entries. Each entry holds
+ *  either a leaf value (Black, White) or index of the first of 4
+ *  consecutive entries holding its children (UL, UR, LL, LR). Entries
+ *  0-3 are unused so any index is greater than leaf values.
+ *
+ *  Lookup table holds entries of all quads at table depth, i.e. get() jumps
+ *  directly to the table cell and descends only the levels below it. Table
+ *  depth is chosen so that the table is not larger than the node array
+ *  (small masks get table at full depth and therefore O(1) get()).
+ *
+ *  Snapshot is never modified after construction: all member functions are
+ *  const and do not touch any shared state, therefore one snapshot (or its
+ *  copies, which share data) can be used from any number of threads without
+ *  locking.
+ */
+
+namespace imgproc { namespace frozenqtree {
+
+class RasterMask {
+public:
+    typedef quadtree::RasterMask::Filter Filter;
+
+    /** Empty (0x0) mask.
+     */
+    RasterMask();
+
+    /** Takes snapshot of quadtree raster mask.
+     */
+    explicit RasterMask(const quadtree::RasterMask &mask);
+
+    math::Size2 size() const { return math::Size2(sizeX_, sizeY_); }
+
+    math::Size2 dims() const { return math::Size2(sizeX_, sizeY_); }
+
+    /** Returns maximal depth of tree.
+     */
+    unsigned int depth() const { return depth_; }
+
+    /** obtain mask value at given pos, return false if x, y out of bounds */
+    bool get(int x, int y) const;
+
+    /** return mask size (number of white pixels) */
+    unsigned long long count() const { return count_; }
+
+    /** return total number of pixels */
+    unsigned long long capacity() const {
+        return (unsigned long long)(sizeX_) * (unsigned long long)(sizeY_);
+    }
+
+    /** test mask for emptiness */
+    bool empty() const { return count_ == 0; }
+
+    bool full() const { return count_ == capacity(); }
+
+    /** Number of bytes occupied by tree data and lookup table.
+     */
+    std::size_t memoryUsage() const {
+        return (tree_->nodes.size() + tree_->table.size())
+            * sizeof(std::uint32_t);
+    }
+
+    /** Runs op(x, y, xsize, ysize, white) for each black/white quad inside
+     *  the mask.
+     */
+    template <typename Op>
+    void forEachQuad(const Op &op, Filter filter = Filter::both) const;
+
+    /** Runs op(y, x0, x1, white) for each maximal horizontal run [x0, x1) of
+     *  black/white pixels, row by row.
+     */
+    template <typename Op>
+    void forEachSpan(const Op &op, Filter filter = Filter::both) const;
+
+    /** Converts snapshot back to (mutable) quadtree raster mask.
+     */
+    quadtree::RasterMask asQuadtree() const;
+
+    /** Entry leaf values.
+     */
+    enum : std::uint32_t { Black = 0, White = 1 };
+
+private:
+    struct Tree {
+        /** Root entry. */
+        std::uint32_t root;
+
+        /** Children blocks. */
+        std::vector<std::uint32_t> nodes;
+
+        /** Entries of quads at table depth, row-major. */
+        std::vector<std::uint32_t> table;
+
+        /** Depth of lookup table. */
+        unsigned int tableDepth;
+    };
+
+    template <typename Op>
+    void descend(std::uint32_t entry, unsigned int x, unsigned int y
+                 , unsigned int size, const Op &op, Filter filter) const;
+
+    template <typename Span>
+    void row(std::uint32_t entry, unsigned int y, unsigned int x
+             , unsigned int ny, unsigned int size, Span &span) const;
+
+    unsigned int sizeX_, sizeY_;
+    unsigned int depth_;
+    unsigned int quadSize_;
+    unsigned long long count_;
+
+    /** Immutable tree data, shared by copies.
+     */
+    std::shared_ptr<const Tree> tree_;
+};
+
+// inlines
+
+inline bool RasterMask::get(int x, int y) const
+{
+    if ((x < 0) || (x >= int(sizeX_)) || (y < 0) || (y >= int(sizeY_))) {
+        return false;
+    }
+
+    const auto &tree(*tree_);
+    const unsigned int shift(depth_ - tree.tableDepth);
+
+    // jump to table cell
+    auto entry(tree.table[((y >> shift) << tree.tableDepth) + (x >> shift)]);
+
+    // and descend the rest
+    for (unsigned int bit((1u << shift) >> 1); entry > White; bit >>= 1) {
+        entry = tree.nodes[entry + ((x & bit) ? 1 : 0) + ((y & bit) ? 2 : 0)];
+    }
+
+    return (entry == White);
+}
+
+template <typename Op>
+inline void RasterMask::forEachQuad(const Op &op, Filter filter) const
+{
+    descend(tree_->root, 0, 0, quadSize_, op, filter);
+}
+
+template <typename Op>
+inline void RasterMask::descend(std::uint32_t entry, unsigned int x
+                                , unsigned int y, unsigned int size
+                                , const Op &op, Filter filter) const
+{
+    // ignore quads completely outside of mask
+    if ((x >= sizeX_) || (y >= sizeY_)) { return; }
+
+    if (entry > White) {
+        const auto &nodes(tree_->nodes);
+        const unsigned int split(size >> 1);
+        descend(nodes[entry], x, y, split, op, filter);
+        descend(nodes[entry + 1], x + split, y, split, op, filter);
+        descend(nodes[entry + 2], x, y + split, split, op, filter);
+        descend(nodes[entry + 3], x + split, y + split, split, op, filter);
+        return;
+    }
+
+    const bool white(entry == White);
+    if (white && (filter == Filter::black)) { return; }
+    if (!white && (filter == Filter::white)) { return; }
+
+    op(x, y, std::min(size, sizeX_ - x), std::min(size, sizeY_ - y), white);
+}
+
+template <typename Op>
+inline void RasterMask::forEachSpan(const Op &op, Filter filter) const
+{
+    auto filtered([&](unsigned int y, unsigned int x0, unsigned int x1
+                      , bool white)
+    {
+        if (white ? (filter != Filter::black) : (filter != Filter::white)) {
+            op(y, x0, x1, white);
+        }
+    });
+
+    for (unsigned int y(0); y < sizeY_; ++y) {
+        imgproc::detail::SpanBuilder<decltype(filtered)>
+            span(filtered, y, 0, sizeX_);
+        row(tree_->root, y, 0, 0, quadSize_, span);
+        span.flush();
+    }
+}
+
+template <typename Span>
+inline void RasterMask::row(std::uint32_t entry, unsigned int y
+                            , unsigned int x, unsigned int ny
+                            , unsigned int size, Span &span) const
+{
+    if (entry <= White) {
+        span.add(x, x + size, (entry == White));
+        return;
+    }
+
+    // pick row of children crossing y
+    const unsigned int split(size >> 1);
+    if (y >= (ny + split)) {
+        entry += 2;
+        ny += split;
+    }
+
+    const auto &nodes(tree_->nodes);
+    row(nodes[entry], y, x, ny, split, span);
+    if ((x + split) < sizeX_) {
+        row(nodes[entry + 1], y, x + split, ny, split, span);
+    }
+}
+
+} } // namespace imgproc::frozenqtree
+
+#endif // imgproc_rastermask_frozenqtree_hpp_included_
@@ -35,12 +35,14 @@
 
 #include <boost/logic/tribool.hpp>
 
+#include "../detail/spans.hpp"
+
 namespace imgproc { namespace quadtree {
 
 template <typename Op>
 inline void RasterMask::forEachQuad(const Op &op, Filter filter) const
 {
-    root_.descend(0, 0, quadSize_, op, filter);
+    root_.descend(*this, 0, 0, quadSize_, op, filter);
 }
 
 template <typename Op>
@@ -62,18 +64,212 @@ inline void RasterMask::forEach(const Op &op, Filter filter) const
 }
 
 template <typename Op>
-inline void RasterMask::Node::descend(unsigned int x, unsigned int y, unsigned int size
+inline void RasterMask::forEachSpan(const Op &op, Filter filter) const
+{
+    auto filtered([&](unsigned int y, unsigned int x0, unsigned int x1
+                      , bool white)
+    {
+        if (white ? (filter != Filter::black) : (filter != Filter::white)) {
+            op(y, x0, x1, white);
+        }
+    });
+
+    for (unsigned int y(0); y < sizeY_; ++y) {
+        imgproc::detail::SpanBuilder<decltype(filtered)>
+            span(filtered, y, 0, sizeX_);
+        root_.row(*this, y, 0, 0, quadSize_, span);
+        span.flush();
+    }
+}
+
+template <typename Op>
+inline void RasterMask::forEachBoundary(const Op &op) const
+{
+    typedef std::pair<unsigned int, unsigned int> Interval;
+    typedef std::vector<Interval> Intervals;
+
+    // side pixels of quad touching black pixels in line next to the side,
+    // i.e. black runs grown by one pixel and clipped to [lo, hi); runs come
+    // in increasing order
+    auto line([this](Intervals &out, unsigned int x0, unsigned int y0
+                     , unsigned int x1, unsigned int y1, bool horizontal
+                     , unsigned int lo, unsigned int hi)
+    {
+        out.clear();
+        root_.runs(x0, y0, x1, y1, false, 0, 0, quadSize_
+                   , [&](unsigned int rx0, unsigned int ry0
+                         , unsigned int rx1, unsigned int ry1)
+        {
+            const auto a(horizontal ? rx0 : ry0);
+            const auto b(horizontal ? rx1 : ry1);
+            const auto s((a > lo) ? a - 1 : lo);
+            const auto e(std::min(b + 1, hi));
+            if (s >= e) { return; }
+            if (!out.empty() && (out.back().second >= s)) {
+                out.back().second = e;
+            } else {
+                out.emplace_back(s, e);
+            }
+        });
+    });
+
+    // turns runs into their union (sorted, disjoint)
+    Intervals runs;
+    auto unite([&runs]()
+    {
+        std::sort(runs.begin(), runs.end());
+        auto out(runs.begin());
+        for (const auto &r : runs) {
+            if (r.first >= r.second) { continue; }
+            if ((out != runs.begin()) && (std::prev(out)->second >= r.first)) {
+                std::prev(out)->second
+                    = std::max(std::prev(out)->second, r.second);
+            } else {
+                *out++ = r;
+            }
+        }
+        runs.erase(out, runs.end());
+    });
+
+    auto contains([](const Intervals &intervals, unsigned int i) -> bool
+    {
+        for (const auto &r : intervals) {
+            if ((i >= r.first) && (i < r.second)) { return true; }
+        }
+        return false;
+    });
+
+    Intervals top, bottom, left, right;
+    forEachQuad([&](unsigned int x, unsigned int y, unsigned int w
+                    , unsigned int h, bool)
+    {
+        const auto x1(x + w);
+        const auto y1(y + h);
+
+        // lines next to quad sides including diagonal neighbours
+        const auto nx0(x ? x - 1 : 0);
+        const auto ny0(y ? y - 1 : 0);
+        const auto nx1(std::min(x1 + 1, sizeX_));
+        const auto ny1(std::min(y1 + 1, sizeY_));
+
+        top.clear(); bottom.clear(); left.clear(); right.clear();
+        if (y) { line(top, nx0, y - 1, nx1, y, true, x, x1); }
+        if (y1 < sizeY_) { line(bottom, nx0, y1, nx1, y1 + 1, true, x, x1); }
+        if (x) { line(left, x - 1, ny0, x, ny1, false, y, y1); }
+        if (x1 < sizeX_) { line(right, x1, ny0, x1 + 1, ny1, false, y, y1); }
+
+        // first and last row
+        auto row([&](unsigned int j, bool first, bool last)
+        {
+            if (first) { runs.insert(runs.end(), top.begin(), top.end()); }
+            if (last) {
+                runs.insert(runs.end(), bottom.begin(), bottom.end());
+            }
+            if (contains(left, j)) { runs.emplace_back(x, x + 1); }
+            if (contains(right, j)) { runs.emplace_back(x1 - 1, x1); }
+            unite();
+            for (const auto &r : runs) {
+                for (auto i(r.first); i < r.second; ++i) { op(i, j); }
+            }
+            runs.clear();
+        });
+
+        row(y, true, (h == 1));
+        if (h > 1) { row(y1 - 1, false, true); }
+        if (h <= 2) { return; }
+
+        // rows in between: first and last column
+        auto column([&](unsigned int i, const Intervals &side)
+        {
+            for (const auto &r : side) {
+                runs.emplace_back(std::max(r.first, y + 1)
+                                  , std::min(r.second, y1 - 1));
+            }
+            unite();
+            for (const auto &r : runs) {
+                for (auto j(r.first); j < r.second; ++j) { op(i, j); }
+            }
+            runs.clear();
+        });
+
+        if (w == 1) {
+            runs.insert(runs.end(), right.begin(), right.end());
+            column(x, left);
+        } else {
+            column(x, left);
+            column(x1 - 1, right);
+        }
+    }, Filter::white);
+}
+
+template <typename Op>
+inline void RasterMask::Node::runs(unsigned int x0, unsigned int y0
+                                   , unsigned int x1, unsigned int y1
+                                   , bool value, unsigned int x
+                                   , unsigned int y, unsigned int size
+                                   , const Op &op) const
+{
+    if ((x >= x1) || (y >= y1) || ((x + size) <= x0) || ((y + size) <= y0)) {
+        // disjoint
+        return;
+    }
+
+    if (type != GRAY) {
+        if ((type == WHITE) == value) {
+            op(std::max(x, x0), std::max(y, y0), std::min(x + size, x1)
+               , std::min(y + size, y1));
+        }
+        return;
+    }
+
+    size >>= 1;
+    children->ul.runs(x0, y0, x1, y1, value, x, y, size, op);
+    children->ur.runs(x0, y0, x1, y1, value, x + size, y, size, op);
+    children->ll.runs(x0, y0, x1, y1, value, x, y + size, size, op);
+    children->lr.runs(x0, y0, x1, y1, value, x + size, y + size, size, op);
+}
+
+template <typename Span>
+inline void RasterMask::Node::row(const RasterMask &mask, unsigned int y
+                                  , unsigned int x, unsigned int ny
+                                  , unsigned int size, Span &span) const
+{
+    if (type != GRAY) {
+        span.add(x, x + size, (type == WHITE));
+        return;
+    }
+
+    const auto split(size >> 1);
+    if (y < (ny + split)) {
+        children->ul.row(mask, y, x, ny, split, span);
+        if ((x + split) < mask.sizeX_) {
+            children->ur.row(mask, y, x + split, ny, split, span);
+        }
+    } else {
+        children->ll.row(mask, y, x, ny + split, split, span);
+        if ((x + split) < mask.sizeX_) {
+            children->lr.row(mask, y, x + split, ny + split, split, span);
+        }
+    }
+}
+
+template <typename Op>
+inline void RasterMask::Node::descend(const RasterMask &mask, unsigned int x
+                                      , unsigned int y, unsigned int size
                                       , const Op &op, Filter filter)
     const
 {
+    // quads completely outside of mask are not reported
+    if ((x >= mask.sizeX_) || (y >= mask.sizeY_)) { return; }
+
     switch (type) {
     case GRAY: {
         // descend down
         unsigned int split = size / 2;
-        children->ul.descend(x, y, split, op, filter);
-        children->ll.descend(x, y + split, split, op, filter);
-        children->ur.descend(x + split, y, split, op, filter);
-        children->lr.descend(x + split, y + split, split, op, filter);
+        children->ul.descend(mask, x, y, split, op, filter);
+        children->ll.descend(mask, x, y + split, split, op, filter);
+        children->ur.descend(mask, x + split, y, split, op, filter);
+        children->lr.descend(mask, x + split, y + split, split, op, filter);
         return;
     }
 
@@ -97,25 +293,30 @@ inline void RasterMask::Node::descend(unsigned int x, unsigned int y, unsigned i
 template <typename Op>
 inline void RasterMask::forEachQuad(unsigned int depth, const Op &op) const
 {
-    root_.descend(depth, 0, 0, quadSize_, op);
+    root_.descend(*this, depth, 0, 0, quadSize_, op);
 }
 
 template <typename Op>
-inline void RasterMask::Node::descend(unsigned int depth, unsigned int x
+inline void RasterMask::Node::descend(const RasterMask &mask
+                                      , unsigned int depth, unsigned int x
                                       , unsigned int y, unsigned int size
                                       , const Op &op)
     const
 {
+    // quads completely outside of mask are not reported
+    if ((x >= mask.sizeX_) || (y >= mask.sizeY_)) { return; }
+
     boost::tribool value(boost::indeterminate);
     switch (type) {
     case NodeType::GRAY:
         if (depth) {
             // descend down
             unsigned int split = size / 2;
-            children->ul.descend(depth - 1, x, y, split, op);
-            children->ll.descend(depth - 1, x, y + split, split, op);
-            children->ur.descend(depth - 1, x + split, y, split, op);
-            children->lr.descend(depth - 1, x + split, y + split, split, op);
+            children->ul.descend(mask, depth - 1, x, y, split, op);
+            children->ll.descend(mask, depth - 1, x, y + split, split, op);
+            children->ur.descend(mask, depth - 1, x + split, y, split, op);
+            children->lr.descend(mask, depth - 1, x + split, y + split, split
+                                 , op);
             return;
         }
         break;
@@ -130,6 +331,63 @@ inline void RasterMask::Node::descend(unsigned int depth, unsigned int x
        , value);
 }
 
+template <typename Sample>
+inline void RasterMask::build(const Sample &sample)
+{
+    release();
+    count_ = 0;
+
+    root_.build(*this, 0, 0, quadSize_, sample);
+}
+
+template <typename Sample>
+inline bool RasterMask::Node::build(RasterMask &mask, unsigned int x
+                                    , unsigned int y, unsigned int size
+                                    , const Sample &sample)
+{
+    type = BLACK;
+
+    if ((x >= mask.sizeX_) || (y >= mask.sizeY_)) {
+        // completely outside of mask
+        return false;
+    }
+
+    if (size == 1) {
+        if (sample(x, y)) {
+            type = WHITE;
+            ++mask.count_;
+        }
+        return true;
+    }
+
+    // build children in Morton order; block is allocated by settle() only
+    // if node is mixed
+    const unsigned int split(size >> 1);
+    Node c[4] = { { pool }, { pool }, { pool }, { pool } };
+    const bool inside[4] = {
+        c[0].build(mask, x, y, split, sample)
+        , c[1].build(mask, x + split, y, split, sample)
+        , c[2].build(mask, x, y + split, split, sample)
+        , c[3].build(mask, x + split, y + split, split, sample)
+    };
+
+    settle(c, inside);
+    return true;
+}
+
+template <typename ConstRaster, typename Threshold>
+RasterMask fromRaster(const ConstRaster &raster, const Threshold &threshold)
+{
+    RasterMask mask(raster.size(), RasterMask::EMPTY);
+
+    mask.build([&](unsigned int x, unsigned int y) -> bool
+    {
+        return threshold(raster(x, y));
+    });
+
+    return mask;
+}
+
 } } // namespace imgproc::quadtree
 
 #endif // imgproc_rastermask_inline_quadtree_hpp_included_
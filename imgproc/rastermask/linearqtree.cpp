@@ -0,0 +1,683 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file rastermask/linearqtree.cpp
+ * @author Vaclav Blazek <vaclav.blazek@citationtech.net>
+ *
+ * Pointerless (linear) quad-tree raster mask
+ */
+
+#include <stdexcept>
+#include <istream>
+#include <ostream>
+
+#if IMGPROC_HAS_IOSTREAMS
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#endif
+
+#include "dbglog/dbglog.hpp"
+#include "utility/binaryio.hpp"
+
+#include "linearqtree.hpp"
+#include "bitfield.hpp"
+
+namespace imgproc { namespace linearqtree {
+
+namespace {
+
+const char LQ_RASTERMASK_IO_MAGIC[5] = { 'L', 'M', 'A', 'S', 'K' };
+
+using utility::binaryio::read;
+using utility::binaryio::write;
+
+unsigned int computeDepth(unsigned int sizeX, unsigned int sizeY)
+{
+    unsigned int quadSize = 1;
+    unsigned int depth(0);
+    while ((quadSize < sizeX) || (quadSize < sizeY)) {
+        quadSize <<= 1;
+        ++depth;
+    }
+    return depth;
+}
+
+/** Value of quad that lies completely outside of mask. Used only during
+ *  construction; can be turned into either black or white.
+ */
+const std::uint8_t DontCare(0x4);
+
+/** Largest mask dimension accepted by load(), keeps depth computation and
+ *  quad size within unsigned int.
+ */
+const std::uint32_t MaxLoadSize(std::uint32_t(1) << 30);
+
+/** Maximal number of gray nodes in tree of given depth: every node above
+ *  the last level, i.e. (4^depth - 1) / 3.
+ */
+std::uint64_t maxGrayCount(unsigned int depth)
+{
+    std::uint64_t count(0), level(1);
+    for (unsigned int d(0); d < depth; ++d, level *= 4) { count += level; }
+    return count;
+}
+
+/** Returns number of bytes left in stream or -1 if it cannot be queried.
+ */
+std::streamoff remaining(std::istream &f)
+{
+    const auto pos(f.tellg());
+    if (pos == std::streampos(-1)) { return -1; }
+
+    f.seekg(0, std::ios::end);
+    const auto end(f.tellg());
+    f.clear();
+    f.seekg(pos);
+
+    if (end == std::streampos(-1)) { return -1; }
+    return end - pos;
+}
+
+} // namespace
+
+constexpr std::size_t RasterMask::RankBlock;
+
+enum class RasterMask::SetOp { merge, intersect, subtract };
+
+/** Builds tree bottom-up.
+ *
+ *  Gray nodes are emitted to per-level buffers in depth-first post-order
+ *  which is the same as Morton order inside each level. Buffers are then
+ *  concatenated into the breadth-first array.
+ */
+class Builder {
+public:
+    Builder(RasterMask &mask)
+        : mask_(mask), levels_(mask.depth_)
+    {}
+
+    /** Creates node at given depth from its children values. Node is
+     *  contracted if possible. Returns node value.
+     */
+    std::uint8_t node(unsigned int depth, std::uint8_t ul, std::uint8_t ur
+                      , std::uint8_t ll, std::uint8_t lr)
+    {
+        const std::uint8_t values[4] = { ul, ur, ll, lr };
+
+        bool inside(false), white(true), black(true);
+        for (auto value : values) {
+            if (value == DontCare) { continue; }
+            inside = true;
+            if (value != RasterMask::White) { white = false; }
+            if (value != RasterMask::Black) { black = false; }
+        }
+
+        if (!inside) { return DontCare; }
+        if (white) { return RasterMask::White; }
+        if (black) { return RasterMask::Black; }
+
+        std::uint8_t byte(0);
+        for (auto value : values) {
+            byte = (byte << 2) | ((value == DontCare)
+                                  ? std::uint8_t(RasterMask::Black) : value);
+        }
+        levels_[depth].push_back(byte);
+        return RasterMask::Gray;
+    }
+
+    /** Copies (optionally inverted) subtree of gray node at given index.
+     */
+    std::uint8_t copy(const RasterMask &src, std::size_t index
+                      , unsigned int depth, bool invert = false)
+    {
+        const auto byte(src.nodes_[index]);
+        std::uint8_t values[4];
+        std::size_t next(0);
+
+        for (unsigned int child(0); child < 4; ++child) {
+            const auto value(RasterMask::childValue(byte, child));
+            if (RasterMask::isGray(value)) {
+                next = next ? (next + 1) : src.childIndex(index, child);
+                values[child] = copy(src, next, depth + 1, invert);
+            } else {
+                values[child] = invert ? (value ^ 0x3) : value;
+            }
+        }
+
+        return node(depth, values[0], values[1], values[2], values[3]);
+    }
+
+    /** Combines two (sub)trees by given set operation.
+     */
+    std::uint8_t combine(RasterMask::SetOp op
+                         , const RasterMask &a, std::uint8_t av
+                         , std::size_t ai
+                         , const RasterMask &b, std::uint8_t bv
+                         , std::size_t bi
+                         , unsigned int depth)
+    {
+        typedef RasterMask::SetOp SetOp;
+        const bool ag(RasterMask::isGray(av));
+        const bool bg(RasterMask::isGray(bv));
+
+        switch (op) {
+        case SetOp::merge:
+            if ((av == RasterMask::White) || (bv == RasterMask::White)) {
+                return RasterMask::White;
+            }
+            if (av == RasterMask::Black) {
+                return bg ? copy(b, bi, depth) : bv;
+            }
+            if (bv == RasterMask::Black) { return copy(a, ai, depth); }
+            break;
+
+        case SetOp::intersect:
+            if ((av == RasterMask::Black) || (bv == RasterMask::Black)) {
+                return RasterMask::Black;
+            }
+            if (av == RasterMask::White) {
+                return bg ? copy(b, bi, depth) : bv;
+            }
+            if (bv == RasterMask::White) { return copy(a, ai, depth); }
+            break;
+
+        case SetOp::subtract:
+            if ((av == RasterMask::Black) || (bv == RasterMask::White)) {
+                return RasterMask::Black;
+            }
+            if (bv == RasterMask::Black) {
+                return ag ? copy(a, ai, depth) : av;
+            }
+            if (av == RasterMask::White) { return copy(b, bi, depth, true); }
+            break;
+        }
+
+        // both gray -> descend
+        const auto abyte(a.nodes_[ai]);
+        const auto bbyte(b.nodes_[bi]);
+        std::size_t anext(0), bnext(0);
+        std::uint8_t values[4];
+
+        for (unsigned int child(0); child < 4; ++child) {
+            const auto acv(RasterMask::childValue(abyte, child));
+            const auto bcv(RasterMask::childValue(bbyte, child));
+            if (RasterMask::isGray(acv)) {
+                anext = anext ? (anext + 1) : a.childIndex(ai, child);
+            }
+            if (RasterMask::isGray(bcv)) {
+                bnext = bnext ? (bnext + 1) : b.childIndex(bi, child);
+            }
+            values[child] = combine(op, a, acv, anext, b, bcv, bnext
+                                    , depth + 1);
+        }
+
+        return node(depth, values[0], values[1], values[2], values[3]);
+    }
+
+    /** Finalizes mask from root value.
+     */
+    void finish(std::uint8_t root) {
+        auto &nodes(mask_.nodes_);
+        auto &rank(mask_.rank_);
+
+        nodes.clear();
+        rank.clear();
+
+        if (!RasterMask::isGray(root)) {
+            mask_.root_ = ((root == RasterMask::White)
+                           ? RasterMask::White : RasterMask::Black);
+            mask_.recount();
+            return;
+        }
+
+        mask_.root_ = RasterMask::Gray;
+
+        std::size_t total(0);
+        for (const auto &level : levels_) { total += level.size(); }
+        nodes.reserve(total);
+
+        for (auto &level : levels_) {
+            nodes.insert(nodes.end(), level.begin(), level.end());
+            std::vector<std::uint8_t>().swap(level);
+        }
+
+        mask_.sampleRanks();
+        mask_.recount();
+    }
+
+private:
+    RasterMask &mask_;
+    std::vector<std::vector<std::uint8_t>> levels_;
+};
+
+RasterMask::RasterMask()
+    : sizeX_(), sizeY_(), depth_(), quadSize_(1), count_(), root_(Black)
+{}
+
+RasterMask::RasterMask(const math::Size2 &size, InitMode mode)
+    : sizeX_(size.width), sizeY_(size.height)
+    , depth_(computeDepth(sizeX_, sizeY_))
+    , quadSize_(1 << depth_)
+    , count_((mode == FULL) ? capacity() : 0)
+    , root_((mode == FULL) ? White : Black)
+{}
+
+RasterMask::RasterMask(const quadtree::RasterMask &mask)
+    : sizeX_(mask.sizeX_), sizeY_(mask.sizeY_)
+    , depth_(mask.depth_), quadSize_(mask.quadSize_)
+    , count_(), root_(Black)
+{
+    typedef quadtree::RasterMask::Node Node;
+    typedef quadtree::RasterMask::NodeType NodeType;
+
+    struct Converter {
+        Converter(Builder &builder) : builder(builder) {}
+
+        std::uint8_t convert(const Node &node, unsigned int depth) {
+            switch (node.type) {
+            case NodeType::WHITE: return White;
+            case NodeType::BLACK: return Black;
+            case NodeType::GRAY: break;
+            }
+
+            // NB: children must be processed in Morton order
+            const auto &c(*node.children);
+            const auto ul(convert(c.ul, depth + 1));
+            const auto ur(convert(c.ur, depth + 1));
+            const auto ll(convert(c.ll, depth + 1));
+            const auto lr(convert(c.lr, depth + 1));
+            return builder.node(depth, ul, ur, ll, lr);
+        }
+
+        Builder &builder;
+    };
+
+    Builder builder(*this);
+    builder.finish(Converter(builder).convert(mask.root_, 0));
+}
+
+RasterMask::RasterMask(const bitfield::RasterMask &mask)
+    : sizeX_(mask.dims().width), sizeY_(mask.dims().height)
+    , depth_(computeDepth(sizeX_, sizeY_))
+    , quadSize_(1 << depth_)
+    , count_(), root_(Black)
+{
+    struct Converter {
+        Converter(Builder &builder, const bitfield::RasterMask &mask)
+            : builder(builder), mask(mask)
+            , sizeX(mask.dims().width), sizeY(mask.dims().height)
+        {}
+
+        std::uint8_t convert(unsigned int x, unsigned int y
+                             , unsigned int size, unsigned int depth)
+        {
+            if ((x >= sizeX) || (y >= sizeY)) { return DontCare; }
+            if (size == 1) { return mask.get(x, y) ? White : Black; }
+
+            // NB: children must be processed in Morton order
+            const auto split(size >> 1);
+            const auto ul(convert(x, y, split, depth + 1));
+            const auto ur(convert(x + split, y, split, depth + 1));
+            const auto ll(convert(x, y + split, split, depth + 1));
+            const auto lr(convert(x + split, y + split, split, depth + 1));
+            return builder.node(depth, ul, ur, ll, lr);
+        }
+
+        Builder &builder;
+        const bitfield::RasterMask &mask;
+        const unsigned int sizeX;
+        const unsigned int sizeY;
+    };
+
+    Builder builder(*this);
+    builder.finish(Converter(builder, mask).convert(0, 0, quadSize_, 0));
+}
+
+quadtree::RasterMask RasterMask::asQuadtree() const
+{
+    typedef quadtree::RasterMask::Node Node;
+    typedef quadtree::RasterMask::NodeType NodeType;
+
+    quadtree::RasterMask mask(size(), quadtree::RasterMask::EMPTY);
+
+    auto leaf([](Node &node, std::uint8_t value) {
+            node.type = (value == White) ? NodeType::WHITE : NodeType::BLACK;
+        });
+
+    if (!isGray(root_)) {
+        leaf(mask.root_, root_);
+        mask.recount();
+        return mask;
+    }
+
+    // gray nodes are stored in breadth-first order, i.e. in the same order
+    // as they are discovered by walking the array sequentially: n-th queued
+    // node is described by n-th byte, no child index lookup is needed
+    std::vector<Node*> queue;
+    queue.reserve(nodes_.size());
+    queue.push_back(&mask.root_);
+
+    for (std::size_t i(0); i < queue.size(); ++i) {
+        auto &node(*queue[i]);
+        node.type = NodeType::GRAY;
+        node.children = mask.malloc();
+
+        const auto byte(nodes_[i]);
+        Node *children[4] = {
+            &node.children->ul, &node.children->ur
+            , &node.children->ll, &node.children->lr
+        };
+
+        for (unsigned int child(0); child < 4; ++child) {
+            const auto value(childValue(byte, child));
+            if (isGray(value)) {
+                queue.push_back(children[child]);
+            } else {
+                leaf(*children[child], value);
+            }
+        }
+    }
+
+    mask.recount();
+    return mask;
+}
+
+bitfield::RasterMask RasterMask::asBitfield() const
+{
+    bitfield::RasterMask mask(size(), bitfield::RasterMask::EMPTY);
+
+    forEachQuad([&](unsigned int x, unsigned int y, unsigned int xsize
+                    , unsigned int ysize, bool)
+    {
+        for (unsigned int j(y), ej(y + ysize); j < ej; ++j) {
+            mask.setSpan(x, j, xsize);
+        }
+    }, Filter::white);
+
+    return mask;
+}
+
+void RasterMask::recount()
+{
+    unsigned long long count(0);
+    forEachQuad([&count](unsigned int, unsigned int, unsigned long long xsize
+                         , unsigned long long ysize, bool)
+    {
+        count += xsize * ysize;
+    }, Filter::white);
+    count_ = count;
+}
+
+void RasterMask::sampleRanks()
+{
+    rank_.clear();
+    rank_.reserve(nodes_.size() / RankBlock + 1);
+
+    std::uint32_t count(0);
+    for (std::size_t i(0), total(nodes_.size()); i < total; i += RankBlock) {
+        rank_.push_back(count);
+        count += detail::grayCount(nodes_.data() + i
+                                   , std::min(RankBlock, total - i));
+    }
+}
+
+void RasterMask::dump(std::ostream &f, Compression compression) const
+{
+    write(f, LQ_RASTERMASK_IO_MAGIC); // 5 bytes
+    write(f, std::uint8_t(compression));
+    write(f, root_);
+    write(f, std::uint8_t(0)); // reserved
+
+    write(f, std::uint32_t(sizeX_));
+    write(f, std::uint32_t(sizeY_));
+    write(f, std::uint64_t(nodes_.size()));
+
+    switch (compression) {
+    case Compression::none:
+        write(f, nodes_.data(), nodes_.size());
+        break;
+
+    case Compression::zlib: {
+#if IMGPROC_HAS_IOSTREAMS
+        namespace bio = boost::iostreams;
+
+        std::vector<char> packed;
+        {
+            bio::filtering_ostream out;
+            out.push(bio::zlib_compressor(bio::zlib::best_compression));
+            out.push(bio::back_inserter(packed));
+            out.write(reinterpret_cast<const char*>(nodes_.data())
+                      , nodes_.size());
+            out.reset();
+        }
+
+        write(f, std::uint64_t(packed.size()));
+        write(f, packed.data(), packed.size());
+        break;
+#else
+        LOGTHROW(err2, std::runtime_error)
+            << "Cannot compress RasterMask: iostreams support not "
+            "compiled in.";
+#endif
+    }
+
+    default:
+        LOGTHROW(err2, std::runtime_error)
+            << "Invalid RasterMask compression " << int(compression) << ".";
+    }
+}
+
+void RasterMask::load(std::istream &f)
+{
+    char magic[5];
+    read(f, magic);
+
+    if (std::memcmp(magic, LQ_RASTERMASK_IO_MAGIC,
+                    sizeof(LQ_RASTERMASK_IO_MAGIC))) {
+        LOGTHROW(err2, std::runtime_error) << "RasterMask has wrong magic.";
+    }
+
+    std::uint8_t compression, root, reserved;
+    read(f, compression);
+    read(f, root);
+    read(f, reserved); // reserved
+
+    std::uint32_t sizeX, sizeY;
+    std::uint64_t count;
+    read(f, sizeX);
+    read(f, sizeY);
+    read(f, count);
+
+    if (!f) {
+        LOGTHROW(err2, std::runtime_error) << "RasterMask data truncated.";
+    }
+
+    if ((root != Black) && (root != White) && (root != Gray)) {
+        LOGTHROW(err2, std::runtime_error)
+            << "Invalid RasterMask root value " << int(root) << ".";
+    }
+
+    if ((root == Gray) != bool(count)) {
+        LOGTHROW(err2, std::runtime_error)
+            << "RasterMask root value does not match node count.";
+    }
+
+    if ((sizeX > MaxLoadSize) || (sizeY > MaxLoadSize)) {
+        LOGTHROW(err2, std::runtime_error)
+            << "Invalid RasterMask size " << sizeX << "x" << sizeY << ".";
+    }
+
+    // decode into locals, mask is modified only when everything is valid
+    const auto depth(computeDepth(sizeX, sizeY));
+    if (count > maxGrayCount(depth)) {
+        LOGTHROW(err2, std::runtime_error)
+            << "Invalid RasterMask node count " << count << ".";
+    }
+
+    const auto left(remaining(f));
+    std::vector<std::uint8_t> nodes;
+
+    switch (Compression(compression)) {
+    case Compression::none:
+        if ((left >= 0) && (count > std::uint64_t(left))) {
+            LOGTHROW(err2, std::runtime_error)
+                << "RasterMask data truncated.";
+        }
+
+        nodes.resize(count);
+        read(f, nodes.data(), nodes.size());
+        if (!f) {
+            LOGTHROW(err2, std::runtime_error)
+                << "RasterMask data truncated.";
+        }
+        break;
+
+    case Compression::zlib: {
+#if IMGPROC_HAS_IOSTREAMS
+        namespace bio = boost::iostreams;
+
+        std::uint64_t size;
+        read(f, size);
+        if (!f || ((left >= 0)
+                   && (size > std::uint64_t(left) - sizeof(size))))
+        {
+            LOGTHROW(err2, std::runtime_error)
+                << "RasterMask data truncated.";
+        }
+
+        // zlib never expands data by more than compressBound()
+        if (size > (count + (count >> 12) + (count >> 14) + (count >> 25)
+                    + 64))
+        {
+            LOGTHROW(err2, std::runtime_error)
+                << "Invalid RasterMask compressed data size " << size
+                << ".";
+        }
+
+        std::vector<char> packed(size);
+        read(f, packed.data(), packed.size());
+        if (!f) {
+            LOGTHROW(err2, std::runtime_error)
+                << "RasterMask data truncated.";
+        }
+
+        nodes.resize(count);
+        bio::filtering_istream in;
+        in.push(bio::zlib_decompressor());
+        in.push(bio::array_source(packed.data(), packed.size()));
+        in.read(reinterpret_cast<char*>(nodes.data()), nodes.size());
+        if (std::size_t(in.gcount()) != nodes.size()) {
+            LOGTHROW(err2, std::runtime_error)
+                << "RasterMask compressed data truncated.";
+        }
+        break;
+#else
+        LOGTHROW(err2, std::runtime_error)
+            << "Cannot decompress RasterMask: iostreams support not "
+            "compiled in.";
+#endif
+    }
+
+    default:
+        LOGTHROW(err2, std::runtime_error)
+            << "Invalid RasterMask compression " << int(compression) << ".";
+    }
+
+    // validate tree shape: gray children of one level form the next one,
+    // the last level must end exactly at the end of the array and tree
+    // must not be deeper than the mask
+    std::size_t begin(0), end(nodes.size() ? 1 : 0);
+    for (unsigned int d(0); begin < end; ++d) {
+        if ((d >= depth) || (end > nodes.size())) {
+            LOGTHROW(err2, std::runtime_error)
+                << "Invalid RasterMask tree structure.";
+        }
+
+        const auto next(end + detail::grayCount(nodes.data() + begin
+                                                , end - begin));
+        begin = end;
+        end = next;
+    }
+
+    if (end != nodes.size()) {
+        LOGTHROW(err2, std::runtime_error)
+            << "Invalid RasterMask tree structure.";
+    }
+
+    // valid -> take it
+    sizeX_ = sizeX;
+    sizeY_ = sizeY;
+    depth_ = depth;
+    quadSize_ = (1 << depth_);
+    root_ = root;
+    nodes_.swap(nodes);
+
+    sampleRanks();
+    recount();
+}
+
+void RasterMask::invert()
+{
+    // gray node (01) is inverted to (10) which is gray as well
+    for (auto &node : nodes_) { node = ~node; }
+
+    if (!isGray(root_)) { root_ ^= 0x3; }
+
+    count_ = capacity() - count_;
+}
+
+void RasterMask::setOp(SetOp op, const RasterMask &other, const char *what)
+{
+    if ((sizeX_ != other.sizeX_) || (sizeY_ != other.sizeY_)) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Attempt to " << what << " mask with diferent dimensions.";
+    }
+
+    RasterMask result(size(), EMPTY);
+    Builder builder(result);
+    builder.finish(builder.combine(op, *this, root_, 0
+                                   , other, other.root_, 0, 0));
+    *this = std::move(result);
+}
+
+void RasterMask::merge(const RasterMask &other)
+{
+    setOp(SetOp::merge, other, "merge in data from");
+}
+
+void RasterMask::intersect(const RasterMask &other)
+{
+    setOp(SetOp::intersect, other, "intersect with data from");
+}
+
+void RasterMask::subtract(const RasterMask &other)
+{
+    setOp(SetOp::subtract, other, "subtract data from");
+}
+
+} } // namespace imgproc::linearqtree
@@ -0,0 +1,360 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file rastermask/linearqtree.hpp
+ * @author Vaclav Blazek <vaclav.blazek@citationtech.net>
+ *
+ * Pointerless (linear) quad-tree raster mask
+ */
+
+#ifndef imgproc_rastermask_linearqtree_hpp_included_
+#define imgproc_rastermask_linearqtree_hpp_included_
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+
+#include "math/geometry_core.hpp"
+
+#include "bitfieldfwd.hpp"
+#include "quadtree.hpp"
+
+/**** linear quad-tree version of rastermask ****/
+
+/** Layout:
+ *
+ *  Only gray nodes are stored. Each gray node is stored as a single byte
+ *  holding values of its 4 children in the same encoding as used by
+ *  mappedqtree::RasterMask:
+ *
+ *      uint8 children; // children values: UL|UR|LL|LR
+ *
+ *      Each child takes 2 bits:
+ *          00: black node
+ *          01: gray node
+ *          10: gray node
+ *          11: white node
+ *
+ *  Nodes are stored in breadth-first order, i.e. level by level, and in
+ *  Morton order inside each level. No pointers or jump offsets are needed:
+ *  n-th gray child (counting all child slots from the start of the array) is
+ *  stored in byte n + 1. Gray child counts are sampled every RankBlock bytes
+ *  so the position of any child is found in constant time.
+ *
+ *  Uniform root is kept outside of the array (the array is empty then).
+ *
+ *  Serialized form (see dump()) is the array itself preceded by a short
+ *  header, i.e. 2 bits per node (root excluded).
+ */
+
+namespace imgproc { namespace linearqtree {
+
+class RasterMask {
+public:
+    enum InitMode { EMPTY = 0, FULL = 1 };
+
+    typedef quadtree::RasterMask::Filter Filter;
+
+    RasterMask();
+
+    RasterMask(const math::Size2 &size, InitMode mode);
+
+    /** Lossless conversion from quadtree raster mask.
+     */
+    explicit RasterMask(const quadtree::RasterMask &mask);
+
+    /** Lossless conversion from bitfield raster mask.
+     */
+    explicit RasterMask(const bitfield::RasterMask &mask);
+
+    /** Converts mask to quadtree raster mask. Nodes are decoded by single
+     *  sequential scan directly into quadtree's node pool.
+     */
+    quadtree::RasterMask asQuadtree() const;
+
+    /** Optional entropy stage applied to serialized node data.
+     */
+    enum class Compression : std::uint8_t {
+        none = 0
+        , zlib = 1 //!< deflate; available with iostreams support only
+    };
+
+    /** Writes mask to stream in compact format: header (magic, sizes, root
+     *  value) followed by node array (optionally compressed).
+     */
+    void dump(std::ostream &f, Compression compression = Compression::none)
+        const;
+
+    /** Loads mask written by dump(). Node array is read directly into place
+     *  and validated, only rank samples are computed.
+     */
+    void load(std::istream &f);
+
+    /** Converts mask to bitfield raster mask.
+     */
+    bitfield::RasterMask asBitfield() const;
+
+    math::Size2 size() const { return math::Size2(sizeX_, sizeY_); }
+
+    math::Size2 dims() const { return math::Size2(sizeX_, sizeY_); }
+
+    /** Returns maximal depth of tree.
+     */
+    unsigned int depth() const { return depth_; }
+
+    /** obtain mask value at given pos, return false if x, y out of bounds */
+    bool get(int x, int y) const;
+
+    /** return mask size (number of white pixels) */
+    unsigned long long count() const { return count_; }
+
+    /** return total number of pixels */
+    unsigned long long capacity() const {
+        return (unsigned long long)(sizeX_) * (unsigned long long)(sizeY_);
+    }
+
+    /** test mask for emptiness */
+    bool empty() const { return count_ == 0; }
+
+    bool full() const { return count_ == capacity(); }
+
+    /** Number of bytes occupied by tree data.
+     */
+    std::size_t memoryUsage() const {
+        return nodes_.size() + rank_.size() * sizeof(std::uint32_t);
+    }
+
+    /** Runs op(x, y, xsize, ysize, white) for each black/white quad.
+     */
+    template <typename Op>
+    void forEachQuad(const Op &op, Filter filter = Filter::both) const;
+
+    /** invert a mask (negate pixels), done in place */
+    void invert();
+
+    /** Merges other mask in this mask.
+     */
+    void merge(const RasterMask &other);
+
+    /** Intersects this mask with other mask.
+     */
+    void intersect(const RasterMask &other);
+
+    /** Set difference with other mask.
+     */
+    void subtract(const RasterMask &other);
+
+    /** Node values (2-bit child code).
+     */
+    enum : std::uint8_t { Black = 0x0, Gray = 0x1, White = 0x3 };
+
+    /** Value of child (0: UL, 1: UR, 2: LL, 3: LR) in node byte.
+     */
+    static std::uint8_t childValue(std::uint8_t node, unsigned int child) {
+        return (node >> (2 * (3 - child))) & 0x3;
+    }
+
+    /** Whether given child code denotes a gray node.
+     */
+    static bool isGray(std::uint8_t value) {
+        return (value == 0x1) || (value == 0x2);
+    }
+
+private:
+    friend class Builder;
+
+    /** Number of bytes between rank samples.
+     */
+    static constexpr std::size_t RankBlock = 64;
+
+    /** Returns index of given child of node at given index. Child must be gray.
+     */
+    std::size_t childIndex(std::size_t index, unsigned int child) const;
+
+    template <typename Op>
+    void descend(std::size_t index, unsigned int x, unsigned int y
+                 , unsigned int size, const Op &op, Filter filter) const;
+
+    template <typename Op>
+    void leaf(std::uint8_t value, unsigned int x, unsigned int y
+              , unsigned int size, const Op &op, Filter filter) const;
+
+    void recount();
+
+    /** Computes rank_ samples from nodes_.
+     */
+    void sampleRanks();
+
+    enum class SetOp;
+
+    /** Common implementation of merge/intersect/subtract.
+     */
+    void setOp(SetOp op, const RasterMask &other, const char *what);
+
+    unsigned int sizeX_, sizeY_;
+    unsigned int depth_;
+    unsigned int quadSize_;
+    unsigned long long count_;
+
+    /** Root value when tree is uniform.
+     */
+    std::uint8_t root_;
+
+    /** Gray nodes in breadth-first order.
+     */
+    std::vector<std::uint8_t> nodes_;
+
+    /** Number of gray child slots in nodes_[0, i * RankBlock).
+     */
+    std::vector<std::uint32_t> rank_;
+};
+
+// inlines
+
+namespace detail {
+
+/** Number of gray child slots in given bytes.
+ */
+inline unsigned int grayCount(const std::uint8_t *data, std::size_t size)
+{
+    unsigned int count(0);
+    for (; size >= sizeof(std::uint64_t); size -= sizeof(std::uint64_t)
+             , data += sizeof(std::uint64_t))
+    {
+        std::uint64_t w;
+        std::memcpy(&w, data, sizeof(w));
+        count += __builtin_popcountll((w ^ (w >> 1))
+                                      & 0x5555555555555555ull);
+    }
+
+    for (; size; --size, ++data) {
+        count += __builtin_popcount((*data ^ (*data >> 1)) & 0x55);
+    }
+    return count;
+}
+
+} // namespace detail
+
+inline std::size_t RasterMask::childIndex(std::size_t index
+                                          , unsigned int child) const
+{
+    const auto block(index / RankBlock);
+    const auto start(block * RankBlock);
+
+    // gray slots before this node
+    std::size_t rank(rank_[block]
+                     + detail::grayCount(nodes_.data() + start
+                                         , index - start));
+
+    // gray slots of preceding siblings
+    const auto node(nodes_[index]);
+    for (unsigned int c(0); c < child; ++c) {
+        rank += isGray(childValue(node, c));
+    }
+
+    // root occupies first byte
+    return rank + 1;
+}
+
+inline bool RasterMask::get(int x, int y) const
+{
+    if ((x < 0) || (x >= int(sizeX_)) || (y < 0) || (y >= int(sizeY_))) {
+        return false;
+    }
+
+    if (nodes_.empty()) { return root_ == White; }
+
+    std::size_t index(0);
+    for (unsigned int bit(quadSize_ >> 1); bit; bit >>= 1) {
+        const unsigned int child(((x & bit) ? 1 : 0) | ((y & bit) ? 2 : 0));
+        const auto value(childValue(nodes_[index], child));
+        if (value == Black) { return false; }
+        if (value == White) { return true; }
+        index = childIndex(index, child);
+    }
+
+    // not reached for valid tree
+    return false;
+}
+
+template <typename Op>
+inline void RasterMask::forEachQuad(const Op &op, Filter filter) const
+{
+    if (nodes_.empty()) {
+        leaf(root_, 0, 0, quadSize_, op, filter);
+        return;
+    }
+    descend(0, 0, 0, quadSize_, op, filter);
+}
+
+template <typename Op>
+inline void RasterMask::leaf(std::uint8_t value, unsigned int x
+                             , unsigned int y, unsigned int size
+                             , const Op &op, Filter filter) const
+{
+    if ((x >= sizeX_) || (y >= sizeY_)) { return; }
+
+    const bool white(value == White);
+    if (white && (filter == Filter::black)) { return; }
+    if (!white && (filter == Filter::white)) { return; }
+
+    op(x, y, ((x + size) > sizeX_) ? (sizeX_ - x) : size
+       , ((y + size) > sizeY_) ? (sizeY_ - y) : size
+       , white);
+}
+
+template <typename Op>
+inline void RasterMask::descend(std::size_t index, unsigned int x
+                                , unsigned int y, unsigned int size
+                                , const Op &op, Filter filter) const
+{
+    const auto node(nodes_[index]);
+    const unsigned int split(size >> 1);
+
+    // all children of this node are stored consecutively
+    std::size_t next(0);
+
+    for (unsigned int child(0); child < 4; ++child) {
+        const auto cx(x + ((child & 1) ? split : 0));
+        const auto cy(y + ((child & 2) ? split : 0));
+        const auto value(childValue(node, child));
+
+        if (!isGray(value)) {
+            leaf(value, cx, cy, split, op, filter);
+            continue;
+        }
+
+        next = next ? (next + 1) : childIndex(index, child);
+        if ((cx < sizeX_) && (cy < sizeY_)) {
+            descend(next, cx, cy, split, op, filter);
+        }
+    }
+}
+
+} } // namespace imgproc::linearqtree
+
+#endif // imgproc_rastermask_linearqtree_hpp_included_
@@ -23,6 +23,10 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE.
  */
+#include <algorithm>
+#include <fstream>
+
+#include <boost/filesystem/operations.hpp>
 #include <boost/interprocess/file_mapping.hpp>
 #include <boost/interprocess/mapped_region.hpp>
 
@@ -45,8 +49,68 @@ namespace {
 
 const char IO_MAGIC[6] = { 'M', 'Q', 'M', 'A', 'S', 'K' };
 
+inline std::uint8_t childType(std::uint8_t children, unsigned int child)
+{
+    return ((children >> (2 * (3 - child))) & 0x3);
+}
+
+inline bool isGray(std::uint8_t type)
+{
+    return (type == 0x1) || (type == 0x2);
+}
+
+/** Spreads lower 32 bits of value to even bits.
+ */
+inline std::uint64_t spreadBits(std::uint64_t v)
+{
+    v &= 0xffffffffull;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+    v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+    v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+    v = (v | (v << 2)) & 0x3333333333333333ull;
+    v = (v | (v << 1)) & 0x5555555555555555ull;
+    return v;
+}
+
+/** Morton code: x in even bits, y in odd bits, i.e. every bit pair is a
+ *  child index (0: UL, 1: UR, 2: LL, 3: LR).
+ */
+inline std::uint64_t morton(unsigned int x, unsigned int y)
+{
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+/** Inverse of spreadBits.
+ */
+inline unsigned int compactBits(std::uint64_t v)
+{
+    v &= 0x5555555555555555ull;
+    v = (v | (v >> 1)) & 0x3333333333333333ull;
+    v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0full;
+    v = (v | (v >> 4)) & 0x00ff00ff00ff00ffull;
+    v = (v | (v >> 8)) & 0x0000ffff0000ffffull;
+    v = (v | (v >> 16)) & 0x00000000ffffffffull;
+    return unsigned(v);
+}
+
+/** Tree depth for given mask size, same as in quadtree::RasterMask.
+ */
+unsigned int treeDepth(const math::Size2 &size)
+{
+    unsigned int depth(0);
+    while ((1 << depth) < std::max(size.width, size.height)) { ++depth; }
+    return depth;
+}
+
 } // namespcace
 
+struct RasterMask::Query {
+    std::uint64_t code;
+    std::size_t index;
+
+    bool operator<(const Query &o) const { return code < o.code; }
+};
+
 struct MemoryBase {
     MemoryBase(const boost::filesystem::path &path, std::size_t offset)
         : treeStart(), size(), depth()
@@ -124,6 +188,113 @@ RasterMask::RasterMask(const boost::optional<boost::filesystem::path> &path
 {
 }
 
+bool RasterMask::get(int x, int y) const
+{
+    if (!data_) { return false; }
+
+    const int size(1 << depth_);
+    if ((x < 0) || (y < 0) || (x >= size) || (y >= size)) { return false; }
+
+    // special handling for root node that has no explicit representation
+    std::size_t index(start_);
+    switch (std::uint8_t(data_[index])) {
+    case 0x00: return false;
+    case 0xff: return true;
+    default: break;
+    }
+
+    for (int bit(size >> 1); bit; bit >>= 1) {
+        const auto children(read<std::uint8_t>(index));
+        const unsigned int child(((x & bit) ? 1 : 0) | ((y & bit) ? 2 : 0));
+
+        switch (childType(children, child)) {
+        case 0x0: return false;
+        case 0x3: return true;
+        default: break;
+        }
+
+        // jump over gray siblings in front of our child
+        for (unsigned int c(0); c < child; ++c) {
+            if (isGray(childType(children, c))) {
+                const auto jump(read<std::uint32_t>(index));
+                index += jump;
+            }
+        }
+
+        // skip our own jump offset, index now points to child's node
+        read<std::uint32_t>(index);
+    }
+
+    // not reached for valid tree
+    return false;
+}
+
+std::vector<bool> RasterMask::get(const std::vector<math::Point2i> &points)
+    const
+{
+    std::vector<bool> result(points.size(), false);
+    if (!data_) { return result; }
+
+    // gather queries inside mask
+    const int size(1 << depth_);
+    std::vector<Query> queries;
+    queries.reserve(points.size());
+    for (std::size_t i(0), e(points.size()); i != e; ++i) {
+        const auto &p(points[i]);
+        if ((p(0) < 0) || (p(1) < 0) || (p(0) >= size) || (p(1) >= size)) {
+            continue;
+        }
+        queries.push_back({ morton(p(0), p(1)), i });
+    }
+
+    if (queries.empty()) { return result; }
+
+    switch (std::uint8_t(data_[start_])) {
+    case 0x00: return result;
+
+    case 0xff:
+        for (const auto &q : queries) { result[q.index] = true; }
+        return result;
+
+    default: break;
+    }
+
+    // sort in Morton order -> queries in the same quad are adjacent
+    std::sort(queries.begin(), queries.end());
+
+    get(start_, 2 * (depth_ - 1), queries.data()
+        , queries.data() + queries.size(), result);
+    return result;
+}
+
+void RasterMask::get(std::size_t index, unsigned int shift
+                     , const Query *begin, const Query *end
+                     , std::vector<bool> &result) const
+{
+    const auto children(read<std::uint8_t>(index));
+
+    for (unsigned int child(0); (child < 4) && (begin != end); ++child) {
+        // find queries inside this child
+        auto *cend(begin);
+        while ((cend != end) && (((cend->code >> shift) & 0x3) == child)) {
+            ++cend;
+        }
+
+        const auto type(childType(children, child));
+        if (isGray(type)) {
+            const auto jump(read<std::uint32_t>(index));
+            if (begin != cend) {
+                get(index, shift - 2, begin, cend, result);
+            }
+            index += jump;
+        } else if (type == 0x3) {
+            for (; begin != cend; ++begin) { result[begin->index] = true; }
+        }
+
+        begin = cend;
+    }
+}
+
 void RasterMask::write(std::ostream &f, const quadtree::RasterMask &mask
                        , unsigned int depth, unsigned int x, unsigned int y)
 {
@@ -232,4 +403,637 @@ void RasterMask::write(std::ostream &f, const quadtree::RasterMask &mask
     f.seekp(end);
 }
 
+namespace detail {
+
+TreeWriter::TreeWriter(std::ostream &f, unsigned int depth)
+    : f_(f), sizePlace_(), end_(), finished_(false)
+{
+    bin::write(f_, IO_MAGIC); // 6 bytes
+    bin::write(f_, uint8_t(0)); // reserved
+    bin::write(f_, uint8_t(0)); // reserved
+    bin::write(f_, std::uint8_t(depth));
+
+    // make room for data size
+    sizePlace_ = f_.tellp();
+    bin::write(f_, std::uint32_t(0));
+    end_ = f_.tellp();
+}
+
+void TreeWriter::finish()
+{
+    if (finished_) { return; }
+    finished_ = true;
+
+    // compute data size and write to pre-allocated place
+    const std::uint32_t size(end_ - sizePlace_ - sizeof(std::uint32_t));
+    writeAt(sizePlace_, &size, sizeof(size));
+}
+
+void TreeWriter::push(unsigned int level, std::uint8_t type
+                      , const char *data, std::size_t size)
+{
+    if (!level) {
+        // root itself, cannot be gray
+        const std::uint8_t value(type ? 0xff : 0x00);
+        write(&value, sizeof(value));
+        return;
+    }
+
+    // open path down to the parent of this node
+    while (path_.size() < level) { path_.emplace_back(); }
+
+    if (type == 0x1) {
+        materialize();
+        const auto jumpPlace(slot());
+        write(data, size);
+        const std::uint32_t jump(size);
+        writeAt(jumpPlace, &jump, sizeof(jump));
+    }
+
+    add(type);
+}
+
+void TreeWriter::add(std::uint8_t type)
+{
+    for (;;) {
+        auto &node(path_.back());
+        node.children |= (type << (2 * (3 - node.count)));
+        if (++node.count < 4) { return; }
+
+        // node complete
+        if (node.materialized) {
+            // at least one gray child
+            type = 0x1;
+        } else {
+            // all children are leaves
+            switch (node.children) {
+            case 0x00: type = 0x0; break;
+            case 0xff: type = 0x3; break;
+            default:
+                type = 0x1;
+                materialize();
+                break;
+            }
+        }
+
+        const bool root(path_.size() == 1);
+        if (type == 0x1) {
+            writeAt(node.start, &node.children, sizeof(node.children));
+            if (!root) {
+                const std::uint32_t jump
+                    (end_ - node.slot - sizeof(std::uint32_t));
+                writeAt(node.slot, &jump, sizeof(jump));
+            }
+        }
+
+        path_.pop_back();
+
+        if (root) {
+            if (type != 0x1) {
+                // whole tree is a leaf
+                const std::uint8_t value(type ? 0xff : 0x00);
+                write(&value, sizeof(value));
+            }
+            return;
+        }
+    }
+}
+
+void TreeWriter::materialize()
+{
+    for (auto &node : path_) {
+        if (node.materialized) { continue; }
+
+        // root has no jump offset
+        if (&node != &path_.front()) { node.slot = slot(); }
+
+        node.start = end_;
+        const std::uint8_t children(0);
+        write(&children, sizeof(children));
+        node.materialized = true;
+    }
+}
+
+std::streamoff TreeWriter::slot()
+{
+    static const char zeros[2 * sizeof(std::uint32_t)] = { 0 };
+
+    const auto pos(utility::align(end_, sizeof(std::uint32_t)));
+    write(zeros, pos + sizeof(std::uint32_t) - end_);
+    return pos;
+}
+
+void TreeWriter::write(const void *data, std::size_t size)
+{
+    f_.write(static_cast<const char*>(data), size);
+    end_ += size;
+}
+
+void TreeWriter::writeAt(std::streamoff pos, const void *data
+                         , std::size_t size)
+{
+    f_.seekp(pos);
+    f_.write(static_cast<const char*>(data), size);
+    f_.seekp(end_);
+}
+
+} // namespace detail
+
+/** Scratch file record of one tile. Records of all tiles form a table at
+ *  the start of the scratch file (unwritten records read as zeros), tile
+ *  data follow the table.
+ */
+struct Writer::Record {
+    std::uint64_t offset;
+    std::uint32_t size;
+    std::uint8_t type;
+    std::uint8_t spilled;
+    std::uint8_t reserved[2];
+};
+
+Writer::Writer(std::ostream &f, const math::Size2 &size
+               , unsigned int tileDepth
+               , const boost::filesystem::path &scratchDir)
+    : size_(size), depth_(treeDepth(size))
+      // keep tiles below root: tile data are valid only at aligned position
+    , tileDepth_(depth_ ? std::min(tileDepth, depth_ - 1) : 0)
+    , tileSize_(1 << tileDepth_), levels_(depth_ - tileDepth_)
+    , tree_(f, depth_)
+    , cursor_(), tileCount_(std::uint64_t(1) << (2 * levels_))
+    , tilesX_((size.width + tileSize_ - 1) >> tileDepth_)
+    , tilesY_((size.height + tileSize_ - 1) >> tileDepth_)
+    , scratchDir_(scratchDir), scratchEnd_(), spilled_()
+    , bandRows_(), row_()
+{}
+
+Writer::~Writer()
+{
+    removeScratch();
+}
+
+void Writer::tile(unsigned int x, unsigned int y, Tile &&tile)
+{
+    const auto index(morton(x, y));
+    Record record;
+    if (tree_.finished() || (x >= tilesX_) || (y >= tilesY_)
+        || (index < cursor_) || readRecord(x, y, record))
+    {
+        LOGTHROW(err1, std::runtime_error)
+            << "Invalid or duplicate tile <" << x << ", " << y
+            << "> added to mapped QTree RasterMask.";
+    }
+
+    if (index != cursor_) {
+        // not our turn yet
+        spill(x, y, tile);
+        return;
+    }
+
+    tree_.push(levels_, tile.type, tile.data.data(), tile.data.size());
+    ++cursor_;
+    drain();
+}
+
+std::streamoff Writer::recordPos(unsigned int x, unsigned int y) const
+{
+    return std::streamoff(sizeof(Record))
+        * (std::streamoff(y) * tilesX_ + x);
+}
+
+bool Writer::readRecord(unsigned int x, unsigned int y, Record &record)
+{
+    if (!spilled_) { return false; }
+
+    auto &f(*scratch_);
+    f.seekg(recordPos(x, y));
+    f.read(reinterpret_cast<char*>(&record), sizeof(record));
+    if (f.gcount() != sizeof(record)) {
+        // past end of file -> never written
+        f.clear();
+        return false;
+    }
+    return record.spilled;
+}
+
+void Writer::spill(unsigned int x, unsigned int y, const Tile &tile)
+{
+    if (!scratch_) {
+        // first spill, create scratch file
+        namespace fs = boost::filesystem;
+        scratchPath_ = ((scratchDir_.empty()
+                         ? fs::temp_directory_path() : scratchDir_)
+                        / fs::unique_path("mqwriter-%%%%-%%%%-%%%%.tmp"));
+        scratch_.reset(new std::fstream
+                       (scratchPath_.string()
+                        , std::ios::in | std::ios::out | std::ios::trunc
+                        | std::ios::binary));
+        if (!*scratch_) {
+            scratch_.reset();
+            LOGTHROW(err1, std::runtime_error)
+                << "Unable to create scratch file " << scratchPath_
+                << " for mapped QTree RasterMask writer.";
+        }
+
+        // data follow record table
+        scratchEnd_ = std::streamoff(sizeof(Record)) * tilesX_ * tilesY_;
+    }
+
+    auto &f(*scratch_);
+
+    Record record = { std::uint64_t(scratchEnd_)
+                      , std::uint32_t(tile.data.size())
+                      , tile.type, 1, { 0, 0 } };
+    if (!tile.data.empty()) {
+        f.seekp(scratchEnd_);
+        f.write(tile.data.data(), tile.data.size());
+        scratchEnd_ += tile.data.size();
+    }
+
+    f.seekp(recordPos(x, y));
+    f.write(reinterpret_cast<const char*>(&record), sizeof(record));
+
+    if (!f) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Unable to write to scratch file " << scratchPath_
+            << " of mapped QTree RasterMask writer.";
+    }
+    ++spilled_;
+}
+
+bool Writer::unspill(unsigned int x, unsigned int y, Tile &tile)
+{
+    Record record;
+    if (!readRecord(x, y, record)) { return false; }
+
+    auto &f(*scratch_);
+    tile.type = record.type;
+    tile.data.resize(record.size);
+    if (record.size) {
+        f.seekg(record.offset);
+        f.read(&tile.data[0], record.size);
+        if (!f) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Unable to read from scratch file " << scratchPath_
+                << " of mapped QTree RasterMask writer.";
+        }
+    }
+
+    --spilled_;
+    return true;
+}
+
+void Writer::removeScratch()
+{
+    if (!scratch_) { return; }
+
+    scratch_.reset();
+    spilled_ = 0;
+    boost::system::error_code ec;
+    boost::filesystem::remove(scratchPath_, ec);
+}
+
+void Writer::flushBand()
+{
+    if (!bandRows_) { return; }
+
+    const auto width(size_.width);
+    const auto by(row_ - bandRows_);
+    const auto *band(band_.data());
+    const auto sample([&](unsigned int x, unsigned int y) -> bool
+    {
+        return band[std::size_t(y - by) * width + x];
+    });
+
+    // limit tiles to buffered rows
+    const math::Size2 limits(width, row_);
+    const unsigned int ty(by >> tileDepth_);
+    for (unsigned int tx(0); int(tx * tileSize_) < width; ++tx) {
+        Tile tile;
+        tile.type = detail::serializeSubtree
+            (tile.data, tx * tileSize_, by, tileSize_, limits, sample);
+        this->tile(tx, ty, std::move(tile));
+    }
+
+    bandRows_ = 0;
+}
+
+void Writer::drain(bool force)
+{
+    while (cursor_ < tileCount_) {
+        const auto x(compactBits(cursor_) << tileDepth_);
+        const auto y(compactBits(cursor_ >> 1) << tileDepth_);
+
+        if ((int(x) >= size_.width) || (int(y) >= size_.height)) {
+            // outside mask: find largest aligned block starting here, whole
+            // block is outside as well
+            unsigned int k(0);
+            while ((k < levels_) && !(cursor_ & ((std::uint64_t(4) << (2 * k))
+                                                 - 1)))
+            {
+                ++k;
+            }
+            tree_.push(levels_ - k, 0x0);
+            cursor_ += std::uint64_t(1) << (2 * k);
+            continue;
+        }
+
+        if (unspill(x >> tileDepth_, y >> tileDepth_, unspilled_)) {
+            tree_.push(levels_, unspilled_.type, unspilled_.data.data()
+                       , unspilled_.data.size());
+        } else {
+            if (!force) { return; }
+            tree_.push(levels_, 0x0);
+        }
+        ++cursor_;
+    }
+}
+
+void Writer::finish()
+{
+    if (tree_.finished()) { return; }
+
+    flushBand();
+    drain(true);
+    tree_.finish();
+    removeScratch();
+}
+
+namespace detail {
+
+enum class SetOp { merge, intersect, subtract };
+
+/** Walks two mapped masks together.
+ */
+struct Combiner {
+    /** Leaf or gray node in a mapped mask.
+     */
+    struct Node {
+        const RasterMask *mask;
+        std::uint8_t type;
+        std::size_t index; // gray node: position of children byte
+        std::size_t size; // gray node (non-root): size of serialized subtree
+    };
+
+    static Node root(const RasterMask &mask) {
+        switch (std::uint8_t(mask.data_[mask.start_])) {
+        case 0x00: return { &mask, 0x0, 0, 0 };
+        case 0xff: return { &mask, 0x3, 0, 0 };
+        default: break;
+        }
+        return { &mask, 0x1, mask.start_, 0 };
+    }
+
+    /** Combines a and b into quadtree mask out (of the same depth). Output
+     *  is reset first and recounted at the end since
+     *  quadtree::RasterMask::setQuad does not clip quads by mask size.
+     */
+    static void combine(SetOp op, const RasterMask &a, const RasterMask &b
+                        , quadtree::RasterMask &out);
+
+    static void children(const Node &node, Node (&children)[4]) {
+        const auto &mask(*node.mask);
+        std::size_t index(node.index);
+        const auto value(mask.read<std::uint8_t>(index));
+        for (unsigned int child(0); child < 4; ++child) {
+            const auto type(childType(value, child));
+            if (isGray(type)) {
+                const auto jump(mask.read<std::uint32_t>(index));
+                children[child] = { &mask, 0x1, index, jump };
+                index += jump;
+            } else {
+                children[child] = { &mask, type, 0, 0 };
+            }
+        }
+    }
+
+    static const char* data(const Node &node) {
+        return node.mask->data_ + node.index;
+    }
+
+    template <typename Sink>
+    static void combine(SetOp op, const Node &a, const Node &b
+                        , unsigned int level, unsigned int x, unsigned int y
+                        , Sink &sink)
+    {
+        switch (op) {
+        case SetOp::merge:
+            if ((a.type == 0x3) || (b.type == 0x3)) {
+                return sink.leaf(level, x, y, true);
+            }
+            if (a.type == 0x0) { return emit(b, level, x, y, false, sink); }
+            if (b.type == 0x0) { return emit(a, level, x, y, false, sink); }
+            break;
+
+        case SetOp::intersect:
+            if ((a.type == 0x0) || (b.type == 0x0)) {
+                return sink.leaf(level, x, y, false);
+            }
+            if (a.type == 0x3) { return emit(b, level, x, y, false, sink); }
+            if (b.type == 0x3) { return emit(a, level, x, y, false, sink); }
+            break;
+
+        case SetOp::subtract:
+            if ((a.type == 0x0) || (b.type == 0x3)) {
+                return sink.leaf(level, x, y, false);
+            }
+            if (b.type == 0x0) { return emit(a, level, x, y, false, sink); }
+            if (a.type == 0x3) { return emit(b, level, x, y, true, sink); }
+            break;
+        }
+
+        // both gray -> descend
+        Node ac[4], bc[4];
+        children(a, ac);
+        children(b, bc);
+        for (unsigned int child(0); child < 4; ++child) {
+            combine(op, ac[child], bc[child], level + 1
+                    , 2 * x + (child & 1), 2 * y + (child >> 1), sink);
+        }
+    }
+
+    template <typename Sink>
+    static void emit(const Node &node, unsigned int level
+                     , unsigned int x, unsigned int y, bool invert
+                     , Sink &sink)
+    {
+        if (node.type != 0x1) {
+            return sink.leaf(level, x, y, (node.type == 0x3) != invert);
+        }
+
+        if (level) { return sink.subtree(level, x, y, node, invert); }
+
+        // root is not aligned, cannot be copied as a whole
+        Node nc[4];
+        children(node, nc);
+        for (unsigned int child(0); child < 4; ++child) {
+            emit(nc[child], 1, child & 1, child >> 1, invert, sink);
+        }
+    }
+};
+
+} // namespace detail
+
+namespace {
+
+typedef detail::Combiner Combiner;
+
+/** Inverts serialized subtree in place: inverted children byte keeps
+ *  structure (gray 01 <-> 10) so only children bytes are touched.
+ */
+void invertSubtree(std::string &data, std::size_t index)
+{
+    auto &value(data[index++]);
+    value = ~value;
+
+    for (unsigned int child(0); child < 4; ++child) {
+        if (!isGray(childType(value, child))) { continue; }
+
+        index = utility::align(index, sizeof(std::uint32_t));
+        std::uint32_t jump;
+        std::memcpy(&jump, &data[index], sizeof(jump));
+        index += sizeof(jump);
+        invertSubtree(data, index);
+        index += jump;
+    }
+}
+
+struct StreamSink {
+    StreamSink(std::ostream &f, unsigned int depth) : tree(f, depth) {}
+
+    void leaf(unsigned int level, unsigned int, unsigned int, bool value) {
+        tree.push(level, value ? 0x3 : 0x0);
+    }
+
+    void subtree(unsigned int level, unsigned int, unsigned int
+                 , const Combiner::Node &node, bool invert)
+    {
+        if (!invert) {
+            tree.push(level, 0x1, Combiner::data(node), node.size);
+            return;
+        }
+
+        tmp.assign(Combiner::data(node), node.size);
+        invertSubtree(tmp, 0);
+        tree.push(level, 0x1, tmp.data(), tmp.size());
+    }
+
+    detail::TreeWriter tree;
+    std::string tmp;
+};
+
+struct QuadtreeSink {
+    QuadtreeSink(quadtree::RasterMask &mask) : mask(mask) {}
+
+    void leaf(unsigned int level, unsigned int x, unsigned int y
+              , bool value)
+    {
+        if (value) { mask.setQuad(level, x, y, true); }
+    }
+
+    void subtree(unsigned int level, unsigned int x, unsigned int y
+                 , const Combiner::Node &node, bool invert)
+    {
+        Combiner::Node nc[4];
+        Combiner::children(node, nc);
+        for (unsigned int child(0); child < 4; ++child) {
+            const auto cx(2 * x + (child & 1));
+            const auto cy(2 * y + (child >> 1));
+            if (nc[child].type == 0x1) {
+                subtree(level + 1, cx, cy, nc[child], invert);
+            } else {
+                leaf(level + 1, cx, cy, (nc[child].type == 0x3) != invert);
+            }
+        }
+    }
+
+    quadtree::RasterMask &mask;
+};
+
+void checkOperands(const RasterMask &a, const RasterMask &b)
+{
+    if (!a || !b) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Cannot combine invalid mapped QTree RasterMask.";
+    }
+
+    if (a.depth() != b.depth()) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Cannot combine mapped QTree RasterMasks of different depth ("
+            << a.depth() << " and " << b.depth() << ").";
+    }
+}
+
+void combine(detail::SetOp op, std::ostream &out, const RasterMask &a
+             , const RasterMask &b)
+{
+    checkOperands(a, b);
+
+    StreamSink sink(out, a.depth());
+    Combiner::combine(op, Combiner::root(a), Combiner::root(b), 0, 0, 0
+                      , sink);
+    sink.tree.finish();
+}
+
+void combine(detail::SetOp op, quadtree::RasterMask &out, const RasterMask &a
+             , const RasterMask &b)
+{
+    checkOperands(a, b);
+
+    if (out.depth() != a.depth()) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Output QTree RasterMask depth (" << out.depth()
+            << ") differs from mapped QTree RasterMask depth ("
+            << a.depth() << ").";
+    }
+
+    Combiner::combine(op, a, b, out);
+}
+
+} // namespace
+
+void detail::Combiner::combine(SetOp op, const RasterMask &a
+                               , const RasterMask &b
+                               , quadtree::RasterMask &out)
+{
+    out.reset(false);
+    QuadtreeSink sink(out);
+    combine(op, root(a), root(b), 0, 0, 0, sink);
+
+    // quads crossing mask border were counted whole
+    out.recount();
+}
+
+void merge(std::ostream &out, const RasterMask &a, const RasterMask &b)
+{
+    combine(detail::SetOp::merge, out, a, b);
+}
+
+void intersect(std::ostream &out, const RasterMask &a, const RasterMask &b)
+{
+    combine(detail::SetOp::intersect, out, a, b);
+}
+
+void subtract(std::ostream &out, const RasterMask &a, const RasterMask &b)
+{
+    combine(detail::SetOp::subtract, out, a, b);
+}
+
+void merge(quadtree::RasterMask &out, const RasterMask &a
+           , const RasterMask &b)
+{
+    combine(detail::SetOp::merge, out, a, b);
+}
+
+void intersect(quadtree::RasterMask &out, const RasterMask &a
+               , const RasterMask &b)
+{
+    combine(detail::SetOp::intersect, out, a, b);
+}
+
+void subtract(quadtree::RasterMask &out, const RasterMask &a
+              , const RasterMask &b)
+{
+    combine(detail::SetOp::subtract, out, a, b);
+}
+
 } } // namespace imgproc::mappedqtree
@@ -34,6 +34,8 @@
 #define imgproc_rastermask_mappedqtree_hpp_included_
 
 #include <memory>
+#include <vector>
+#include <string>
 #include <cstdint>
 #include <cstring>
 #include <algorithm>
@@ -48,6 +50,8 @@
 
 #include "math/geometry_core.hpp"
 
+#include "detail/spans.hpp"
+
 /**** mappedqtree version of rastermask ****/
 
 /** Format:
@@ -90,6 +94,8 @@ class RasterMask;
 
 namespace imgproc { namespace mappedqtree {
 
+namespace detail { struct Combiner; }
+
 class RasterMask {
 public:
     RasterMask();
@@ -152,6 +158,30 @@ public:
     void forEachQuad(const Op &op, const Constraints &constraints
                      = Constraints()) const;
 
+    /** Calls op(y, x0, x1, white) for each maximal horizontal run [x0, x1)
+     *  of pixels of the same value, row by row. Only pixels inside extents
+     *  (whole tree if invalid) are visited, runs are clipped to them.
+     *
+     *  Only nodes crossing the current row are visited, gray siblings in the
+     *  other half of a node are skipped via their jump offsets.
+     */
+    template <typename Op>
+    void forEachSpan(const Op &op, const Extents &extents
+                     = Extents(math::InvalidExtents{})) const;
+
+    /** Returns mask value at given pixel. Only single root-to-leaf path is
+     *  visited (gray siblings are skipped via their jump offsets).
+     *  Returns false for pixels outside the mask.
+     */
+    bool get(int x, int y) const;
+
+    /** Batched version of get(x, y): result[i] holds value of points[i].
+     *
+     *  Points are processed in Morton order so each tree node is visited at
+     *  most once for the whole batch.
+     */
+    std::vector<bool> get(const std::vector<math::Point2i> &points) const;
+
     unsigned int depth() const { return depth_; }
 
     math::Size2i size() const {
@@ -177,11 +207,25 @@ private:
                      , const Extents *extents)
         const;
 
+    friend struct detail::Combiner;
+
+    struct Query;
+
+    /** Called from RasterMask::get(points) */
+    void get(std::size_t index, unsigned int shift
+             , const Query *begin, const Query *end
+             , std::vector<bool> &result) const;
+
     /** Called from RasterMask::forEachQuad */
     template <typename Op>
     void descend(const Node &node, std::size_t index, const Op &op
                  , unsigned int depthLimit, const Extents *extents) const;
 
+    /** Called from RasterMask::forEachSpan */
+    template <typename Span>
+    void row(const Node &node, std::size_t index, unsigned int y
+             , Span &span) const;
+
     struct Memory;
     std::shared_ptr<Memory> memory_;
 
@@ -193,6 +237,226 @@ private:
     std::size_t start_;
 };
 
+namespace detail {
+
+/** Writes mappedqtree::RasterMask's on-disk format node by node.
+ *
+ *  Nodes are pushed in tree (Morton) order at any level; only one path of
+ *  open nodes is kept and jump offsets are backpatched when a node gets
+ *  closed. Nodes whose children are all leaves are never written so
+ *  contraction needs no rewinding.
+ */
+class TreeWriter {
+public:
+    /** Writes header for tree of given depth.
+     */
+    TreeWriter(std::ostream &f, unsigned int depth);
+
+    /** Adds node at given level (root is at level 0).
+     *
+     *  \param type 0x0: black, 0x3: white, 0x1: gray
+     *  \param data serialized gray node (must be aligned to 4 bytes at its
+     *               source), root cannot be gray
+     *  \param size size of data
+     */
+    void push(unsigned int level, std::uint8_t type
+              , const char *data = nullptr, std::size_t size = 0);
+
+    /** Writes final data size. Whole tree must have been pushed.
+     */
+    void finish();
+
+    bool finished() const { return finished_; }
+
+private:
+    void add(std::uint8_t type);
+    void materialize();
+    std::streamoff slot();
+    void write(const void *data, std::size_t size);
+    void writeAt(std::streamoff pos, const void *data, std::size_t size);
+
+    struct Open {
+        std::uint8_t children;
+        unsigned int count;
+        bool materialized;
+        std::streamoff slot;
+        std::streamoff start;
+
+        Open() : children(), count(), materialized(), slot(), start() {}
+    };
+
+    std::ostream &f_;
+    std::streamoff sizePlace_;
+    std::streamoff end_;
+    bool finished_;
+    std::vector<Open> path_;
+};
+
+} // namespace detail
+
+/** Streaming writer of the mappedqtree::RasterMask's on-disk format.
+ *
+ *  Mask data are delivered either row by row or tile by tile, no
+ *  quadtree::RasterMask is ever built. Each tile is serialized as soon as it
+ *  is complete. Serialized tiles are written to the output in tree (Morton)
+ *  order by detail::TreeWriter.
+ *
+ *  Tiles that arrive ahead of their turn (e.g. all tiles right of the
+ *  current tree path when feeding rows, up to about half of all tiles) are
+ *  spilled in their serialized form to a temporary scratch file and read
+ *  back once their turn comes. Scratch file holds a fixed-size record per
+ *  tile followed by tile data; it is created on first spill and removed by
+ *  finish() (or destructor).
+ *
+ *  Resident memory is therefore one band of tileSize() rows (addRows()),
+ *  one tile and the open tree path (depth), regardless of input order.
+ *
+ *  Pixels outside mask size are black. Output stream must be seekable.
+ */
+class Writer {
+public:
+    /** Starts writing mask of given size, header is written immediately.
+     *
+     *  \param f output stream
+     *  \param size mask size
+     *  \param tileDepth log2 of tile size (clamped to the tree depth)
+     *  \param scratchDir directory for scratch file (system temporary
+     *                    directory if empty)
+     */
+    Writer(std::ostream &f, const math::Size2 &size
+           , unsigned int tileDepth = 6
+           , const boost::filesystem::path &scratchDir
+           = boost::filesystem::path());
+
+    /** Removes scratch file, if any.
+     */
+    ~Writer();
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    /** Adds next count rows. Calls sample(x, y) for each pixel of each added
+     *  row, y is row index in the mask.
+     *
+     *  Only one band of tileSize() rows is buffered.
+     */
+    template <typename Sample>
+    void addRows(const Sample &sample, unsigned int count = 1);
+
+    /** Adds whole tile at tile grid coordinates (x, y). Calls sample(x, y)
+     *  for each pixel of tile inside mask, coordinates are in the mask.
+     *
+     *  Tiles can be added in any order; tiles in Morton order are never
+     *  spilled to scratch file. Do not mix with addRows().
+     */
+    template <typename Sample>
+    void addTile(unsigned int x, unsigned int y, const Sample &sample);
+
+    /** Writes rest of the tree (missing rows/tiles are black) and final data
+     *  size. Must be called once all data are added.
+     */
+    void finish();
+
+    unsigned int tileSize() const { return tileSize_; }
+
+private:
+    struct Tile {
+        std::uint8_t type;
+        std::string data;
+
+        Tile(std::uint8_t type = 0x0) : type(type) {}
+    };
+
+    template <typename Sample>
+    Tile buildTile(unsigned int x, unsigned int y, const Sample &sample)
+        const;
+
+    /** Writes tile if it is its turn (followed by all ready spilled
+     *  tiles), spills it otherwise.
+     */
+    void tile(unsigned int x, unsigned int y, Tile &&tile);
+
+    /** Writes ready tiles; missing tiles are black if force is set.
+     */
+    void drain(bool force = false);
+
+    /** Scratch file record of tile at tile grid coordinates (x, y).
+     */
+    struct Record;
+
+    /** Position of tile record in scratch file.
+     */
+    std::streamoff recordPos(unsigned int x, unsigned int y) const;
+
+    /** Reads tile record, returns false if tile has not been spilled.
+     *  Records of tiles already written are kept, i.e. valid only for tiles
+     *  at or after the cursor.
+     */
+    bool readRecord(unsigned int x, unsigned int y, Record &record);
+
+    /** Stores tile in scratch file.
+     */
+    void spill(unsigned int x, unsigned int y, const Tile &tile);
+
+    /** Loads spilled tile, returns false if tile has not been spilled.
+     */
+    bool unspill(unsigned int x, unsigned int y, Tile &tile);
+
+    /** Closes and removes scratch file.
+     */
+    void removeScratch();
+
+    /** Converts buffered rows to tiles.
+     */
+    void flushBand();
+
+    math::Size2 size_;
+    unsigned int depth_;
+    unsigned int tileDepth_;
+    unsigned int tileSize_;
+    unsigned int levels_;
+
+    detail::TreeWriter tree_;
+
+    std::uint64_t cursor_;
+    std::uint64_t tileCount_;
+    unsigned int tilesX_;
+    unsigned int tilesY_;
+
+    boost::filesystem::path scratchDir_;
+    boost::filesystem::path scratchPath_;
+    std::unique_ptr<std::fstream> scratch_;
+    std::streamoff scratchEnd_;
+    std::uint64_t spilled_;
+    Tile unspilled_;
+
+    std::vector<std::uint8_t> band_;
+    unsigned int bandRows_;
+    unsigned int row_;
+};
+
+/** Set operations on two mapped masks.
+ *
+ *  Both trees are walked together. Uniform subtree of one operand decides
+ *  the result without descending into the other one; subtrees taken over
+ *  from an operand are copied verbatim.
+ *
+ *  Result is either streamed to the output in the on-disk format or stored
+ *  in given quadtree mask (its size is kept, its content is replaced).
+ *
+ *  Both masks (and the output quadtree mask) must have the same depth.
+ */
+void merge(std::ostream &out, const RasterMask &a, const RasterMask &b);
+void intersect(std::ostream &out, const RasterMask &a, const RasterMask &b);
+void subtract(std::ostream &out, const RasterMask &a, const RasterMask &b);
+
+void merge(quadtree::RasterMask &out, const RasterMask &a
+           , const RasterMask &b);
+void intersect(quadtree::RasterMask &out, const RasterMask &a
+               , const RasterMask &b);
+void subtract(quadtree::RasterMask &out, const RasterMask &a
+              , const RasterMask &b);
+
 struct AsNode { std::uint8_t value; };
 
 template<typename CharT, typename Traits>
@@ -348,6 +612,156 @@ void RasterMask::descend(const Node &node, std::size_t index, const Op &op
     processSubtree(type(0), depthLimit - 1, node.child(split, split));
 }
 
+template <typename Op>
+void RasterMask::forEachSpan(const Op &op, const Extents &extents) const
+{
+    const unsigned int size(1 << depth_);
+    unsigned int x0(0), y0(0), x1(size), y1(size);
+    if (math::valid(extents)) {
+        x0 = std::min(extents.ll(0), size);
+        y0 = std::min(extents.ll(1), size);
+        x1 = std::min(extents.ur(0), size);
+        y1 = std::min(extents.ur(1), size);
+    }
+
+    std::size_t index(start_);
+    const auto value(read<std::uint8_t>(index));
+
+    for (unsigned int y(y0); y < y1; ++y) {
+        imgproc::detail::SpanBuilder<Op> span(op, y, x0, x1);
+        switch (value) {
+        case 0x00: span.add(x0, x1, false); break;
+        case 0xff: span.add(x0, x1, true); break;
+        default: row(Node(size), start_, y, span); break;
+        }
+        span.flush();
+    }
+}
+
+template <typename Span>
+void RasterMask::row(const Node &node, std::size_t index, unsigned int y
+                     , Span &span) const
+{
+    // get children value
+    const auto children(read<std::uint8_t>(index));
+
+    const auto split(node.size / 2);
+    const bool bottom(y >= (node.y + split));
+
+    for (unsigned int child(0); child < 4; ++child) {
+        if (!bottom && (child > 1)) { return; }
+
+        const auto type((children >> (2 * (3 - child))) & 0x3);
+        const auto cn(node.child((child & 1) ? split : 0
+                                 , (child & 2) ? split : 0));
+        const bool cross(bottom == bool(child & 2));
+
+        if ((type == 0x0) || (type == 0x3)) {
+            if (cross) { span.add(cn.x, cn.x + split, (type == 0x3)); }
+            continue;
+        }
+
+        // gray node: jump over it unless it crosses the row
+        auto jump(read<std::uint32_t>(index));
+        if (cross && span.inside(cn.x, cn.x + split)) {
+            row(cn, index, y, span);
+        }
+        index += jump;
+    }
+}
+
+namespace detail {
+
+/** Serializes subtree in mappedqtree format. Start of output must be aligned
+ *  to 4 bytes both here and in the final file; returns node type (0x0: black,
+ *  0x1: gray, 0x3: white), nothing is written for non-gray node.
+ */
+template <typename Sample>
+std::uint8_t serializeSubtree(std::string &out, unsigned int x, unsigned int y
+                              , unsigned int size, const math::Size2 &limits
+                              , const Sample &sample)
+{
+    if ((int(x) >= limits.width) || (int(y) >= limits.height)) { return 0x0; }
+    if (size == 1) { return sample(x, y) ? 0x3 : 0x0; }
+
+    const auto start(out.size());
+    out.push_back(0);
+
+    const auto half(size / 2);
+    std::uint8_t children(0);
+    for (unsigned int child(0); child < 4; ++child) {
+        // make room for jump offset
+        const auto before(out.size());
+        const auto slot(utility::align(before, sizeof(std::uint32_t)));
+        out.resize(slot + sizeof(std::uint32_t));
+
+        const auto type(serializeSubtree
+                        (out, x + ((child & 1) ? half : 0)
+                         , y + ((child & 2) ? half : 0)
+                         , half, limits, sample));
+
+        if (type == 0x1) {
+            const std::uint32_t jump
+                (out.size() - slot - sizeof(std::uint32_t));
+            std::memcpy(&out[slot], &jump, sizeof(jump));
+        } else {
+            // no jump offset for leaf
+            out.resize(before);
+        }
+
+        children |= (type << (2 * (3 - child)));
+    }
+
+    switch (children) {
+    case 0x00: out.resize(start); return 0x0;
+    case 0xff: out.resize(start); return 0x3;
+    default: break;
+    }
+
+    out[start] = char(children);
+    return 0x1;
+}
+
+} // namespace detail
+
+template <typename Sample>
+Writer::Tile Writer::buildTile(unsigned int x, unsigned int y
+                               , const Sample &sample) const
+{
+    Tile tile;
+    tile.type = detail::serializeSubtree
+        (tile.data, x * tileSize_, y * tileSize_, tileSize_, size_, sample);
+    return tile;
+}
+
+template <typename Sample>
+void Writer::addRows(const Sample &sample, unsigned int count)
+{
+    const auto width(size_.width);
+    if (band_.empty()) { band_.resize(std::size_t(tileSize_) * width); }
+
+    for (; count; --count) {
+        if (int(row_) >= size_.height) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Too many rows added to mapped QTree RasterMask.";
+        }
+
+        auto *data(band_.data() + std::size_t(bandRows_) * width);
+        for (int x(0); x < width; ++x) { *data++ = sample(x, row_); }
+
+        ++row_;
+        if ((++bandRows_ == tileSize_) || (int(row_) == size_.height)) {
+            flushBand();
+        }
+    }
+}
+
+template <typename Sample>
+void Writer::addTile(unsigned int x, unsigned int y, const Sample &sample)
+{
+    tile(x, y, buildTile(x, y, sample));
+}
+
 } } // namespace imgproc::mappedqtree
 
 #endif // imgproc_rastermask_mappedqtree_hpp_included_
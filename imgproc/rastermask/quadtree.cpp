@@ -34,14 +34,23 @@
 #include <stdexcept>
 #include <numeric>
 #include <cstdint>
+#include <new>
+#include <algorithm>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #include "dbglog/dbglog.hpp"
 #include "utility/binaryio.hpp"
 #include "utility/align.hpp"
+#include "utility/openmp.hpp"
 
 #include "bitfield.hpp"
 #include "quadtree.hpp"
 
+namespace bi = boost::interprocess;
+
 namespace imgproc { namespace quadtree {
 
 namespace {
@@ -60,6 +69,21 @@ namespace {
         }
         return depth;
     }
+
+    /** Node pool slab sizes (in blocks). Slabs grow geometrically so tiny
+     *  masks do not waste memory.
+     */
+    const std::size_t MinPoolSlabSize(16);
+    const std::size_t MaxPoolSlabSize(4096);
+
+    /** Bitfield conversion: blocks up to this size are classified by
+     *  counting whole bitfield words.
+     */
+    const unsigned int BitfieldBlockSize(64);
+
+    /** Bitfield conversion: minimal band height processed by one thread.
+     */
+    const unsigned int BitfieldBandHeight(256);
 }
 
 
@@ -67,7 +91,8 @@ RasterMask::RasterMask( unsigned int sizeX, unsigned int sizeY, const InitMode m
     : sizeX_( sizeX ), sizeY_( sizeY )
     , depth_(computeDepth(sizeX_, sizeY_))
     , quadSize_(1 << depth_)
-    , root_( *this )
+    , pool_(std::make_shared<NodePool>())
+    , root_(pool_.get())
 {
     switch ( mode ) {
     case EMPTY :
@@ -87,7 +112,8 @@ RasterMask::RasterMask( const math::Size2 & size, const InitMode mode )
     : sizeX_( size.width ), sizeY_( size.height )
     , depth_(computeDepth(sizeX_, sizeY_))
     , quadSize_(1 << depth_)
-    , root_( * this )
+    , pool_(std::make_shared<NodePool>())
+    , root_(pool_.get())
 {
     switch ( mode ) {
     case EMPTY :
@@ -106,8 +132,9 @@ RasterMask::RasterMask( const math::Size2 & size, const InitMode mode )
 RasterMask::RasterMask( const RasterMask & mask, const InitMode mode )
     : sizeX_( mask.sizeX_ ), sizeY_( mask.sizeY_ )
     , depth_(mask.depth_)
-    , quadSize_( mask.quadSize_ ),
-      root_( *this )
+    , quadSize_( mask.quadSize_ )
+    , pool_(std::make_shared<NodePool>())
+    , root_(pool_.get())
 {
     switch ( mode ) {
     case EMPTY:
@@ -120,15 +147,27 @@ RasterMask::RasterMask( const RasterMask & mask, const InitMode mode )
 
     case SOURCE:
     default:
+        // share whole tree
+        adopt(mask);
         count_ = mask.count_;
         root_ = mask.root_;
         break;
     }
 }
 
+RasterMask::~RasterMask()
+{
+    // nodes shared with other masks must be released one by one, otherwise
+    // they go away with the pool
+    if (pool_->shared()) { pool_->free(root_.children); }
+    root_.children = nullptr;
+    pool_->detach();
+}
+
 void RasterMask::invert()
 {
     root_.invert();
+    recount();
 }
 
 bool RasterMask::get( int x, int y ) const {
@@ -151,13 +190,42 @@ bool RasterMask::getClamped( int x, int y ) const {
 void RasterMask::set( int x, int y, bool value ) {
 
     if ( x < 0 || x >= (int) sizeX_ || y < 0 || y >= (int) sizeY_ ) return;
-    root_.set( (unsigned int) x, (unsigned int ) y, value, quadSize_ );
+    root_.set( *this, (unsigned int) x, (unsigned int ) y, value, quadSize_ );
 }
 
 void RasterMask::reset(bool value)
 {
-    // set root to given value
-    root_ = Node(*this, value ? NodeType::WHITE : NodeType::BLACK);
+    // drop whole tree and set root to given value
+    release();
+    root_.type = value ? NodeType::WHITE : NodeType::BLACK;
+    count_ = value ? capacity() : 0;
+}
+
+void RasterMask::release()
+{
+    if (pool_->shared()) {
+        // pool is shared with other masks -> drop our references and start
+        // with new pool
+        pool_->free(root_.children);
+        pool_->detach();
+        pool_ = std::make_shared<NodePool>();
+        root_.pool = pool_.get();
+    } else {
+        // all children live in the pool -> forget them and drop pool at once
+        root_.children = nullptr;
+        pool_->clear();
+    }
+    root_.type = NodeType::BLACK;
+}
+
+void RasterMask::adopt(const RasterMask &other)
+{
+    if (pool_ == other.pool_) { return; }
+
+    pool_->detach();
+    pool_ = other.pool_;
+    pool_->attach();
+    root_.pool = pool_.get();
 }
 
 bool RasterMask::onBoundary( int x, int y ) const {
@@ -175,6 +243,14 @@ bool RasterMask::onBoundary( int x, int y ) const {
     return false;
 }
 
+imgproc::bitfield::RasterMask RasterMask::boundary() const
+{
+    imgproc::bitfield::RasterMask m
+        (sizeX_, sizeY_, imgproc::bitfield::RasterMask::EMPTY);
+    forEachBoundary([&m](unsigned int x, unsigned int y) { m.add(x, y); });
+    return m;
+}
+
 void RasterMask::dump( std::ostream & f ) const
 {
     write(f, QT_RASTERMASK_IO_MAGIC); // 5 bytes
@@ -218,17 +294,60 @@ void RasterMask::load( std::istream & f )
     std::uint32_t count(0);
     f.read( reinterpret_cast<char *>( & count ), sizeof( count ) );
 
+    release();
     root_.load( f );
     recount();
 }
 
+void RasterMask::load(const boost::filesystem::path &path, std::size_t offset)
+{
+    bi::file_mapping file(path.string().c_str(), bi::read_only);
+    bi::mapped_region region(file, bi::read_only, offset);
+
+    const auto *data(static_cast<const std::uint8_t*>
+                     (region.get_address()));
+    const auto *end(data + region.get_size());
+
+    // magic + 3 reserved bytes + sizeX, sizeY, quadSize, count
+    const std::size_t headerSize(sizeof(QT_RASTERMASK_IO_MAGIC) + 3
+                                 + 4 * sizeof(std::uint32_t));
+    if (std::size_t(end - data) < headerSize) {
+        LOGTHROW(err2, std::runtime_error)
+            << "RasterMask file " << path << " is too short.";
+    }
+
+    if (std::memcmp(data, QT_RASTERMASK_IO_MAGIC,
+                    sizeof(QT_RASTERMASK_IO_MAGIC))) {
+        LOGTHROW(err2, std::runtime_error) << "RasterMask has wrong magic.";
+    }
+    data += sizeof(QT_RASTERMASK_IO_MAGIC) + 3;
+
+    std::memcpy(&sizeX_, data, sizeof(unsigned int));
+    data += sizeof(unsigned int);
+    std::memcpy(&sizeY_, data, sizeof(unsigned int));
+    data += sizeof(unsigned int);
+    // quad size and count ignored
+    data += 2 * sizeof(std::uint32_t);
+
+    // calculate depth and fix quad size
+    depth_ = computeDepth(sizeX_, sizeY_);
+    quadSize_ = (1 << depth_);
+
+    release();
+    root_.load(data, end, depth_);
+    recount();
+}
+
 RasterMask & RasterMask::operator = ( const RasterMask & op )
 {
     if ( & op == this ) return *this;
 
     sizeX_ = op.sizeX_;
     sizeY_ = op.sizeY_;
+    depth_ = op.depth_;
     quadSize_ = op.quadSize_;
+    release();
+    adopt(op);
     root_ = op.root_;
     count_ = op.count_;
 
@@ -238,20 +357,85 @@ RasterMask & RasterMask::operator = ( const RasterMask & op )
 
 RasterMask::NodeChildren* RasterMask::malloc()
 {
-    return new NodeChildren(*this);
+    return pool_->malloc();
+}
+
+/* class RasterMask::NodePool */
+
+RasterMask::NodeChildren* RasterMask::NodePool::malloc()
+{
+    return new (allocate()) NodeChildren(this);
 }
 
-RasterMask::NodeChildren* RasterMask::malloc(NodeType type)
+RasterMask::NodeChildren* RasterMask::NodePool::malloc(NodeType type)
 {
-    return new NodeChildren(*this, type);
+    return new (allocate()) NodeChildren(this, type);
 }
 
-void RasterMask::free(NodeChildren *&children)
+void RasterMask::NodePool::free(NodeChildren *&children)
 {
-    delete children;
+    if (!children) { return; }
+
+    if (children->refs.fetch_sub(1) == 1) {
+        // last reference: destroy children (recursively frees their
+        // subtrees) and return block
+        children->~NodeChildren();
+        deallocate(children);
+    }
     children = 0x0;
 }
 
+void* RasterMask::NodePool::allocate()
+{
+    if (!locking()) { return allocateImpl(); }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocateImpl();
+}
+
+void* RasterMask::NodePool::allocateImpl()
+{
+    // reuse freed block if available
+    if (free_) {
+        auto *block(free_);
+        free_ = block->next;
+        return block;
+    }
+
+    if (used_ == slabSize_) {
+        // current slab exhausted -> allocate new one
+        slabSize_ = (slabSize_
+                     ? std::min(2 * slabSize_, MaxPoolSlabSize)
+                     : MinPoolSlabSize);
+        slabs_.emplace_back(new Block[slabSize_]);
+        used_ = 0;
+    }
+
+    return &slabs_.back()[used_++];
+}
+
+void RasterMask::NodePool::deallocate(void *block)
+{
+    auto *b(static_cast<Block*>(block));
+
+    if (!locking()) {
+        b->next = free_;
+        free_ = b;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    b->next = free_;
+    free_ = b;
+}
+
+void RasterMask::NodePool::clear()
+{
+    slabs_.clear();
+    free_ = nullptr;
+    used_ = slabSize_ = 0;
+}
+
 void RasterMask::merge(const RasterMask &other, bool checkDimensions)
 {
     if (checkDimensions) {
@@ -287,6 +471,69 @@ void RasterMask::subtract(const RasterMask &other)
     recount();
 }
 
+template <typename Op>
+void RasterMask::runParallel(const Op &op)
+{
+    // node children are (de)allocated from multiple threads; counted (not
+    // flagged) since other masks sharing the pool can run parallel
+    // operations at the same time
+    struct Guard {
+        Guard(NodePool &pool) : pool(pool) { pool.enterParallel(); }
+        ~Guard() { pool.leaveParallel(); }
+        NodePool &pool;
+    } guard(*pool_);
+
+    UTILITY_OMP(parallel)
+    UTILITY_OMP(single)
+    op();
+}
+
+void RasterMask::invert(const Parallel &parallel)
+{
+    runParallel([&]() { root_.invert(parallel.grainDepth); });
+    recount();
+}
+
+void RasterMask::merge(const RasterMask &other, const Parallel &parallel
+                       , bool checkDimensions)
+{
+    if (checkDimensions) {
+        if ((sizeX_ != other.sizeX_) || (sizeY_ != other.sizeY_)) {
+            LOGTHROW(err1, std::runtime_error)
+                << "Attempt to merge in data from mask with diferent "
+                "dimensions.";
+        }
+    }
+    runParallel([&]() { root_.merge(other.root_, parallel.grainDepth); });
+    recount();
+}
+
+void RasterMask::intersect(const RasterMask &other, const Parallel &parallel)
+{
+    if ((sizeX_ != other.sizeX_) || (sizeY_ != other.sizeY_)) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Attempt to intersect with data from mask with diferent "
+            "dimensions.";
+    }
+    runParallel([&]() {
+            root_.intersect(other.root_, parallel.grainDepth);
+        });
+    recount();
+}
+
+void RasterMask::subtract(const RasterMask &other, const Parallel &parallel)
+{
+    if ((sizeX_ != other.sizeX_) || (sizeY_ != other.sizeY_)) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Attempt to subtract data from mask with diferent "
+            "dimensions.";
+    }
+    runParallel([&]() {
+            root_.subtract(other.root_, parallel.grainDepth);
+        });
+    recount();
+}
+
 void RasterMask::coarsen(const unsigned int threshold)
 {
     // sanity check
@@ -317,7 +564,7 @@ void RasterMask::recount()
 /* class RasterMask::Node */
 
 RasterMask::Node::~Node() {
-    mask.free(children);
+    pool->free(children);
 }
 
 bool RasterMask::Node::get( unsigned int x, unsigned int y, unsigned int size ) const {
@@ -352,17 +599,20 @@ bool RasterMask::Node::get( unsigned int x, unsigned int y, unsigned int size )
     }
 }
 
-void RasterMask::Node::set( unsigned int x, unsigned int y, bool value, unsigned int size )
+void RasterMask::Node::set( RasterMask &mask, unsigned int x, unsigned int y
+                            , bool value, unsigned int size )
 {
     unsigned int split = size >> 1;
 
     // split node if necessarry
     if ( ( ( type == BLACK && value ) || ( type == WHITE && ! value  ) )
         && size > 1 ) {
-        children = mask.malloc(type);
+        children = pool->malloc(type);
         type = GRAY;
     }
 
+    own();
+
     // process
     if ( type == BLACK ) {
         if ( value ) { type = WHITE; mask.count_++; }
@@ -371,15 +621,15 @@ void RasterMask::Node::set( unsigned int x, unsigned int y, bool value, unsigned
     } else if ( type == GRAY ) {
         if ( x < split ) {
             if ( y < split ) {
-                children->ul.set( x, y, value, split );
+                children->ul.set( mask, x, y, value, split );
             } else {
-                children->ll.set( x, y - split, value, split );
+                children->ll.set( mask, x, y - split, value, split );
             }
         } else {
             if ( y < split ) {
-                children->ur.set( x - split, y, value, split );
+                children->ur.set( mask, x - split, y, value, split );
             } else {
-                children->lr.set( x - split, y - split, value, split );
+                children->lr.set( mask, x - split, y - split, value, split );
             }
         }
     }
@@ -397,12 +647,12 @@ void RasterMask::Node::contract()
     if (children->ul.type == WHITE && children->ll.type == WHITE
         && children->ur.type == WHITE && children->lr.type == WHITE )
     {
-        mask.free(children);
+        pool->free(children);
         type = WHITE;
     } else if (children->ul.type == BLACK && children->ll.type == BLACK
                && children->ur.type == BLACK && children->lr.type == BLACK)
     {
-        mask.free(children);
+        pool->free(children);
         type = BLACK;
     }
 }
@@ -413,26 +663,48 @@ RasterMask::Node & RasterMask::Node::operator = (
     // no self-assignment
     if ( this == &s ) return *this;
 
-    // clean
-    if ( type == GRAY ) {
-        mask.free(children);
+    // get new children first, source can live in our subtree
+    NodeChildren *c(nullptr);
+    if ( s.type == GRAY ) {
+        if ( s.pool == pool ) {
+            // same pool -> share
+            c = s.children;
+            ++c->refs;
+        } else {
+            c = pool->malloc();
+            c->ul = s.children->ul;
+            c->ll = s.children->ll;
+            c->ur = s.children->ur;
+            c->lr = s.children->lr;
+        }
     }
 
+    // clean
+    pool->free(children);
+
     // assign
     type = s.type;
-
-    if ( type == GRAY ) {
-        children = mask.malloc();
-        children->ul = s.children->ul;
-        children->ll = s.children->ll;
-        children->ur = s.children->ur;
-        children->lr = s.children->lr;
-    }
+    children = c;
 
     // return
     return * this;
 }
 
+void RasterMask::Node::own()
+{
+    if ((type != GRAY) || (children->refs == 1)) { return; }
+
+    // shared block -> copy it (shares grandchildren) and drop our reference
+    auto *c(pool->malloc());
+    c->ul = children->ul;
+    c->ur = children->ur;
+    c->ll = children->ll;
+    c->lr = children->lr;
+
+    pool->free(children);
+    children = c;
+}
+
 void RasterMask::Node::dump( std::ostream & f ) const
 {
     std::uint8_t c = type;
@@ -454,7 +726,7 @@ void RasterMask::Node::load( std::istream & f )
     type = static_cast<NodeType>(c);
 
     if ( type == GRAY ) {
-        children = mask.malloc();
+        children = pool->malloc();
 
         children->ul.load( f );
         children->ur.load( f );
@@ -463,35 +735,95 @@ void RasterMask::Node::load( std::istream & f )
     }
 }
 
+void RasterMask::Node::load(const std::uint8_t *&data
+                            , const std::uint8_t *end, unsigned int depth)
+{
+    if (data == end) {
+        LOGTHROW(err2, std::runtime_error) << "RasterMask data truncated.";
+    }
+
+    const auto value(*data++);
+    if (value > GRAY) {
+        LOGTHROW(err2, std::runtime_error)
+            << "Invalid RasterMask node type " << int(value) << ".";
+    }
+
+    // corrupted data would otherwise recurse without limit
+    if ((value == GRAY) && !depth) {
+        LOGTHROW(err2, std::runtime_error)
+            << "RasterMask data deeper than mask size allows.";
+    }
+
+    type = static_cast<NodeType>(value);
+    if (type != GRAY) { return; }
+
+    children = pool->malloc();
+
+    children->ul.load(data, end, depth - 1);
+    children->ur.load(data, end, depth - 1);
+    children->ll.load(data, end, depth - 1);
+    children->lr.load(data, end, depth - 1);
+}
+
 imgproc::bitfield::RasterMask RasterMask::asBitfield() const
 {
     LOG(info1) << "Converting raster mask from quad-tree based representation";
     imgproc::bitfield::RasterMask m
         (sizeX_, sizeY_, imgproc::bitfield::RasterMask::EMPTY);
-    root_.dump(m, 0, 0, quadSize_);
+    root_.dump(*this, m, 0, 0, quadSize_, 0, sizeY_);
+    m.recount();
     LOG(info1) << "RasterMask: " << m.size() << " vs " << count_;
 
     return m;
 }
 
-void RasterMask::Node::dump(imgproc::bitfield::RasterMask &m
-                              , unsigned int x, unsigned int y, unsigned int size)
+imgproc::bitfield::RasterMask RasterMask::asBitfield(const Parallel&) const
+{
+    LOG(info1) << "Converting raster mask from quad-tree based representation";
+    imgproc::bitfield::RasterMask m
+        (sizeX_, sizeY_, imgproc::bitfield::RasterMask::EMPTY);
+
+    // bitfield rows are not word aligned: band must start at row whose
+    // first pixel starts a new 64-bit word so no word is shared by two bands
+    unsigned int align(64);
+    for (auto w(sizeX_); !(w & 1) && (align > 1); w >>= 1) { align >>= 1; }
+    const int bandHeight(align * ((BitfieldBandHeight + align - 1) / align));
+    const int bands((sizeY_ + bandHeight - 1) / bandHeight);
+
+    UTILITY_OMP(parallel for schedule(dynamic))
+    for (int band = 0; band < bands; ++band) {
+        const unsigned int y0(band * bandHeight);
+        root_.dump(*this, m, 0, 0, quadSize_, y0
+                   , std::min(y0 + bandHeight, sizeY_));
+    }
+
+    m.recount();
+    LOG(info1) << "RasterMask: " << m.size() << " vs " << count_;
+
+    return m;
+}
+
+void RasterMask::Node::dump(const RasterMask &mask
+                            , imgproc::bitfield::RasterMask &m
+                            , unsigned int x, unsigned int y
+                            , unsigned int size
+                            , unsigned int y0, unsigned int y1)
     const
 {
+    // outside of band or mask
+    if ((y >= y1) || ((y + size) <= y0) || (x >= mask.sizeX_)) { return; }
+
     unsigned int split = size / 2;
 
     switch ( type ) {
     case WHITE: {
-        // fill in quad
-        unsigned int ex(x + size);
-        unsigned int ey(y + size);
-        if (ex > mask.sizeX_) { ex = mask.sizeX_; };
-        if (ey > mask.sizeY_) { ey = mask.sizeY_; };
-
-        for (unsigned int j(y); j < ey; ++j) {
-            for (unsigned int i(x); i < ex; ++i) {
-                m.set(i, j);
-            }
+        // fill in quad, row by row
+        const auto width(std::min(x + size, mask.sizeX_) - x);
+        const auto ey(std::min(y + size, y1));
+        std::size_t offset(std::size_t(mask.sizeX_) * std::max(y, y0) + x);
+        for (unsigned int j(std::max(y, y0)); j < ey; ++j) {
+            m.fillBits(offset, width, true);
+            offset += mask.sizeX_;
         }
         return;
     }
@@ -500,14 +832,165 @@ void RasterMask::Node::dump(imgproc::bitfield::RasterMask &m
         return;
 
     case GRAY :
-        children->ul.dump( m, x, y, split );
-        children->ll.dump( m, x, y + split, split );
-        children->ur.dump( m, x + split, y, split );
-        children->lr.dump( m, x + split, y + split, split );
+        children->ul.dump( mask, m, x, y, split, y0, y1 );
+        children->ur.dump( mask, m, x + split, y, split, y0, y1 );
+        children->ll.dump( mask, m, x, y + split, split, y0, y1 );
+        children->lr.dump( mask, m, x + split, y + split, split, y0, y1 );
         break;
     }
 }
 
+RasterMask::RasterMask(const bitfield::RasterMask &mask)
+    : RasterMask(mask, Parallel(0))
+{}
+
+RasterMask::RasterMask(const bitfield::RasterMask &mask
+                       , const Parallel &parallel)
+    : sizeX_(mask.dims().width), sizeY_(mask.dims().height)
+    , depth_(computeDepth(sizeX_, sizeY_))
+    , quadSize_(1 << depth_)
+    , count_(0)
+    , pool_(std::make_shared<NodePool>())
+    , root_(pool_.get())
+{
+    LOG(info1) << "Converting raster mask from bitfield representation";
+
+    if (parallel.grainDepth) {
+        runParallel([&]() {
+                root_.build(*this, mask, 0, 0, quadSize_, parallel.grainDepth);
+            });
+    } else {
+        root_.build(*this, mask, 0, 0, quadSize_, 0);
+    }
+    recount();
+}
+
+bool RasterMask::Node::build(const RasterMask &mask
+                             , const imgproc::bitfield::RasterMask &m
+                             , unsigned int x, unsigned int y
+                             , unsigned int size, unsigned int grain)
+{
+    type = BLACK;
+
+    if ((x >= mask.sizeX_) || (y >= mask.sizeY_)) {
+        // completely outside of mask
+        return false;
+    }
+
+    if (size <= BitfieldBlockSize) {
+        // classify block (clipped to mask) by counting its row spans
+        const auto width(std::min(x + size, mask.sizeX_) - x);
+        const auto ey(std::min(y + size, mask.sizeY_));
+        std::size_t offset(std::size_t(mask.sizeX_) * y + x);
+        const auto first(m.countBits(offset, width));
+
+        bool uniform(!first || (first == width));
+        for (auto j(y + 1); uniform && (j < ey); ++j) {
+            offset += mask.sizeX_;
+            uniform = (m.countBits(offset, width) == first);
+        }
+
+        if (uniform) {
+            if (first) { type = WHITE; }
+            return true;
+        }
+    }
+
+    // build children in Morton order; block is allocated by settle() only
+    // if node is mixed
+    const unsigned int split(size >> 1);
+    Node c[4] = { { pool }, { pool }, { pool }, { pool } };
+    const auto *mk(&mask);
+    const auto *bf(&m);
+    bool inside[4];
+
+    if (grain) {
+        --grain;
+        UTILITY_OMP(task shared(inside, c))
+        inside[0] = c[0].build(*mk, *bf, x, y, split, grain);
+        UTILITY_OMP(task shared(inside, c))
+        inside[1] = c[1].build(*mk, *bf, x + split, y, split, grain);
+        UTILITY_OMP(task shared(inside, c))
+        inside[2] = c[2].build(*mk, *bf, x, y + split, split, grain);
+        UTILITY_OMP(task shared(inside, c))
+        inside[3] = c[3].build(*mk, *bf, x + split, y + split, split
+                               , grain);
+        UTILITY_OMP(taskwait)
+    } else {
+        inside[0] = c[0].build(mask, m, x, y, split, 0);
+        inside[1] = c[1].build(mask, m, x + split, y, split, 0);
+        inside[2] = c[2].build(mask, m, x, y + split, split, 0);
+        inside[3] = c[3].build(mask, m, x + split, y + split, split, 0);
+    }
+
+    settle(c, inside);
+    return true;
+}
+
+void RasterMask::Node::settle(NodeChildren *c, const bool (&inside)[4])
+{
+    const NodeType types[4] = {
+        c->ul.type, c->ur.type, c->ll.type, c->lr.type
+    };
+
+    // find whether all children inside mask have the same color; children
+    // outside the mask can have any color
+    NodeType uniform(GRAY);
+    for (int i(0); i < 4; ++i) {
+        if (!inside[i]) { continue; }
+
+        if ((types[i] == GRAY)
+            || ((uniform != GRAY) && (uniform != types[i])))
+        {
+            // mixed node -> keep children
+            children = c;
+            type = GRAY;
+            return;
+        }
+        uniform = types[i];
+    }
+
+    // uniform node
+    pool->free(c);
+    type = uniform;
+}
+
+void RasterMask::Node::settle(Node (&c)[4], const bool (&inside)[4])
+{
+    // find whether all children inside mask have the same color; children
+    // outside the mask can have any color
+    NodeType uniform(GRAY);
+    bool mixed(false);
+    for (int i(0); i < 4; ++i) {
+        if (!inside[i]) { continue; }
+
+        if ((c[i].type == GRAY)
+            || ((uniform != GRAY) && (uniform != c[i].type)))
+        {
+            mixed = true;
+            break;
+        }
+        uniform = c[i].type;
+    }
+
+    if (!mixed) {
+        // uniform node, children have no subtrees
+        type = uniform;
+        return;
+    }
+
+    // mixed node -> move children into new block
+    children = pool->malloc();
+    Node *dst[4] = {
+        &children->ul, &children->ur, &children->ll, &children->lr
+    };
+    for (int i(0); i < 4; ++i) {
+        dst[i]->type = c[i].type;
+        std::swap(dst[i]->children, c[i].children);
+    }
+    type = GRAY;
+}
+
 void RasterMask::Node::invert()
 {
     switch (type) {
@@ -520,6 +1003,7 @@ void RasterMask::Node::invert()
         return;
 
     case GRAY :
+        own();
         children->ul.invert();
         children->ll.invert();
         children->ur.invert();
@@ -549,7 +1033,13 @@ void RasterMask::Node::merge(const Node &other)
         return;
     }
 
+    if (children == other.children) {
+        // merge(X, X) = X (shared subtree)
+        return;
+    }
+
     // merge(GRAY, GRAY) = go down
+    own();
     children->ul.merge(other.children->ul);
     children->ll.merge(other.children->ll);
     children->ur.merge(other.children->ur);
@@ -583,7 +1073,7 @@ void RasterMask::Node::intersect(const Node &other)
         // this is a gray node
         if (other.type == NodeType::BLACK) {
             // intersect(GRAY, BLACK) = BLACK
-            mask.free(children);
+            pool->free(children);
             type = NodeType::BLACK;
             return;
         } else if (other.type == NodeType::WHITE) {
@@ -594,7 +1084,13 @@ void RasterMask::Node::intersect(const Node &other)
 
     // intersect(GRAY, GRAY);
 
+    if (children == other.children) {
+        // intersect(X, X) = X (shared subtree)
+        return;
+    }
+
     // go down
+    own();
     children->ul.intersect(other.children->ul);
     children->ll.intersect(other.children->ll);
     children->ur.intersect(other.children->ur);
@@ -630,7 +1126,7 @@ void RasterMask::Node::subtract(const Node &other)
         // this is gray
         if (other.type == NodeType::WHITE) {
             // subtract(GRAY, WHITE) = BLACK
-            mask.free(children);
+            pool->free(children);
             type = NodeType::BLACK;
             return;
         }
@@ -638,7 +1134,15 @@ void RasterMask::Node::subtract(const Node &other)
 
     // subtract(GRAY, GRAY);
 
+    if (children == other.children) {
+        // subtract(X, X) = BLACK (shared subtree)
+        pool->free(children);
+        type = NodeType::BLACK;
+        return;
+    }
+
     // go down
+    own();
     children->ul.subtract(other.children->ul);
     children->ll.subtract(other.children->ll);
     children->ur.subtract(other.children->ur);
@@ -648,6 +1152,118 @@ void RasterMask::Node::subtract(const Node &other)
     contract();
 }
 
+void RasterMask::Node::invert(unsigned int grain)
+{
+    if (!grain || (type != GRAY)) {
+        invert();
+        return;
+    }
+
+    own();
+    auto *c(children);
+    --grain;
+
+    UTILITY_OMP(task)
+    c->ul.invert(grain);
+    UTILITY_OMP(task)
+    c->ll.invert(grain);
+    UTILITY_OMP(task)
+    c->ur.invert(grain);
+    UTILITY_OMP(task)
+    c->lr.invert(grain);
+    UTILITY_OMP(taskwait)
+}
+
+void RasterMask::Node::merge(const Node &other, unsigned int grain)
+{
+    if (!grain || (type != GRAY) || (other.type != GRAY)
+        || (children == other.children))
+    {
+        // not parallelizable here
+        merge(other);
+        return;
+    }
+
+    // merge(GRAY, GRAY) = go down in parallel
+    own();
+    auto *c(children);
+    const auto *o(other.children);
+    --grain;
+
+    UTILITY_OMP(task)
+    c->ul.merge(o->ul, grain);
+    UTILITY_OMP(task)
+    c->ll.merge(o->ll, grain);
+    UTILITY_OMP(task)
+    c->ur.merge(o->ur, grain);
+    UTILITY_OMP(task)
+    c->lr.merge(o->lr, grain);
+    UTILITY_OMP(taskwait)
+
+    // contract if possible
+    contract();
+}
+
+void RasterMask::Node::intersect(const Node &other, unsigned int grain)
+{
+    if (!grain || (type != GRAY) || (other.type != GRAY)
+        || (children == other.children))
+    {
+        // not parallelizable here
+        intersect(other);
+        return;
+    }
+
+    // intersect(GRAY, GRAY) = go down in parallel
+    own();
+    auto *c(children);
+    const auto *o(other.children);
+    --grain;
+
+    UTILITY_OMP(task)
+    c->ul.intersect(o->ul, grain);
+    UTILITY_OMP(task)
+    c->ll.intersect(o->ll, grain);
+    UTILITY_OMP(task)
+    c->ur.intersect(o->ur, grain);
+    UTILITY_OMP(task)
+    c->lr.intersect(o->lr, grain);
+    UTILITY_OMP(taskwait)
+
+    // contract if possible
+    contract();
+}
+
+void RasterMask::Node::subtract(const Node &other, unsigned int grain)
+{
+    if (!grain || (type != GRAY) || (other.type != GRAY)
+        || (children == other.children))
+    {
+        // not parallelizable here
+        subtract(other);
+        return;
+    }
+
+    // subtract(GRAY, GRAY) = go down in parallel
+    own();
+    auto *c(children);
+    const auto *o(other.children);
+    --grain;
+
+    UTILITY_OMP(task)
+    c->ul.subtract(o->ul, grain);
+    UTILITY_OMP(task)
+    c->ll.subtract(o->ll, grain);
+    UTILITY_OMP(task)
+    c->ur.subtract(o->ur, grain);
+    UTILITY_OMP(task)
+    c->lr.subtract(o->lr, grain);
+    UTILITY_OMP(taskwait)
+
+    // contract if possible
+    contract();
+}
+
 void RasterMask::Node::coarsen(unsigned int size, const unsigned int threshold)
 {
     if (type != NodeType::GRAY) {
@@ -658,7 +1274,7 @@ void RasterMask::Node::coarsen(unsigned int size, const unsigned int threshold)
     // gray node
     if (size == threshold) {
         // this is the right spot to cut
-        mask.free(children);
+        pool->free(children);
         type = WHITE;
         return;
     }
@@ -666,20 +1282,152 @@ void RasterMask::Node::coarsen(unsigned int size, const unsigned int threshold)
     // need to descend one level down
     size >>= 1;
 
+    own();
     children->ul.coarsen(size, threshold);
     children->ll.coarsen(size, threshold);
     children->ur.coarsen(size, threshold);
     children->lr.coarsen(size, threshold);
 }
 
+bool RasterMask::Coverage::operator()(unsigned long long white
+                                      , unsigned long long total) const
+{
+    switch (rule) {
+    case any: return white;
+    case all: return (white == total);
+    case threshold: break;
+    }
+    return (white >= ratio * total);
+}
+
+namespace {
+
+/** Pyramid level sinks. fill(level, x, y, shift) makes footprint of source
+ *  quad (x, y, 1 << shift) white at given level.
+ */
+struct QuadtreeLevels {
+    std::vector<RasterMask> &levels;
+
+    void fill(unsigned int level, unsigned int x, unsigned int y
+              , unsigned int shift)
+    {
+        auto &l(levels[level]);
+        l.setQuad(l.depth() - (shift - level), x >> shift, y >> shift);
+    }
+};
+
+struct BitfieldLevels {
+    std::vector<bitfield::RasterMask> &levels;
+
+    void fill(unsigned int level, unsigned int x, unsigned int y
+              , unsigned int shift)
+    {
+        auto &l(levels[level]);
+        const auto &dims(l.dims());
+        const unsigned int size(1u << shift);
+
+        const int x0(x >> level);
+        const int x1(std::min((x + size) >> level, unsigned(dims.width)));
+        const int y0(y >> level);
+        const int y1(std::min((y + size) >> level, unsigned(dims.height)));
+        for (int j(y0); j < y1; ++j) { l.setSpan(x0, j, x1 - x0); }
+    }
+};
+
+inline math::Size2 levelSize(unsigned int sizeX, unsigned int sizeY
+                             , unsigned int level)
+{
+    const auto add((1ull << level) - 1);
+    return math::Size2((sizeX + add) >> level, (sizeY + add) >> level);
+}
+
+} // namespace
+
+std::vector<RasterMask> RasterMask::pyramid(const Coverage &coverage) const
+{
+    std::vector<RasterMask> levels;
+    levels.reserve(depth_ + 1);
+    for (unsigned int level(0); level <= depth_; ++level) {
+        levels.emplace_back(levelSize(sizeX_, sizeY_, level), EMPTY);
+    }
+
+    QuadtreeLevels sink{levels};
+    root_.pyramid(*this, 0, 0, depth_, coverage, sink);
+
+    // setQuad accounts whole quads, get exact numbers
+    for (auto &l : levels) { l.recount(); }
+    return levels;
+}
+
+std::vector<bitfield::RasterMask>
+RasterMask::bitfieldPyramid(const Coverage &coverage) const
+{
+    std::vector<bitfield::RasterMask> levels;
+    levels.reserve(depth_ + 1);
+    for (unsigned int level(0); level <= depth_; ++level) {
+        levels.emplace_back(levelSize(sizeX_, sizeY_, level)
+                            , bitfield::RasterMask::EMPTY);
+    }
+
+    BitfieldLevels sink{levels};
+    root_.pyramid(*this, 0, 0, depth_, coverage, sink);
+    return levels;
+}
+
+template <typename Sink>
+unsigned long long RasterMask::Node::pyramid(const RasterMask &mask
+                                             , unsigned int x, unsigned int y
+                                             , unsigned int shift
+                                             , const Coverage &coverage
+                                             , Sink &sink) const
+{
+    if ((x >= mask.sizeX_) || (y >= mask.sizeY_)) {
+        // completely outside of mask
+        return 0;
+    }
+
+    const unsigned int size(1u << shift);
+    const unsigned long long total
+        ((unsigned long long)(std::min(x + size, mask.sizeX_) - x)
+         * (std::min(y + size, mask.sizeY_) - y));
+
+    if (type != GRAY) {
+        // uniform quad: the same coverage in all levels up to this one
+        const unsigned long long white((type == WHITE) ? total : 0);
+        if (coverage(white, total)) {
+            for (unsigned int level(0); level <= shift; ++level) {
+                sink.fill(level, x, y, shift);
+            }
+        }
+        return white;
+    }
+
+    --shift;
+    const unsigned int split(size >> 1);
+    const auto white(children->ul.pyramid(mask, x, y, shift, coverage, sink)
+                     + children->ur.pyramid(mask, x + split, y, shift
+                                            , coverage, sink)
+                     + children->ll.pyramid(mask, x, y + split, shift
+                                            , coverage, sink)
+                     + children->lr.pyramid(mask, x + split, y + split, shift
+                                            , coverage, sink));
+
+    if (coverage(white, total)) {
+        sink.fill(shift + 1, x, y, shift + 1);
+    }
+    return white;
+}
+
 RasterMask::RasterMask(const RasterMask &other, const math::Size2 &size
                        , unsigned int depth, unsigned int x, unsigned int y)
     : sizeX_(size.width), sizeY_(size.height)
     , depth_(computeDepth(sizeX_, sizeY_))
     , quadSize_(1 << depth_)
-    , root_(*this)
+    , pool_(other.pool_)
+    , root_(pool_.get())
 {
-    // clone
+    // share subtree
+    pool_->attach();
     root_ = other.root_.find(depth, x, y);
     recount();
 }
@@ -736,10 +1484,11 @@ void RasterMask::setQuad(int depth, int x, int y, bool value)
         return;
     }
 
-    root_.setQuad(depth, x, y, value, quadSize_);
+    root_.setQuad(*this, depth, x, y, value, quadSize_);
 }
 
-void RasterMask::Node::setQuad(unsigned int depth, unsigned int x, unsigned int y, bool value
+void RasterMask::Node::setQuad(RasterMask &mask, unsigned int depth
+                               , unsigned int x, unsigned int y, bool value
                                , unsigned int size)
 {
     unsigned int split = size >> 1;
@@ -748,10 +1497,19 @@ void RasterMask::Node::setQuad(unsigned int depth, unsigned int x, unsigned int
     if (depth && ((type == BLACK && value)
                   || (type == WHITE && !value)))
     {
-        children = mask.malloc(type);
+        children = pool->malloc(type);
         type = GRAY;
     }
 
+    if (!depth && (type == GRAY)) {
+        // whole gray subtree is replaced -> make it black
+        mask.count_ -= whiteArea(size);
+        pool->free(children);
+        type = BLACK;
+    }
+
+    own();
+
     // process
     if (type == BLACK) {
         if (value) { type = WHITE;
@@ -762,16 +1520,18 @@ void RasterMask::Node::setQuad(unsigned int depth, unsigned int x, unsigned int
     } else if (type == GRAY) {
         if (x < split) {
             if (y < split) {
-                children->ul.setQuad(depth - 1, x, y, value, split);
+                children->ul.setQuad(mask, depth - 1, x, y, value, split);
             } else {
-                children->ll.setQuad(depth - 1, x, y - split, value, split);
+                children->ll.setQuad(mask, depth - 1, x, y - split, value
+                                     , split);
             }
         } else {
             if ( y < split ) {
-                children->ur.setQuad(depth - 1, x - split, y, value, split);
-            } else {
-                children->lr.setQuad(depth - 1, x - split, y - split, value
+                children->ur.setQuad(mask, depth - 1, x - split, y, value
                                      , split);
+            } else {
+                children->lr.setQuad(mask, depth - 1, x - split, y - split
+                                     , value, split);
             }
         }
     }
@@ -780,6 +1540,19 @@ void RasterMask::Node::setQuad(unsigned int depth, unsigned int x, unsigned int
     contract();
 }
 
+unsigned long long RasterMask::Node::whiteArea(unsigned int size) const
+{
+    switch (type) {
+    case WHITE: return (long long)(size) * (long long)(size);
+    case BLACK: return 0;
+    case GRAY: break;
+    }
+
+    size >>= 1;
+    return (children->ul.whiteArea(size) + children->ur.whiteArea(size)
+            + children->ll.whiteArea(size) + children->lr.whiteArea(size));
+}
+
 void RasterMask::setSubtree(int depth, int x, int y, const RasterMask &mask)
 {
     if (depth > int(depth_)) {
@@ -803,17 +1576,18 @@ void RasterMask::setSubtree(int depth, int x, int y, const RasterMask &mask)
         return;
     }
 
-    root_.setSubtree(depth, x, y, mask, quadSize_);
+    root_.setSubtree(*this, depth, x, y, mask, quadSize_);
 }
 
-void RasterMask::Node::setSubtree(unsigned int depth, unsigned int x, unsigned int y
+void RasterMask::Node::setSubtree(RasterMask &mask, unsigned int depth
+                                  , unsigned int x, unsigned int y
                                   , const RasterMask &other, unsigned int size)
 {
     unsigned int split = size >> 1;
 
     // split node if necessarry
     if (depth && (type != GRAY)) {
-        children = mask.malloc(type);
+        children = pool->malloc(type);
         type = GRAY;
     }
 
@@ -828,18 +1602,21 @@ void RasterMask::Node::setSubtree(unsigned int depth, unsigned int x, unsigned i
         // update mask count
         mask.count_ += other.count_ + update;
     } else if (type == GRAY) {
+        own();
         if (x < split) {
             if (y < split) {
-                children->ul.setSubtree(depth - 1, x, y, other, split);
+                children->ul.setSubtree(mask, depth - 1, x, y, other, split);
             } else {
-                children->ll.setSubtree(depth - 1, x, y - split, other, split);
+                children->ll.setSubtree(mask, depth - 1, x, y - split, other
+                                        , split);
             }
         } else {
             if (y < split) {
-                children->ur.setSubtree(depth - 1, x - split, y, other, split);
-            } else {
-                children->lr.setSubtree(depth - 1, x - split, y - split, other
+                children->ur.setSubtree(mask, depth - 1, x - split, y, other
                                         , split);
+            } else {
+                children->lr.setSubtree(mask, depth - 1, x - split, y - split
+                                        , other, split);
             }
         }
     }
@@ -903,6 +1680,132 @@ RasterMask::Node::findSubtree(unsigned int depth, unsigned int x, unsigned int y
     }
 }
 
+void RasterMask::grow(unsigned int radius, bool value)
+{
+    if (!radius) { return; }
+
+    struct Rect { unsigned int x0, y0, x1, y1; };
+
+    // collect quads that touch other color (i.e. contain boundary pixels),
+    // anything inside the rest is already covered by them
+    std::vector<Rect> grown;
+    forEachQuad([&](unsigned int x, unsigned int y, unsigned int xsize
+                    , unsigned int ysize, bool)
+    {
+        const Rect q{ x, y, x + xsize, y + ysize };
+        const Rect n{ q.x0 ? q.x0 - 1 : 0, q.y0 ? q.y0 - 1 : 0
+                , std::min(q.x1 + 1, sizeX_), std::min(q.y1 + 1, sizeY_) };
+
+        // check 1 pixel wide ring around quad
+        if (!root_.any(n.x0, n.y0, n.x1, q.y0, !value, 0, 0, quadSize_)
+            && !root_.any(n.x0, q.y1, n.x1, n.y1, !value, 0, 0, quadSize_)
+            && !root_.any(n.x0, q.y0, q.x0, q.y1, !value, 0, 0, quadSize_)
+            && !root_.any(q.x1, q.y0, n.x1, q.y1, !value, 0, 0, quadSize_))
+        {
+            return;
+        }
+
+        grown.push_back
+            ({ (q.x0 > radius) ? q.x0 - radius : 0
+              , (q.y0 > radius) ? q.y0 - radius : 0
+              , unsigned(std::min<unsigned long>
+                         (q.x1 + (unsigned long)(radius), sizeX_))
+              , unsigned(std::min<unsigned long>
+                         (q.y1 + (unsigned long)(radius), sizeY_)) });
+    }, value ? Filter::white : Filter::black);
+
+    for (const auto &r : grown) {
+        root_.setRect(*this, r.x0, r.y0, r.x1, r.y1, value, 0, 0, quadSize_);
+    }
+
+    recount();
+}
+
+bool RasterMask::Node::any(unsigned int x0, unsigned int y0, unsigned int x1
+                           , unsigned int y1, bool value, unsigned int x
+                           , unsigned int y, unsigned int size) const
+{
+    if ((x >= x1) || (y >= y1) || ((x + size) <= x0) || ((y + size) <= y0)) {
+        // disjoint
+        return false;
+    }
+
+    switch (type) {
+    case WHITE: return value;
+    case BLACK: return !value;
+    case GRAY: break;
+    }
+
+    size >>= 1;
+    return (children->ul.any(x0, y0, x1, y1, value, x, y, size)
+            || children->ur.any(x0, y0, x1, y1, value, x + size, y, size)
+            || children->ll.any(x0, y0, x1, y1, value, x, y + size, size)
+            || children->lr.any(x0, y0, x1, y1, value, x + size, y + size
+                                , size));
+}
+
+void RasterMask::Node::setRect(const RasterMask &mask
+                               , unsigned int x0, unsigned int y0
+                               , unsigned int x1, unsigned int y1, bool value
+                               , unsigned int x, unsigned int y
+                               , unsigned int size)
+{
+    if ((x >= x1) || (y >= y1) || ((x + size) <= x0) || ((y + size) <= y0)) {
+        // disjoint
+        return;
+    }
+
+    const NodeType target(value ? WHITE : BLACK);
+    if (type == target) { return; }
+
+    // node is covered when its part inside mask lies in the rectangle
+    if ((x >= x0) && (y >= y0)
+        && (std::min(x + size, mask.sizeX_) <= x1)
+        && (std::min(y + size, mask.sizeY_) <= y1))
+    {
+        pool->free(children);
+        type = target;
+        return;
+    }
+
+    // split node if necessarry
+    own();
+    auto *c((type == GRAY) ? children : pool->malloc(type));
+    children = nullptr;
+
+    size >>= 1;
+    const bool right((x + size) < mask.sizeX_);
+    const bool bottom((y + size) < mask.sizeY_);
+    const bool inside[4] = { true, right, bottom, right && bottom };
+
+    // children outside of mask are kept black
+    auto outside([this](Node &node)
+    {
+        pool->free(node.children);
+        node.type = BLACK;
+    });
+    if (!inside[1]) { outside(c->ur); }
+    if (!inside[2]) { outside(c->ll); }
+    if (!inside[3]) { outside(c->lr); }
+
+    c->ul.setRect(mask, x0, y0, x1, y1, value, x, y, size);
+    c->ur.setRect(mask, x0, y0, x1, y1, value, x + size, y, size);
+    c->ll.setRect(mask, x0, y0, x1, y1, value, x, y + size, size);
+    c->lr.setRect(mask, x0, y0, x1, y1, value, x + size, y + size, size);
+
+    settle(c, inside);
+}
+
+void dilate(RasterMask &mask, unsigned int radius)
+{
+    mask.grow(radius, true);
+}
+
+void erode(RasterMask &mask, unsigned int radius)
+{
+    mask.grow(radius, false);
+}
+
 void resizeMask(const RasterMask &src, RasterMask &dst)
 {
     int dstHeight { dst.dims().height };
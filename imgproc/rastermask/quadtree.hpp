@@ -34,12 +34,17 @@
 #define imgproc_rastermask_quadtree_hpp_included_
 
 #include <memory>
+#include <vector>
+#include <mutex>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <algorithm>
 #include <iosfwd>
+#include <type_traits>
 
 #include <boost/scoped_array.hpp>
+#include <boost/filesystem/path.hpp>
 
 #include "math/geometry_core.hpp"
 
@@ -49,10 +54,32 @@
 
 namespace imgproc { namespace mappedqtree {
 class RasterMask;
+namespace detail { struct Combiner; }
 } } // imgproc::mappedqtree
 
+namespace imgproc { namespace linearqtree {
+class RasterMask;
+} } // imgproc::linearqtree
+
+namespace imgproc { namespace frozenqtree {
+class RasterMask;
+} } // imgproc::frozenqtree
+
 namespace imgproc { namespace quadtree {
 
+class PolygonFiller;
+
+/** Quad-tree raster mask.
+ *
+ *  Thread safety: const member functions do not modify the tree, i.e. any
+ *  number of threads can read a mask unless it is modified at the same time.
+ *  Copying a mask (and subTree()) updates reference counts of shared nodes
+ *  and the node pool's user count on the const source; these counters are
+ *  atomic, therefore copies can be made concurrently as well. Copies can be
+ *  modified concurrently since shared nodes are never modified in place. Use
+ *  frozenqtree::RasterMask when a mask that cannot be modified by design
+ *  (and faster get()) is needed.
+ */
 class RasterMask {
 public :
     enum InitMode {
@@ -61,7 +88,10 @@ public :
         SOURCE = 2
     };
 
-    RasterMask() : sizeX_(0), sizeY_(0), count_(0), root_(*this) {}
+    RasterMask()
+        : sizeX_(0), sizeY_(0), count_(0)
+        , pool_(std::make_shared<NodePool>()), root_(pool_.get())
+    {}
 
     /** initialize mask */
     RasterMask( unsigned int sizeX, unsigned int sizeY, const InitMode mode );
@@ -69,10 +99,15 @@ public :
     /** intialize mask */
     RasterMask( const math::Size2 & size, const InitMode mode );
 
-    /** initialize a mask of the same order, optionally copying mask. */
+    /** initialize a mask of the same order, optionally copying mask.
+     *
+     *  Copy is O(1): both masks share the same (immutable) tree until one of
+     *  them is modified; only the path to the modified node is copied then.
+     */
     RasterMask( const RasterMask & mask, const InitMode mode = SOURCE );
 
     /** Initialize mask from other mask's subtree at given coordinates.
+     *  Subtree is shared with other mask, i.e. this is O(depth).
      */
     RasterMask(const RasterMask &other, const math::Size2 &size
                , unsigned int depth, unsigned int x, unsigned int y);
@@ -80,18 +115,50 @@ public :
     /** return size of mask */
     math::Size2 size() const { return math::Size2(sizeX_, sizeY_); }
 
-    /** assignment operator */
+    /** assignment operator; shares tree with source, see copy constructor */
     RasterMask & operator = ( const RasterMask & );
 
-    /** destroy */
-    ~RasterMask() {}
+    /** destroy; all nodes are released at once with the node pool unless
+     *  the pool is shared with another mask
+     */
+    ~RasterMask();
+
+    /** Parallel execution settings for set operations.
+     *
+     *  Children of gray nodes are processed in separate (OpenMP) tasks down
+     *  to grainDepth levels below root; deeper subtrees are processed by
+     *  serial code. Parallel operations give the same result as the serial
+     *  ones.
+     */
+    struct Parallel {
+        unsigned int grainDepth;
+
+        explicit Parallel(unsigned int grainDepth = 4)
+            : grainDepth(grainDepth)
+        {}
+    };
+
+    /** Initialize mask from bitfield mask. Uniform blocks are detected from
+     *  whole bitfield words, pixels are never visited one by one.
+     */
+    explicit RasterMask(const bitfield::RasterMask &mask);
+
+    /** Initialize mask from bitfield mask, parallel version.
+     */
+    RasterMask(const bitfield::RasterMask &mask, const Parallel &parallel);
 
     /** invert a mask (negate pixels) */
     void invert();
 
+    /** invert a mask (negate pixels), parallel version */
+    void invert(const Parallel &parallel);
+
     /** do a set difference with two masks. */
     void subtract(const RasterMask &op);
 
+    /** do a set difference with two masks, parallel version. */
+    void subtract(const RasterMask &op, const Parallel &parallel);
+
     /** obtain mask value at given pos, return false if x, y out of bounds */
     bool get( int x, int y ) const;
 
@@ -111,6 +178,8 @@ public :
     void setQuad(int depth, int x, int y, bool value = true);
 
     /** Set subtree from other mask. Subtree is clipped at maximum mask depth.
+     *  Source tree is shared (not copied) when both masks share node pool,
+     *  i.e. when one is a copy or subtree of the other.
      *
      *  \param depth depth in tree, root starts at 0
      *  \param x horizontal index in quads at given depth
@@ -122,10 +191,36 @@ public :
     /** Resets whole mask to given value. */
     void reset(bool value = true);
 
+    /** Builds whole mask bottom-up from per-pixel samples.
+     *
+     *  sample(x, y) -> bool is called exactly once for each pixel inside the
+     *  mask, pixels are visited in Morton (tile) order. Uniform quads are
+     *  created directly, i.e. no node is split and contracted again.
+     *  Previous content is discarded.
+     */
+    template <typename Sample>
+    void build(const Sample &sample);
+
     /** test if a given pixel is a boundary pixel (neighboring unset
         pixel in mask */
     bool onBoundary( int x, int y ) const;
 
+    /** Runs op(x, y) for each boundary pixel (see onBoundary), in no
+     *  particular order.
+     *
+     *  Only white quads are visited: black runs along each side of a quad
+     *  are found by descent to the neighbouring quads, i.e. cost is
+     *  proportional to the number of leaves (boundary length * depth) and
+     *  not to mask area.
+     */
+    template <typename Op>
+    void forEachBoundary(const Op &op) const;
+
+    /** Returns mask of all boundary pixels (see onBoundary), computed by
+     *  forEachBoundary.
+     */
+    imgproc::bitfield::RasterMask boundary() const;
+
     /** return mask size (number of white pixels) */
     unsigned long long count() const { return count_; }
 
@@ -148,16 +243,28 @@ public :
     /** load mask from stream */
     void load( std::istream & f );
 
-    /** dump mask to bitfield mask */
+    /** Load mask from file (dump written by dump(std::ostream&) placed at
+     *  given offset). File is memory-mapped and tree is built directly from
+     *  the mapped data.
+     */
+    void load(const boost::filesystem::path &path, std::size_t offset = 0);
+
+    /** dump mask to bitfield mask; white quads are filled by whole words */
     imgproc::bitfield::RasterMask asBitfield() const;
 
+    /** dump mask to bitfield mask, parallel version: row bands (aligned to
+     *  bitfield words) are filled in parallel; grain depth is not used.
+     */
+    imgproc::bitfield::RasterMask asBitfield(const Parallel &parallel) const;
+
     math::Size2 dims() const { return math::Size2(sizeX_, sizeY_); }
 
     enum class Filter {
         black, white, both
     };
 
-    /** Runs op(x, y, xsize, ysize, white) for each black/white quad.
+    /** Runs op(x, y, xsize, ysize, white) for each black/white quad. Quads
+     *  are clipped by mask size, quads completely outside are skipped.
      */
     template <typename Op>
     void forEachQuad(const Op &op, Filter filter = Filter::both) const;
@@ -168,6 +275,13 @@ public :
     template <typename Op>
     void forEach(const Op &op, Filter filter = Filter::both)  const;
 
+    /** Runs op(y, x0, x1, white) for each maximal horizontal run [x0, x1) of
+     *  black/white pixels, row by row. Adjacent quads of the same color are
+     *  merged, i.e. op is called once per run and not once per pixel.
+     */
+    template <typename Op>
+    void forEachSpan(const Op &op, Filter filter = Filter::both) const;
+
     /** Runs op(x, y, xsize, ysize, boost::tribool) for each black/white/gray
      *  quad (gray is marked by indeterminate value). Tree descent is terminated
      *  at given tree depth.
@@ -181,20 +295,65 @@ public :
      */
     void merge(const RasterMask &other, bool checkDimensions = true);
 
+    /** Merges other's quadtree in this quadtree, parallel version.
+     */
+    void merge(const RasterMask &other, const Parallel &parallel
+               , bool checkDimensions = true);
+
     /** In place intersects other's quadtree with this quadtree.
      */
     void intersect(const RasterMask &other);
 
+    /** In place intersects other's quadtree with this quadtree, parallel
+     *  version.
+     */
+    void intersect(const RasterMask &other, const Parallel &parallel);
+
     /** Makes mask coarsen. White quads smaller than given threshold grow to
      *  match threshold.
      */
     void coarsen(const unsigned int threshold = 2);
 
+    /** Decides whether pixel of coarser pyramid level is white from white
+     *  pixel count in its source block (only part inside mask is counted).
+     */
+    struct Coverage {
+        enum Rule {
+            any         //!< at least one white pixel
+            , all       //!< all pixels are white
+            , threshold //!< white ratio is at least given ratio
+        };
+
+        Rule rule;
+        double ratio;
+
+        explicit Coverage(Rule rule = any, double ratio = 0.5)
+            : rule(rule), ratio(ratio)
+        {}
+
+        bool operator()(unsigned long long white
+                        , unsigned long long total) const;
+    };
+
+    /** Builds all power-of-two levels of mask in one tree traversal.
+     *
+     *  Level i has size ceil(dims / 2^i), i.e. level 0 is copy of this mask
+     *  and the last level (index depth()) is 1x1. Uniform quads are written
+     *  to all levels at once.
+     */
+    std::vector<RasterMask> pyramid(const Coverage &coverage = Coverage())
+        const;
+
+    /** Same as above, levels are generated as bitfield masks.
+     */
+    std::vector<bitfield::RasterMask>
+    bitfieldPyramid(const Coverage &coverage = Coverage()) const;
+
     /** Returns new raster mask that created from subtreee at given quad.
      *
      * Quad is addressed by depth from root and index in grid at given depth.
      *
-     * Mask is assigned given size.
+     * Mask is assigned given size. Nodes are shared with this mask.
      */
     RasterMask subTree(const math::Size2 &size
                        , unsigned int depth, unsigned int x, unsigned int y) const;
@@ -209,41 +368,116 @@ private :
     enum NodeType { WHITE, BLACK, GRAY };
 
     struct NodeChildren;
+    class NodePool;
 
+    /** Tree node. Children blocks are reference counted and can be shared
+     *  by multiple nodes (even in different masks using the same pool);
+     *  shared block is never modified, it is copied by own() first.
+     *
+     *  Node does not know its mask: functions that need mask size or
+     *  maintain its pixel count get the mask as an argument.
+     */
     struct Node
     {
-        Node(RasterMask &mask)
-            : type(BLACK), mask(mask), children() {};
-        Node(RasterMask &mask, NodeType type)
-            : type(type), mask(mask), children() {};
+        Node(NodePool *pool)
+            : type(BLACK), pool(pool), children() {};
+        Node(NodePool *pool, NodeType type)
+            : type(type), pool(pool), children() {};
+        Node(const Node&) = delete;
 
         bool get( unsigned int x, unsigned int y, unsigned int size ) const;
-        void set( unsigned int x, unsigned int y, bool value, unsigned int size );
-        void setQuad(unsigned int depth, unsigned int x, unsigned int y, bool value, unsigned int size);
-        void setSubtree(unsigned int depth, unsigned int x, unsigned int y, const RasterMask &other
+        void set( RasterMask &mask, unsigned int x, unsigned int y
+                  , bool value, unsigned int size );
+        void setQuad(RasterMask &mask, unsigned int depth, unsigned int x
+                     , unsigned int y, bool value, unsigned int size);
+        void setSubtree(RasterMask &mask, unsigned int depth, unsigned int x
+                        , unsigned int y, const RasterMask &other
                         , unsigned int size);
 
         const Node* findSubtree(unsigned int depth, unsigned int x, unsigned int y, unsigned int size) const;
 
+        /** Shares source's children when both nodes live in the same
+         *  pool, deep copies them otherwise.
+         */
         Node & operator = ( const Node & s );
         ~Node();
 
+        /** Makes children block exclusively owned by this node, i.e.
+         *  replaces shared block with its copy (grandchildren are shared).
+         *  Must be called before any modification of children.
+         */
+        void own();
+
         void dump( std::ostream & f ) const;
         void load( std::istream & f );
 
+        /** Loads node from memory, advances data pointer. Depth is number
+         *  of tree levels below this node, i.e. leaf node is expected at
+         *  depth 0.
+         */
+        void load(const std::uint8_t *&data, const std::uint8_t *end
+                  , unsigned int depth);
+
         void dump2( std::ostream & f ) const;
 
-        void dump( imgproc::bitfield::RasterMask &m, unsigned int x, unsigned int y
-                   , unsigned int size ) const;
+        /** Fills white quads into rows [y0, y1) of bitfield mask.
+         */
+        void dump( const RasterMask &mask, imgproc::bitfield::RasterMask &m
+                   , unsigned int x, unsigned int y
+                   , unsigned int size, unsigned int y0, unsigned int y1 ) const;
+
+        /** Called from RasterMask(bitfield::RasterMask). Returns false if
+         *  node lies completely outside of mask (it is left black then).
+         */
+        bool build(const RasterMask &mask
+                   , const imgproc::bitfield::RasterMask &m, unsigned int x
+                   , unsigned int y, unsigned int size, unsigned int grain);
+
+        /** Finishes building of gray node from its built children:
+         *  adopts them or contracts into a uniform node when all children
+         *  inside the mask have the same color.
+         */
+        void settle(NodeChildren *c, const bool (&inside)[4]);
+
+        /** Same as above for children built in place (ul, ur, ll, lr);
+         *  children block is allocated only for mixed node, children are
+         *  moved into it then.
+         */
+        void settle(Node (&c)[4], const bool (&inside)[4]);
 
         /** Called from RasterMask::forEachQuad */
         template <typename Op>
-        void descend(unsigned int x, unsigned int y, unsigned int size, const Op &op
-                     , Filter filter) const;
+        void descend(const RasterMask &mask, unsigned int x, unsigned int y
+                     , unsigned int size, const Op &op, Filter filter) const;
+
+        /** Called from RasterMask::build. Returns false if node lies
+         *  completely outside of mask (it is left black then).
+         */
+        template <typename Sample>
+        bool build(RasterMask &mask, unsigned int x, unsigned int y
+                   , unsigned int size, const Sample &sample);
+
+        /** Called from RasterMask::forEachSpan. Adds leaves of this subtree
+         *  (at x, ny of given size) crossing row y to span builder.
+         */
+        template <typename Span>
+        void row(const RasterMask &mask, unsigned int y, unsigned int x
+                 , unsigned int ny, unsigned int size, Span &span) const;
+
+        /** Called from RasterMask::forEachBoundary. Runs op(x0, y0, x1, y1)
+         *  for each leaf of given value intersecting rectangle [x0, x1) x
+         *  [y0, y1) (intersection is passed), in Z-order. Rectangle must be
+         *  clipped to mask.
+         */
+        template <typename Op>
+        void runs(unsigned int x0, unsigned int y0, unsigned int x1
+                  , unsigned int y1, bool value, unsigned int x
+                  , unsigned int y, unsigned int size, const Op &op) const;
 
         /** Called from RasterMask::forEachQuad */
         template <typename Op>
-        void descend(unsigned int depth, unsigned int x, unsigned int y, unsigned int size, const Op &op) const;
+        void descend(const RasterMask &mask, unsigned int depth, unsigned int x
+                     , unsigned int y, unsigned int size, const Op &op) const;
 
         /** Inverts node (black -> white, white->black, gray is recursed down).
          */
@@ -255,52 +489,235 @@ private :
 
         void subtract(const Node &other);
 
+        /** Parallel versions of the above. Children are processed in
+         *  separate tasks until grain reaches zero.
+         */
+        void invert(unsigned int grain);
+        void merge(const Node &other, unsigned int grain);
+        void intersect(const Node &other, unsigned int grain);
+        void subtract(const Node &other, unsigned int grain);
+
         void coarsen(unsigned int size, const unsigned int threshold);
 
         /** Contracts node if all children are either white or black.
          */
         void contract();
 
+        /** Number of white pixels in this subtree (not clipped by mask
+         *  size, matches setQuad's accounting).
+         */
+        unsigned long long whiteArea(unsigned int size) const;
+
+        /** Called from RasterMask::pyramid. Writes pyramid levels of this
+         *  subtree (of size 1 << shift) to sink, returns number of white
+         *  pixels inside mask.
+         */
+        template <typename Sink>
+        unsigned long long pyramid(const RasterMask &mask
+                                   , unsigned int x, unsigned int y
+                                   , unsigned int shift
+                                   , const Coverage &coverage
+                                   , Sink &sink) const;
+
         /** Finds quad in given subtree.
          */
         const Node& find(unsigned int depth, unsigned int x, unsigned int y) const;
 
+        /** Returns true if any pixel of rectangle [x0, x1) x [y0, y1) inside
+         *  this subtree has given value. Rectangle must be clipped to mask.
+         */
+        bool any(unsigned int x0, unsigned int y0, unsigned int x1
+                 , unsigned int y1, bool value, unsigned int x, unsigned int y
+                 , unsigned int size) const;
+
+        /** Sets rectangle [x0, x1) x [y0, y1) to given value. Area outside
+         *  of mask is don't care, i.e. nodes are not split along mask
+         *  border (quads completely outside are left black). Pixel count is
+         *  not maintained.
+         */
+        void setRect(const RasterMask &mask
+                     , unsigned int x0, unsigned int y0, unsigned int x1
+                     , unsigned int y1, bool value, unsigned int x
+                     , unsigned int y, unsigned int size);
+
         NodeType type;
-        RasterMask &mask;
+        NodePool *pool;
         NodeChildren *children;
     };
 
     struct NodeChildren {
-        NodeChildren(RasterMask &mask)
-            : ul(mask), ur(mask), ll(mask), lr(mask)
+        NodeChildren(NodePool *pool)
+            : refs(1), ul(pool), ur(pool), ll(pool), lr(pool)
         {}
 
-        NodeChildren(RasterMask &mask, NodeType type)
-            : ul(mask, type), ur(mask, type)
-            , ll(mask, type), lr(mask, type)
+        NodeChildren(NodePool *pool, NodeType type)
+            : refs(1), ul(pool, type), ur(pool, type)
+            , ll(pool, type), lr(pool, type)
         {}
 
+        /** Number of nodes pointing to this block. */
+        std::atomic<unsigned int> refs;
         Node ul, ur, ll, lr;
     };
 
+    /** Slab allocator for node children. Freed blocks are kept in a free list
+     *  and reused, slabs are returned to the system only when whole pool is
+     *  cleared (i.e. when the last mask using the pool is destroyed, reset or
+     *  reloaded).
+     *
+     *  Pool can be shared by multiple masks (copies and subtrees of one mask)
+     *  which then share nodes as well.
+     */
+    class NodePool {
+    public:
+        NodePool()
+            : free_(), used_(), slabSize_(), users_(1), parallel_()
+        {}
+        NodePool(const NodePool&) = delete;
+        NodePool& operator=(const NodePool&) = delete;
+
+        /** Allocates new children block (with black children). */
+        NodeChildren* malloc();
+
+        /** Allocates new children block with children of given type. */
+        NodeChildren* malloc(NodeType type);
+
+        /** Drops one reference to children block; block is destroyed
+         *  (recursively) when it is not referenced anymore.
+         */
+        void free(NodeChildren *&children);
+
+        /** Returns uninitialized storage for one NodeChildren block. */
+        void* allocate();
+
+        /** Returns storage of destroyed NodeChildren block to free list. */
+        void deallocate(void *block);
+
+        /** Releases all slabs. Any allocated block is invalidated. */
+        void clear();
+
+        /** Registers/unregisters mask using this pool (pool is created
+         *  with one user). Masks can be used from different threads,
+         *  therefore locking is enabled while there is more than one user.
+         */
+        void attach() { ++users_; }
+        void detach() { --users_; }
+
+        /** Returns true if more than one mask uses this pool, i.e. its
+         *  nodes cannot be dropped at once.
+         */
+        bool shared() const { return users_ > 1; }
+
+        /** Registers/unregisters parallel operation running on this pool.
+         *  Locking is enabled while any one is running.
+         */
+        void enterParallel() { ++parallel_; }
+        void leaveParallel() { --parallel_; }
+
+    private:
+        void* allocateImpl();
+
+        bool locking() const { return shared() || parallel_; }
+
+        union Block {
+            Block *next;
+            typename std::aligned_storage<sizeof(NodeChildren)
+                                          , alignof(NodeChildren)>::type
+                storage;
+        };
+
+        std::vector<std::unique_ptr<Block[]>> slabs_;
+        Block *free_;
+        std::size_t used_;
+        std::size_t slabSize_;
+        std::atomic<unsigned int> users_;
+        std::atomic<unsigned int> parallel_;
+        std::mutex mutex_;
+    };
+
     NodeChildren* malloc();
-    NodeChildren* malloc(NodeType type);
-    void free(NodeChildren *&children);
     const Node* findSubtree(int depth, int x, int y) const;
 
+    /** Drops whole tree, root is left black. Unshared pool is dropped at
+     *  once (no node traversal); shared pool is left to other masks and
+     *  new pool is started.
+     */
+    void release();
+
+    /** Starts to use other's node pool. Tree must be empty.
+     */
+    void adopt(const RasterMask &other);
+
+    /** Runs op() inside parallel region with node pool in parallel mode.
+     */
+    template <typename Op> void runParallel(const Op &op);
+
+    /** Grows quads of given value that touch the other value by radius
+     *  pixels (in chessboard metric). Used by dilate() and erode().
+     */
+    void grow(unsigned int radius, bool value);
+
     unsigned int sizeX_, sizeY_;
     unsigned int depth_;
     unsigned int quadSize_;
     unsigned long long count_;
+    std::shared_ptr<NodePool> pool_;
     Node root_;
 
     /** Needed for mappedqtree::RasterMask creation.
      */
     friend class mappedqtree::RasterMask;
+
+    /** Needed for recount after set operations on mapped masks.
+     */
+    friend struct mappedqtree::detail::Combiner;
+
+    /** Needed for conversion from/to linearqtree::RasterMask.
+     */
+    friend class linearqtree::RasterMask;
+
+    /** Needed for conversion from/to frozenqtree::RasterMask.
+     */
+    friend class frozenqtree::RasterMask;
+
+    /** Needed for polygon rasterization (see rasterize.hpp).
+     */
+    friend class PolygonFiller;
+
+    friend void dilate(RasterMask &mask, unsigned int radius);
+    friend void erode(RasterMask &mask, unsigned int radius);
 };
 
 void resizeMask(const RasterMask &src, RasterMask &dst);
 
+/** Dilates mask by square structuring element of size 2 * radius + 1, pixels
+ *  outside of mask are ignored (same as imgproc::dilate on cv::Mat).
+ *
+ *  Only white quads touching black ones are grown, therefore cost is
+ *  proportional to mask boundary and not to its area.
+ */
+void dilate(RasterMask &mask, unsigned int radius);
+
+/** Erodes mask by square structuring element of size 2 * radius + 1, pixels
+ *  outside of mask are ignored (same as imgproc::erode on cv::Mat).
+ *
+ *  Only black quads touching white ones are grown, therefore cost is
+ *  proportional to mask boundary and not to its area.
+ */
+void erode(RasterMask &mask, unsigned int radius);
+
+/** Generates quadtree raster mask from constant raster.
+ *  See ../const-raster.hpp for const raster interface.
+ *
+ *  Mask is built bottom-up in O(pixels), see RasterMask::build.
+ *
+ *  \param raster source raster
+ *  \param threshold thresholding function: raster value -> bool
+ *  \return generated mask
+ */
+template <typename ConstRaster, typename Threshold>
+RasterMask fromRaster(const ConstRaster &raster, const Threshold &threshold);
+
 } } // namespace imgproc::quadtree
 
 #include "inline/quadtree.hpp"
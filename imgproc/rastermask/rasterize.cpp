@@ -0,0 +1,336 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file rastermask/rasterize.cpp
+ *
+ * Polygon and triangle rasterization into quadtree raster mask.
+ *
+ * Each pixel is sampled at point (x + e, y + e^2) for infinitesimal e, i.e.
+ * no sample lies on any edge. Winding number of samples is then well defined
+ * and it changes only when a path between two samples crosses an edge.
+ * Winding number of the top-left sample of each quad is derived from its
+ * parent's one using only edges crossing the parent, quads crossed by no
+ * edge are uniform.
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <tuple>
+#include <stdexcept>
+
+#include "dbglog/dbglog.hpp"
+
+#include "rasterize.hpp"
+
+namespace imgproc { namespace quadtree {
+
+namespace {
+
+/** Polygon edge stored in canonical direction (a < b) with winding weight:
+ *  +1/-1 if original direction is the same/opposite.
+ */
+struct Edge {
+    math::Point2 a;
+    math::Point2 b;
+    int weight;
+
+    Edge(const math::Point2 &p1, const math::Point2 &p2, int weight = 1)
+        : a(p1), b(p2), weight(weight)
+    {
+        if (std::make_tuple(b(1), b(0)) < std::make_tuple(a(1), a(0))) {
+            std::swap(a, b);
+            this->weight = -weight;
+        }
+    }
+
+    /** Returns true if sample (x, y) lies left of edge line. Collinear
+     *  samples are resolved by the sample perturbation.
+     */
+    bool left(double x, double y) const {
+        const double dx(b(0) - a(0));
+        const double dy(b(1) - a(1));
+        const double o(dx * (y - a(1)) - dy * (x - a(0)));
+        if (o) { return o > 0; }
+        // dx * e^2 - dy * e
+        return dy ? (dy < 0) : (dx > 0);
+    }
+
+    /** Winding number change along horizontal path between samples (x0, y)
+     *  and (x1, y).
+     */
+    int row(double y, double x0, double x1) const {
+        if ((a(1) <= y) == (b(1) <= y)) { return 0; }
+        return weight * (int(left(x1, y)) - int(left(x0, y)));
+    }
+
+    /** Winding number change along vertical path between samples (x, y0)
+     *  and (x, y1).
+     */
+    int column(double x, double y0, double y1) const {
+        if ((a(0) <= x) == (b(0) <= x)) { return 0; }
+        return weight * (int(left(x, y1)) - int(left(x, y0)));
+    }
+
+    /** Returns true if edge can cross any path between samples inside
+     *  rectangle [x0, x1] x [y0, y1] (conservative).
+     */
+    bool crosses(double x0, double y0, double x1, double y1) const {
+        // pad to stay clear of the sample perturbation
+        x0 -= 0.5; y0 -= 0.5; x1 += 0.5; y1 += 0.5;
+
+        if ((std::max(a(0), b(0)) < x0) || (std::min(a(0), b(0)) > x1)
+            || (b(1) < y0) || (a(1) > y1))
+        {
+            return false;
+        }
+
+        // edge line must separate rectangle corners
+        const double dx(b(0) - a(0));
+        const double dy(b(1) - a(1));
+        auto side([&](double x, double y) -> int {
+                const double o(dx * (y - a(1)) - dy * (x - a(0)));
+                return (o > 0) - (o < 0);
+            });
+
+        const int s(side(x0, y0) + side(x1, y0) + side(x0, y1)
+                    + side(x1, y1));
+        return (s > -4) && (s < 4);
+    }
+};
+
+typedef std::vector<Edge> Edges;
+typedef std::vector<std::uint32_t> EdgeIndices;
+
+/** Sorts edges and merges duplicates (i.e. edges shared by adjacent
+ *  triangles cancel out).
+ */
+void merge(Edges &edges)
+{
+    auto key([](const Edge &e) {
+        return std::make_tuple(e.a(1), e.a(0), e.b(1), e.b(0));
+    });
+
+    std::sort(edges.begin(), edges.end()
+              , [&](const Edge &l, const Edge &r) { return key(l) < key(r); });
+
+    auto out(edges.begin());
+    for (auto ie(edges.begin()), ee(edges.end()); ie != ee; ) {
+        auto e(*ie);
+        for (++ie; (ie != ee) && (key(*ie) == key(e)); ++ie) {
+            e.weight += ie->weight;
+        }
+        if (e.weight) { *out++ = e; }
+    }
+    edges.erase(out, edges.end());
+}
+
+} // namespace
+
+/** Fills polygon given by its edges into mask.
+ */
+class PolygonFiller {
+public:
+    PolygonFiller(RasterMask &mask, const Edges &edges, bool evenOdd
+                  , bool value)
+        : mask_(mask), edges_(edges), evenOdd_(evenOdd)
+        , target_(value ? RasterMask::WHITE : RasterMask::BLACK)
+    {}
+
+    void run() {
+        if (mask_.zeroSize() || edges_.empty()) { return; }
+
+        // winding number of sample (0, 0): path from a sample left of
+        // everything (i.e. outside)
+        double outside(0);
+        for (const auto &e : edges_) {
+            outside = std::min(outside, std::min(e.a(0), e.b(0)));
+        }
+        outside = std::floor(outside) - 1;
+
+        int winding(0);
+        EdgeIndices indices;
+        for (std::uint32_t i(0), ei(edges_.size()); i < ei; ++i) {
+            winding += edges_[i].row(0, outside, 0);
+            if (edges_[i].crosses(0, 0, mask_.sizeX_ - 1, mask_.sizeY_ - 1)) {
+                indices.push_back(i);
+            }
+        }
+
+        fill(mask_.root_, 0, 0, mask_.quadSize_, winding, indices);
+        mask_.recount();
+    }
+
+private:
+    bool inside(int winding) const {
+        return evenOdd_ ? (winding & 1) : (winding > 0);
+    }
+
+    /** Sets node (of given size at x, y) where it lies inside. Winding is
+     *  winding number of sample (x, y), indices are edges crossing the node.
+     */
+    void fill(RasterMask::Node &node, unsigned int x, unsigned int y
+              , unsigned int size, int winding, const EdgeIndices &indices)
+    {
+        if (node.type == target_) { return; }
+
+        if (indices.empty() || (size == 1)) {
+            // uniform node
+            if (inside(winding)) {
+                node.pool->free(node.children);
+                node.type = target_;
+            }
+            return;
+        }
+
+        // split node if necessarry
+        node.own();
+        auto *c((node.type == RasterMask::GRAY)
+                ? node.children : node.pool->malloc(node.type));
+        node.children = nullptr;
+
+        size >>= 1;
+        const bool right((x + size) < mask_.sizeX_);
+        const bool bottom((y + size) < mask_.sizeY_);
+        const bool inside[4] = { true, right, bottom, right && bottom };
+
+        // winding numbers of children's top-left samples, i.e. paths
+        // (x, y) -> (x + size, y) -> (x + size, y + size) and
+        // (x, y) -> (x, y + size)
+        int ur(winding), ll(winding), lr(0);
+        for (auto i : indices) {
+            ur += edges_[i].row(y, x, x + size);
+            ll += edges_[i].column(x, y, y + size);
+        }
+        lr = ur;
+        for (auto i : indices) {
+            lr += edges_[i].column(x + size, y, y + size);
+        }
+
+        auto child([&](RasterMask::Node &node, unsigned int x
+                       , unsigned int y, int winding, bool inside)
+        {
+            if (!inside) {
+                // children outside of mask are kept black
+                node.pool->free(node.children);
+                node.type = RasterMask::BLACK;
+                return;
+            }
+
+            const double x1(std::min(x + size, mask_.sizeX_) - 1);
+            const double y1(std::min(y + size, mask_.sizeY_) - 1);
+            EdgeIndices sub;
+            for (auto i : indices) {
+                if (edges_[i].crosses(x, y, x1, y1)) { sub.push_back(i); }
+            }
+            fill(node, x, y, size, winding, sub);
+        });
+
+        child(c->ul, x, y, winding, inside[0]);
+        child(c->ur, x + size, y, ur, inside[1]);
+        child(c->ll, x, y + size, ll, inside[2]);
+        child(c->lr, x + size, y + size, lr, inside[3]);
+
+        node.settle(c, inside);
+    }
+
+    RasterMask &mask_;
+    const Edges &edges_;
+    const bool evenOdd_;
+    const RasterMask::NodeType target_;
+};
+
+namespace {
+
+void addRing(Edges &edges, const math::Polygon &ring)
+{
+    for (std::size_t i(0), e(ring.size()); i < e; ++i) {
+        const auto &a(ring[i]);
+        const auto &b(ring[(i + 1) % e]);
+        if ((a(0) == b(0)) && (a(1) == b(1))) { continue; }
+        edges.emplace_back(a, b);
+    }
+}
+
+} // namespace
+
+void rasterizePolygon(RasterMask &mask, const math::Polygon &polygon
+                      , bool value)
+{
+    Edges edges;
+    addRing(edges, polygon);
+    merge(edges);
+    PolygonFiller(mask, edges, true, value).run();
+}
+
+void rasterizePolygon(RasterMask &mask, const math::MultiPolygon &polygon
+                      , bool value)
+{
+    Edges edges;
+    for (const auto &ring : polygon) { addRing(edges, ring); }
+    merge(edges);
+    PolygonFiller(mask, edges, true, value).run();
+}
+
+void rasterizeTriangles(RasterMask &mask, const math::Points2 &vertices
+                        , const std::vector<std::size_t> &indices
+                        , bool value)
+{
+    if (indices.size() % 3) {
+        LOGTHROW(err1, std::runtime_error)
+            << "Number of triangle vertex indices (" << indices.size()
+            << ") is not divisible by 3.";
+    }
+
+    Edges edges;
+    edges.reserve(indices.size());
+    for (auto ii(indices.begin()), ei(indices.end()); ii != ei; ii += 3) {
+        for (int i(0); i < 3; ++i) {
+            if (ii[i] >= vertices.size()) {
+                LOGTHROW(err1, std::runtime_error)
+                    << "Triangle vertex index " << ii[i]
+                    << " out of range (" << vertices.size() << " vertices).";
+            }
+        }
+
+        const auto &a(vertices[ii[0]]);
+        const auto &b(vertices[ii[1]]);
+        const auto &c(vertices[ii[2]]);
+
+        // orient triangle so that its interior has winding number +1
+        const double area((b(0) - a(0)) * (c(1) - a(1))
+                          - (b(1) - a(1)) * (c(0) - a(0)));
+        if (!area) { continue; }
+        const int weight((area > 0) ? 1 : -1);
+
+        edges.emplace_back(a, b, weight);
+        edges.emplace_back(b, c, weight);
+        edges.emplace_back(c, a, weight);
+    }
+    merge(edges);
+    PolygonFiller(mask, edges, false, value).run();
+}
+
+} } // namespace imgproc::quadtree
@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file rastermask/rasterize.hpp
+ *
+ * Polygon and triangle rasterization into quadtree raster mask.
+ */
+
+#ifndef imgproc_rastermask_rasterize_hpp_included_
+#define imgproc_rastermask_rasterize_hpp_included_
+
+#include <vector>
+
+#include "math/geometry_core.hpp"
+
+#include "quadtree.hpp"
+
+namespace imgproc { namespace quadtree {
+
+/** Rasterizes polygon into mask: pixels inside polygon are set to given
+ *  value, other pixels are left intact.
+ *
+ *  Pixel (x, y) is sampled at point (x, y) with the same rule as
+ *  imgproc::Rasterizer uses: pixels lying on the left/top edge of polygon are
+ *  inside, pixels on the right/bottom edge are outside.
+ *
+ *  Quads are classified against polygon edges top-down: quads not crossed by
+ *  any edge are set at once and only quads along edges are split, i.e. cost
+ *  is O(perimeter * depth) regardless of polygon area.
+ */
+void rasterizePolygon(RasterMask &mask, const math::Polygon &polygon
+                      , bool value = true);
+
+/** Same as above for multiple rings combined by even-odd rule, i.e. rings
+ *  inside other rings are holes (ring orientation does not matter).
+ */
+void rasterizePolygon(RasterMask &mask, const math::MultiPolygon &polygon
+                      , bool value = true);
+
+/** Rasterizes union of triangles into mask, pixels are sampled in the same
+ *  way as in rasterizePolygon.
+ *
+ *  Triangles are given by triplets of indices into vertices. Edges shared by
+ *  two adjacent triangles cancel out, cost is therefore proportional to the
+ *  mesh outline and not to the number of triangles.
+ */
+void rasterizeTriangles(RasterMask &mask, const math::Points2 &vertices
+                        , const std::vector<std::size_t> &indices
+                        , bool value = true);
+
+/** Same as above for any face type with vertex indices a, b, c (e.g.
+ *  geometry::Face).
+ */
+template <typename Face>
+void rasterizeMesh(RasterMask &mask, const math::Points2 &vertices
+                   , const std::vector<Face> &faces, bool value = true);
+
+// inlines
+
+template <typename Face>
+void rasterizeMesh(RasterMask &mask, const math::Points2 &vertices
+                   , const std::vector<Face> &faces, bool value)
+{
+    std::vector<std::size_t> indices;
+    indices.reserve(3 * faces.size());
+    for (const auto &face : faces) {
+        indices.push_back(face.a);
+        indices.push_back(face.b);
+        indices.push_back(face.c);
+    }
+    rasterizeTriangles(mask, vertices, indices, value);
+}
+
+} } // namespace imgproc::quadtree
+
+#endif // imgproc_rastermask_rasterize_hpp_included_
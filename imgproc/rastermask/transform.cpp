@@ -23,8 +23,13 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE.
  */
+#include <algorithm>
+#include <vector>
+
 #include "dbglog/dbglog.hpp"
+#include "utility/openmp.hpp"
 
+#include "bitfield.hpp"
 #include "transform.hpp"
 #include "cvmat.hpp"
 
@@ -40,10 +45,79 @@ inline math::Point2 trans(const Matrix2x3 &tr, int x, int y)
      };
 }
 
-} // namespace
+inline int clamp(int i, int max)
+{
+    if (i < 0) { return 0; }
+    if (i > max) { return max; }
+    return i;
+}
 
-RasterMask transform(const RasterMask &mask, const math::Size2 &size
-                     , const Matrix2x3 &trafo)
+/** Source kernel window of each output column (or row), both ends inclusive
+ *  and clamped to source pixels. Both ends are non-decreasing for positive
+ *  scale.
+ */
+struct Footprint {
+    std::vector<int> lo;
+    std::vector<int> hi;
+
+    template <typename Map>
+    Footprint(int count, double k, int max, const Map &map)
+        : lo(count), hi(count)
+    {
+        for (int i(0); i < count; ++i) {
+            const auto p(map(i));
+            lo[i] = clamp(std::floor(p - k), max);
+            hi[i] = clamp(std::ceil(p + k), max);
+        }
+    }
+
+    /** Returns half-open range of output indices whose window intersects
+     *  source range [s0, s1].
+     */
+    std::pair<int, int> hits(int s0, int s1) const {
+        return {
+            int(std::lower_bound(hi.begin(), hi.end(), s0) - hi.begin())
+            , int(std::upper_bound(lo.begin(), lo.end(), s1) - lo.begin())
+        };
+    }
+};
+
+/** Axis-aligned transformation with positive scale: output pixel is black iff
+ *  its window touches a black source quad. Each black quad therefore maps to
+ *  a single output rectangle, no per-pixel kernel scan is needed.
+ */
+RasterMask transformAligned(const RasterMask &mask, const math::Size2 &size
+                            , const Matrix2x3 &trafo)
+{
+    const auto dims(mask.dims());
+
+    const Footprint xfp(size.width, trafo(0, 0) / 2.0, dims.width - 1
+                        , [&](int i) { return trans(trafo, i, 0)(0); });
+    const Footprint yfp(size.height, trafo(1, 1) / 2.0, dims.height - 1
+                        , [&](int j) { return trans(trafo, 0, j)(1); });
+
+    bitfield::RasterMask out(size, bitfield::RasterMask::FULL);
+
+    mask.forEachQuad([&](unsigned int x, unsigned int y
+                         , unsigned int xsize, unsigned int ysize, bool)
+    {
+        const auto cols(xfp.hits(x, x + xsize - 1));
+        if (cols.first >= cols.second) { return; }
+        const auto rows(yfp.hits(y, y + ysize - 1));
+
+        for (int j(rows.first); j < rows.second; ++j) {
+            out.setSpan(cols.first, j, cols.second - cols.first, false);
+        }
+    }, RasterMask::Filter::black);
+
+    return RasterMask(out, RasterMask::Parallel());
+}
+
+/** Generic transformation: kernel window is scanned for each output pixel,
+ *  output rows are processed in parallel.
+ */
+RasterMask transformGeneric(const RasterMask &mask, const math::Size2 &size
+                            , const Matrix2x3 &trafo)
 {
     // kernel sizes (from scaling factor)
     double kw(trafo(0, 0) / 2.0);
@@ -51,13 +125,6 @@ RasterMask transform(const RasterMask &mask, const math::Size2 &size
 
     auto m(asCvMat(mask));
 
-    auto clamp([](int i, int max) -> int
-    {
-        if (i < 0) { return 0; }
-        if (i > max) { return max; }
-        return i;
-    });
-
     // both ends of kernel are inclusive -> clip to -1 and use <=
     const int xMax(m.cols - 1);
     const int yMax(m.rows - 1);
@@ -79,17 +146,42 @@ RasterMask transform(const RasterMask &mask, const math::Size2 &size
         return true;
     });
 
-    RasterMask out(size, RasterMask::EMPTY);
-    for (int j(0); j < size.height; ++j) {
+    cv::Mat o(size.height, size.width, CV_8UC1);
+
+    UTILITY_OMP(parallel for schedule(dynamic))
+    for (int j = 0; j < size.height; ++j) {
+        auto *row(o.ptr<std::uint8_t>(j));
         for (int i(0); i < size.width; ++i) {
-            if (scan(trans(trafo, i, j))) {
-                out.set(i, j);
-            }
+            row[i] = scan(trans(trafo, i, j));
         }
     }
 
+    RasterMask out(size, RasterMask::EMPTY);
+    out.build([&](int x, int y) -> bool
+    {
+        return o.at<std::uint8_t>(y, x);
+    });
+
     // done
     return out;
 }
 
+} // namespace
+
+RasterMask transform(const RasterMask &mask, const math::Size2 &size
+                     , const Matrix2x3 &trafo)
+{
+    if (!mask.dims().width || !mask.dims().height) {
+        return RasterMask(size, RasterMask::EMPTY);
+    }
+
+    if (!trafo(0, 1) && !trafo(1, 0)
+        && (trafo(0, 0) > 0.0) && (trafo(1, 1) > 0.0))
+    {
+        return transformAligned(mask, size, trafo);
+    }
+
+    return transformGeneric(mask, size, trafo);
+}
+
 } } // namespace imgproc::quadtree
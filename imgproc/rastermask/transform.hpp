@@ -38,6 +38,11 @@ typedef boost::numeric::ublas::matrix
 
 /** Transforms raster mask to new mask of size size by given transformation
  *  matrix.
+ *
+ *  Output pixel is white iff all source pixels in its kernel window are white.
+ *  Axis-aligned transformations (scale and offset only) are computed directly
+ *  from black quads, other transformations scan the kernel window of each
+ *  output pixel (in parallel).
  */
 RasterMask transform(const RasterMask &mask, const math::Size2 &size
                      , const Matrix2x3 &trafo);
@@ -0,0 +1,202 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file tabulated-filter.hpp
+ *
+ * Tabulated (precomputed) 2D filter kernels.
+ */
+
+#ifndef imgproc_tabulated_filter_hpp_included_
+#define imgproc_tabulated_filter_hpp_included_
+
+#include <cmath>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "filter-traits.hpp"
+
+namespace imgproc {
+
+namespace detail {
+
+/** Filter sampled over [lo, hi] with step of at most 1 / resolution px,
+ *  both ends are sampled exactly. Values in between are interpolated
+ *  linearly, values beyond the sampled range are clamped.
+ */
+class FilterSegment {
+public:
+    template <typename Eval>
+    FilterSegment(double lo, double hi, int resolution, const Eval &eval)
+        : lo_(lo)
+    {
+        const int intervals
+            (std::max(1.0, std::ceil((hi - lo) * resolution)));
+        scale_ = intervals / (hi - lo);
+        values_.reserve(intervals + 1);
+        for (int i(0); i < intervals; ++i) {
+            values_.push_back(eval(lo + i / scale_));
+        }
+        values_.push_back(eval(hi));
+    }
+
+    double operator()(double d) const {
+        const double t((d - lo_) * scale_);
+        if (t <= 0.0) { return values_.front(); }
+        const std::size_t i(t);
+        if ((i + 1) >= values_.size()) { return values_.back(); }
+        return values_[i] + (t - i) * (values_[i + 1] - values_[i]);
+    }
+
+private:
+    double lo_;
+    double scale_;
+    std::vector<double> values_;
+};
+
+/** One axis of a filter sampled over [-halfwin - 1, halfwin + 1]
+ *  (reconstruct() evaluates taps up to one pixel beyond filter window).
+ *
+ *  Filter window and both parts beyond it are sampled separately:
+ *  filters are usually cut off at the window edge and interpolation across
+ *  the cut would smear it over one sampling step.
+ */
+class FilterTable {
+public:
+    template <typename Eval>
+    FilterTable(double halfwin, int resolution, const Eval &eval)
+        : halfwin_(halfwin)
+        , below_(-halfwin - 1.0, std::nextafter(-halfwin, -halfwin - 1.0)
+                 , resolution, eval)
+        , window_(-halfwin, halfwin, resolution, eval)
+        , above_(std::nextafter(halfwin, halfwin + 1.0), halfwin + 1.0
+                 , resolution, eval)
+    {}
+
+    double operator()(double d) const {
+        if (d < -halfwin_) { return below_(d); }
+        if (d > halfwin_) { return above_(d); }
+        return window_(d);
+    }
+
+private:
+    double halfwin_;
+    FilterSegment below_;
+    FilterSegment window_;
+    FilterSegment above_;
+};
+
+} // namespace detail
+
+/** Filter2 wrapper that samples given filter once and then looks weights up
+ *  in a table (with linear interpolation) instead of evaluating the filter
+ *  for each tap, e.g. no trigonometric functions are evaluated for
+ *  math::SincHamming2 in reconstruct().
+ *
+ *  Models the same concept as math filters, i.e. it can be used as the
+ *  filter template argument of reconstruct(), transform(), scale() and
+ *  cropAndScale():
+ *
+ *      imgproc::scale<imgproc::TabulatedFilter2<math::SincHamming2>>(src, dst);
+ *
+ *  Filter must be separable, i.e. filter(x, y) = f(x) * g(y), and marked by
+ *  SeparableFilter2 (enforced at compile time); one table per axis is
+ *  built.
+ *
+ *  Tables are cached per thread for the last used window size: transform()
+ *  constructs a filter for each pixel and the window is usually the same.
+ *  Filters with a different window each time are slower than the
+ *  wrapped filter.
+ *
+ *  \param Filter2 wrapped filter, constructible from window sizes (winx, winy)
+ *  \param Resolution number of samples per pixel
+ */
+template <typename Filter2, int Resolution = 256>
+class TabulatedFilter2 {
+    static_assert(SeparableFilter2<Filter2>::value
+                  , "TabulatedFilter2 needs separable filter "
+                  "(see SeparableFilter2).");
+
+public:
+    TabulatedFilter2(double winx, double winy)
+        : filter_(winx, winy)
+    {
+        auto &cache(Cache::get());
+        if (!cache.x || (cache.winx != winx) || (cache.winy != winy)) {
+            const Filter2 &filter(filter_);
+            cache.winx = winx;
+            cache.winy = winy;
+            cache.x = std::make_shared<detail::FilterTable>
+                (filter.halfwinx(), Resolution
+                 , [&](double d) { return filter(d, 0.0); });
+            cache.y = std::make_shared<detail::FilterTable>
+                (filter.halfwiny(), Resolution
+                 , [&](double d) { return filter(0.0, d); });
+
+            // filter(x, 0) * filter(0, y) = filter(x, y) * filter(0, 0)
+            const double center(filter(0.0, 0.0));
+            cache.scale = center ? (1.0 / center) : 1.0;
+        }
+
+        x_ = cache.x;
+        y_ = cache.y;
+        scale_ = cache.scale;
+    }
+
+    double halfwinx() const { return filter_.halfwinx(); }
+    double halfwiny() const { return filter_.halfwiny(); }
+
+    double operator()(double x, double y) const {
+        return scale_ * (*x_)(x) * (*y_)(y);
+    }
+
+private:
+    struct Cache {
+        double winx;
+        double winy;
+        double scale;
+        std::shared_ptr<const detail::FilterTable> x;
+        std::shared_ptr<const detail::FilterTable> y;
+
+        static Cache& get() {
+            thread_local Cache cache{ 0.0, 0.0, 1.0, {}, {} };
+            return cache;
+        }
+    };
+
+    Filter2 filter_;
+    std::shared_ptr<const detail::FilterTable> x_;
+    std::shared_ptr<const detail::FilterTable> y_;
+    double scale_;
+};
+
+template <typename Filter2, int Resolution>
+struct SeparableFilter2<TabulatedFilter2<Filter2, Resolution> >
+    : SeparableFilter2<Filter2> {};
+
+} // namespace imgproc
+
+#endif // imgproc_tabulated_filter_hpp_included_
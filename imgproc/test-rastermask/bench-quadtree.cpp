@@ -0,0 +1,368 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file test-rastermask/bench-quadtree.cpp
+ *
+ * Quadtree raster mask benchmark: measures node-heavy operations (building,
+ * copying, set operations, coarsening, morphology, serialization and
+ * destruction) on random and real-world masks. Serialized sizes of all mask
+ * formats are reported as well.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <sstream>
+#include <fstream>
+#include <vector>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include "dbglog/dbglog.hpp"
+#include "utility/streams.hpp"
+#include "service/cmdline.hpp"
+
+#include "imgproc/rastermask/quadtree.hpp"
+#include "imgproc/rastermask/bitfield.hpp"
+#include "imgproc/rastermask/mappedqtree.hpp"
+#include "imgproc/rastermask/linearqtree.hpp"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+using imgproc::quadtree::RasterMask;
+
+namespace {
+
+class Timer {
+public:
+    Timer(const std::string &what)
+        : what_(what), start_(std::chrono::steady_clock::now())
+    {}
+
+    ~Timer() {
+        std::chrono::duration<double, std::milli> d
+            (std::chrono::steady_clock::now() - start_);
+        std::cout << "    " << std::setw(12) << std::left << what_
+                  << std::setw(12) << std::right << std::fixed
+                  << std::setprecision(2) << d.count() << " ms" << std::endl;
+    }
+
+private:
+    std::string what_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+void reportSize(const std::string &what, std::size_t size)
+{
+    std::cout << "    " << std::setw(12) << std::left << what
+              << std::setw(12) << std::right << size << " B" << std::endl;
+}
+
+/** Generates random mask by setting random quads at random depths.
+ */
+RasterMask randomMask(const math::Size2 &size, std::size_t quads
+                      , unsigned int spread, boost::random::mt19937 &gen)
+{
+    RasterMask mask(size, RasterMask::EMPTY);
+
+    const int depth(mask.depth());
+    const int minDepth(std::max(0, depth - int(spread)));
+    boost::random::uniform_int_distribution<> depthDist(minDepth, depth);
+    boost::random::uniform_int_distribution<> valueDist(0, 1);
+
+    for (std::size_t i(0); i < quads; ++i) {
+        const auto d(depthDist(gen));
+        boost::random::uniform_int_distribution<> xyDist(0, (1 << d) - 1);
+        const auto x(xyDist(gen));
+        const auto y(xyDist(gen));
+        mask.setQuad(d, x, y, valueDist(gen));
+    }
+
+    return mask;
+}
+
+void run(const std::string &name, const RasterMask &a, const RasterMask &b
+         , const RasterMask::Parallel &parallel)
+{
+    std::cout << name << ": " << a.dims().width << "x" << a.dims().height
+              << ", depth " << a.depth() << std::endl;
+
+    {
+        Timer t("copy");
+        RasterMask tmp(a);
+    }
+
+    {
+        // copy and modify one pixel (only path to the pixel is copied)
+        Timer t("copy/set");
+        RasterMask tmp(a);
+        tmp.set(0, 0, !tmp.get(0, 0));
+    }
+
+    {
+        RasterMask tmp(a);
+        Timer t("merge");
+        tmp.merge(b);
+    }
+
+    {
+        RasterMask tmp(a);
+        Timer t("intersect");
+        tmp.intersect(b);
+    }
+
+    {
+        RasterMask tmp(a);
+        Timer t("subtract");
+        tmp.subtract(b);
+    }
+
+    {
+        RasterMask tmp(a);
+        Timer t("merge/p");
+        tmp.merge(b, parallel);
+    }
+
+    {
+        RasterMask tmp(a);
+        Timer t("intersect/p");
+        tmp.intersect(b, parallel);
+    }
+
+    {
+        RasterMask tmp(a);
+        Timer t("subtract/p");
+        tmp.subtract(b, parallel);
+    }
+
+    {
+        RasterMask tmp(a);
+        Timer t("coarsen");
+        tmp.coarsen(4);
+    }
+
+    {
+        Timer t("pyramid");
+        a.pyramid();
+    }
+
+    {
+        Timer t("pyramid/bf");
+        a.bitfieldPyramid();
+    }
+
+    {
+        RasterMask tmp(a);
+        Timer t("dilate");
+        dilate(tmp, 4);
+    }
+
+    {
+        RasterMask tmp(a);
+        Timer t("erode");
+        erode(tmp, 4);
+    }
+
+    {
+        std::stringstream ss;
+        a.dump(ss);
+        RasterMask tmp;
+        Timer t("load");
+        tmp.load(ss);
+    }
+
+    {
+        // serialized formats: quadtree dump (QMASK), mapped quadtree (MQMASK)
+        // and linear quadtree (LMASK)
+        std::stringstream qs, ls;
+        a.dump(qs);
+        const imgproc::linearqtree::RasterMask la(a);
+        la.dump(ls);
+
+        // mapped quadtree writer seeks past end of output, needs a file
+        const auto mpath(fs::temp_directory_path() / fs::unique_path());
+        {
+            std::ofstream ms(mpath.string(), std::ios::binary);
+            imgproc::mappedqtree::RasterMask::write(ms, a);
+        }
+
+        reportSize("size/qmask", qs.str().size());
+        reportSize("size/mqmask", fs::file_size(mpath));
+        reportSize("size/lmask", ls.str().size());
+        fs::remove(mpath);
+
+        {
+            imgproc::linearqtree::RasterMask tmp;
+            Timer t("load/lmask");
+            tmp.load(ls);
+        }
+
+        {
+            Timer t("lmask->qt");
+            la.asQuadtree();
+        }
+
+#if IMGPROC_HAS_IOSTREAMS
+        std::stringstream zs;
+        la.dump(zs, imgproc::linearqtree::RasterMask::Compression::zlib);
+        reportSize("size/lmask/z", zs.str().size());
+
+        {
+            imgproc::linearqtree::RasterMask tmp;
+            Timer t("load/lmask/z");
+            tmp.load(zs);
+        }
+#endif
+    }
+
+    {
+        Timer t("asBitfield");
+        a.asBitfield();
+    }
+
+    {
+        Timer t("asBitfield/p");
+        a.asBitfield(parallel);
+    }
+
+    {
+        Timer t("boundary");
+        a.boundary();
+    }
+
+    {
+        const auto bf(a.asBitfield());
+        {
+            Timer t("fromBitfield");
+            RasterMask tmp(bf);
+        }
+        {
+            Timer t("fromBitfield/p");
+            RasterMask tmp(bf, parallel);
+        }
+    }
+
+    {
+        std::unique_ptr<RasterMask> tmp(new RasterMask(a));
+        Timer t("destroy");
+        tmp.reset();
+    }
+}
+
+} // namespace
+
+class Bench : public service::Cmdline {
+public:
+    Bench()
+        : service::Cmdline("bench-quadtree", IMGPROC_VERSION
+                           , service::DISABLE_EXCESSIVE_LOGGING)
+        , size_(16384, 16384), quads_(1 << 20), spread_(10), seed_(5489u)
+        , parallel_()
+    {}
+
+    virtual void configuration(po::options_description &cmdline
+                               , po::options_description&
+                               , po::positional_options_description &pd)
+    {
+        cmdline.add_options()
+            ("input", po::value(&input_)
+             , "Real-world mask (quadtree::RasterMask dump), "
+             "can be used multiple times. Masks are processed in pairs "
+             "(each with the next one).")
+            ("width", po::value(&size_.width)->default_value(size_.width)
+             , "Width of random mask.")
+            ("height", po::value(&size_.height)->default_value(size_.height)
+             , "Height of random mask.")
+            ("quads", po::value(&quads_)->default_value(quads_)
+             , "Number of random quads set in random mask.")
+            ("spread", po::value(&spread_)->default_value(spread_)
+             , "Random quads are generated in this many bottom levels.")
+            ("seed", po::value(&seed_)->default_value(seed_)
+             , "Random generator seed.")
+            ("grainDepth", po::value(&parallel_.grainDepth)
+             ->default_value(parallel_.grainDepth)
+             , "Grain depth for parallel set operations (/p).")
+            ;
+
+        pd.add("input", -1);
+    }
+
+    virtual void configure(const po::variables_map&) {}
+
+    virtual int run() {
+        boost::random::mt19937 gen(seed_);
+
+        {
+            std::unique_ptr<RasterMask> a, b;
+            {
+                Timer t("build");
+                a.reset(new RasterMask
+                        (randomMask(size_, quads_, spread_, gen)));
+                b.reset(new RasterMask
+                        (randomMask(size_, quads_, spread_, gen)));
+            }
+            ::run("random", *a, *b, parallel_);
+        }
+
+        std::vector<RasterMask> masks;
+        for (const auto &path : input_) {
+            utility::ifstreambuf f(path.string());
+            masks.emplace_back();
+            masks.back().load(f);
+        }
+
+        for (std::size_t i(0), e(masks.size()); i < e; ++i) {
+            const auto &other(masks[(i + 1) % e]);
+            if (other.dims().width != masks[i].dims().width
+                || other.dims().height != masks[i].dims().height)
+            {
+                LOG(warn3) << "Mask " << input_[i]
+                           << " has different size than its pair, skipped.";
+                continue;
+            }
+            ::run(input_[i].string(), masks[i], other, parallel_);
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+private:
+    std::vector<fs::path> input_;
+    math::Size2 size_;
+    std::size_t quads_;
+    unsigned int spread_;
+    unsigned int seed_;
+    RasterMask::Parallel parallel_;
+};
+
+int main(int argc, char *argv[])
+{
+    return Bench()(argc, argv);
+}
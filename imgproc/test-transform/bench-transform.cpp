@@ -0,0 +1,213 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * @file test-transform/bench-transform.cpp
+ *
+ * Image transformation benchmark: measures serial and parallel (tiled)
+ * transform() with axis-aligned (separable) and generic mappings for
+ * increasing number of threads.
+ */
+
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <functional>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#include "dbglog/dbglog.hpp"
+#include "service/cmdline.hpp"
+
+#include "imgproc/transformation.hpp"
+
+namespace po = boost::program_options;
+namespace gil = boost::gil;
+
+namespace {
+
+typedef gil::rgb8_image_t Image;
+
+/** Rotation around image center combined with scaling (rotated destination
+ *  fits into source). Models Mapping2 concept, not axis-aligned.
+ */
+class Rotation2 {
+public:
+    Rotation2(const math::Size2 &srcSize, const math::Size2 &dstSize
+              , double angle)
+        : cos_(std::cos(angle)), sin_(std::sin(angle))
+        , sx_(double(srcSize.width) / dstSize.width
+              / (std::abs(cos_) + std::abs(sin_)))
+        , sy_(double(srcSize.height) / dstSize.height
+              / (std::abs(cos_) + std::abs(sin_)))
+        , scx_(srcSize.width / 2.0), scy_(srcSize.height / 2.0)
+        , dcx_(dstSize.width / 2.0), dcy_(dstSize.height / 2.0)
+    {}
+
+    math::Point2 map(const math::Point2i &op) const {
+        const double x(sx_ * (op(0) - dcx_));
+        const double y(sy_ * (op(1) - dcy_));
+        return math::Point2(scx_ + cos_ * x - sin_ * y
+                            , scy_ + sin_ * x + cos_ * y);
+    }
+
+    math::Point2 derivatives(const math::Point2i&) const {
+        return math::Point2(sx_, sy_);
+    }
+
+private:
+    double cos_, sin_, sx_, sy_, scx_, scy_, dcx_, dcy_;
+};
+
+double measure(const std::function<void()> &op)
+{
+    const auto start(std::chrono::steady_clock::now());
+    op();
+    return std::chrono::duration<double, std::milli>
+        (std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const std::string &what, int threads, double ms, double serial)
+{
+    std::cout << "    " << std::setw(12) << std::left << what
+              << std::setw(4) << std::right << threads
+              << std::setw(12) << std::fixed << std::setprecision(2) << ms
+              << " ms" << std::setw(8) << std::setprecision(2)
+              << (serial / ms) << "x" << std::endl;
+}
+
+} // namespace
+
+class Bench : public service::Cmdline {
+public:
+    Bench()
+        : service::Cmdline("bench-transform", IMGPROC_VERSION
+                           , service::DISABLE_EXCESSIVE_LOGGING)
+        , srcSize_(8192, 8192), dstSize_(1024, 1024), maxThreads_(32)
+        , tileSize_(256), seed_(5489u)
+    {}
+
+    virtual void configuration(po::options_description &cmdline
+                               , po::options_description&
+                               , po::positional_options_description&)
+    {
+        cmdline.add_options()
+            ("srcWidth", po::value(&srcSize_.width)
+             ->default_value(srcSize_.width)
+             , "Width of source image.")
+            ("srcHeight", po::value(&srcSize_.height)
+             ->default_value(srcSize_.height)
+             , "Height of source image.")
+            ("dstWidth", po::value(&dstSize_.width)
+             ->default_value(dstSize_.width)
+             , "Width of destination image.")
+            ("dstHeight", po::value(&dstSize_.height)
+             ->default_value(dstSize_.height)
+             , "Height of destination image.")
+            ("maxThreads", po::value(&maxThreads_)
+             ->default_value(maxThreads_)
+             , "Thread counts 1, 2, 4, ... up to this value are measured.")
+            ("tileSize", po::value(&tileSize_)->default_value(tileSize_)
+             , "Tile size for parallel transformation.")
+            ("seed", po::value(&seed_)->default_value(seed_)
+             , "Random generator seed.")
+            ;
+    }
+
+    virtual void configure(const po::variables_map&) {}
+
+    virtual int run() {
+        Image src(srcSize_.width, srcSize_.height);
+        {
+            boost::random::mt19937 gen(seed_);
+            boost::random::uniform_int_distribution<> dist(0, 255);
+            const auto v(gil::view(src));
+            for (int y(0); y < v.height(); ++y) {
+                for (auto ix(v.row_begin(y)), ex(v.row_end(y)); ix != ex;
+                     ++ix)
+                {
+                    for (int k(0); k < 3; ++k) { (*ix)[k] = dist(gen); }
+                }
+            }
+        }
+
+        Image dst(dstSize_.width, dstSize_.height);
+        const auto sv(gil::const_view(src));
+        const auto dv(gil::view(dst));
+
+        std::cout << "source " << srcSize_.width << "x" << srcSize_.height
+                  << ", destination " << dstSize_.width << "x"
+                  << dstSize_.height << std::endl;
+
+        const imgproc::Scaling2 scaling(dstSize_, srcSize_);
+        runMapping("scale", scaling, sv, dv);
+
+        const Rotation2 rotation(srcSize_, dstSize_, 0.3);
+        runMapping("rotate", rotation, sv, dv);
+
+        return EXIT_SUCCESS;
+    }
+
+private:
+    template <typename Mapping2, typename SrcView, typename DstView>
+    void runMapping(const std::string &name, const Mapping2 &mapping
+                    , const SrcView &sv, const DstView &dv)
+    {
+        const double serial(measure([&]() {
+                    imgproc::transform(mapping, sv, dv);
+                }));
+        report(name + "/serial", 1, serial, serial);
+
+        const imgproc::TransformParallel parallel(tileSize_, tileSize_);
+        for (int threads(1); threads <= maxThreads_; threads *= 2) {
+#ifdef _OPENMP
+            omp_set_num_threads(threads);
+#endif
+            const double ms(measure([&]() {
+                        imgproc::transform(mapping, sv, dv, parallel);
+                    }));
+            report(name + "/tiled", threads, ms, serial);
+        }
+    }
+
+    math::Size2 srcSize_;
+    math::Size2 dstSize_;
+    int maxThreads_;
+    int tileSize_;
+    unsigned int seed_;
+};
+
+int main(int argc, char *argv[])
+{
+    return Bench()(argc, argv);
+}
@@ -24,16 +24,86 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 #include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <memory>
+#include <functional>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/filesystem/operations.hpp>
 
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 
 #include "imgproc/rastermask/quadtree.hpp"
+#include "imgproc/rastermask/bitfield.hpp"
+#include "imgproc/rastermask/linearqtree.hpp"
+#include "imgproc/rastermask/mappedqtree.hpp"
+#include "imgproc/rastermask/frozenqtree.hpp"
+#include "imgproc/rastermask/rasterize.hpp"
+#include "imgproc/rastermask/coverage.hpp"
+#if IMGPROC_HAS_OPENCV
+#include "imgproc/rastermask/transform.hpp"
+#endif
+#include "imgproc/distance.hpp"
 
 #include "dbglog/dbglog.hpp"
 
+namespace {
+
+/** Generates mask with random blobs of random sizes and some noise.
+ */
+imgproc::quadtree::RasterMask randomMask(const math::Size2 &size
+                                         , boost::random::mt19937 &gen
+                                         , int quads = 2000)
+{
+    using imgproc::quadtree::RasterMask;
+    RasterMask mask(size, RasterMask::InitMode::EMPTY);
+
+    const int depth(mask.depth());
+    boost::random::uniform_int_distribution<> depthDist
+        (std::max(0, depth - 6), depth);
+    boost::random::uniform_int_distribution<> valueDist(0, 1);
+
+    for (int i(0); i < quads; ++i) {
+        const auto d(depthDist(gen));
+        boost::random::uniform_int_distribution<> xyDist(0, (1 << d) - 1);
+        const auto x(xyDist(gen));
+        const auto y(xyDist(gen));
+        mask.setQuad(d, x, y, valueDist(gen));
+    }
+
+    return mask;
+}
+
+template <typename Mask1, typename Mask2>
+void requireSame(const Mask1 &m1, const Mask2 &m2, const math::Size2 &size)
+{
+    for (int j(-1); j <= size.height; ++j) {
+        for (int i(-1); i <= size.width; ++i) {
+            BOOST_REQUIRE_EQUAL(m1.get(i, j), m2.get(i, j));
+        }
+    }
+}
+
+template <typename Mask>
+unsigned long long whiteCount(const Mask &mask, const math::Size2 &size)
+{
+    unsigned long long count(0);
+    for (int j(0); j < size.height; ++j) {
+        for (int i(0); i < size.width; ++i) {
+            count += mask.get(i, j);
+        }
+    }
+    return count;
+}
+
+} // namespace
+
 BOOST_AUTO_TEST_CASE(rastermask_quadtree_invert)
 {
     BOOST_TEST_MESSAGE("* Testing QuadTree-based rastermask invertions.");
@@ -63,3 +133,1482 @@ BOOST_AUTO_TEST_CASE(rastermask_quadtree_invert)
         }
     }
 }
+
+BOOST_AUTO_TEST_CASE(rastermask_quadtree_setquad)
+{
+    BOOST_TEST_MESSAGE("* Testing QuadTree-based rastermask quad setting.");
+
+    using imgproc::quadtree::RasterMask;
+
+    RasterMask mask(64, 64, RasterMask::InitMode::EMPTY);
+
+    // make quad (depth 2, 1, 1) gray and then overwrite it as a whole
+    mask.set(17, 17);
+    mask.set(20, 30);
+    mask.setQuad(2, 1, 1, true);
+    BOOST_REQUIRE_EQUAL(mask.count(), 16 * 16);
+
+    mask.set(17, 17, false);
+    mask.setQuad(2, 1, 1, false);
+    BOOST_REQUIRE(mask.empty());
+
+    for (int j(0); j < 64; ++j) {
+        for (int i(0); i < 64; ++i) {
+            BOOST_REQUIRE(!mask.get(i, j));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_quadtree_reset)
+{
+    BOOST_TEST_MESSAGE("* Testing QuadTree-based rastermask reset.");
+
+    using imgproc::quadtree::RasterMask;
+
+    // non-power-of-two size: count is limited by mask size, not by tree
+    RasterMask mask(50, 30, RasterMask::InitMode::EMPTY);
+    mask.set(3, 4);
+    mask.set(40, 20);
+    BOOST_REQUIRE_EQUAL(mask.count(), 2);
+
+    mask.reset(true);
+    BOOST_REQUIRE_EQUAL(mask.count(), 50 * 30);
+    BOOST_REQUIRE(mask.full());
+
+    // count stays in sync with subsequent modifications
+    mask.set(3, 4, false);
+    BOOST_REQUIRE_EQUAL(mask.count(), 50 * 30 - 1);
+
+    mask.reset(false);
+    BOOST_REQUIRE(mask.empty());
+
+    mask.set(3, 4);
+    BOOST_REQUIRE_EQUAL(mask.count(), 1);
+
+    for (int j(0); j < 30; ++j) {
+        for (int i(0); i < 50; ++i) {
+            BOOST_REQUIRE_EQUAL(mask.get(i, j), (i == 3) && (j == 4));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_quadtree_boundary)
+{
+    BOOST_TEST_MESSAGE("* Testing QuadTree-based rastermask boundary "
+                       "extraction.");
+
+    using imgproc::quadtree::RasterMask;
+
+    boost::random::mt19937 gen;
+
+    for (const auto &size : { math::Size2(1, 1), math::Size2(1, 37)
+                , math::Size2(29, 2), math::Size2(300, 200)
+                , math::Size2(513, 257) })
+    {
+        // noisy mask (small quads) and blobs (large quads)
+        for (int quads : { 20, 2000 }) {
+            const auto mask(randomMask(size, gen, quads));
+
+            std::vector<int> hits(math::area(size));
+            mask.forEachBoundary([&](unsigned int x, unsigned int y)
+            {
+                BOOST_REQUIRE(int(x) < size.width);
+                BOOST_REQUIRE(int(y) < size.height);
+                ++hits[y * size.width + x];
+            });
+
+            const auto boundary(mask.boundary());
+            for (int j(0); j < size.height; ++j) {
+                for (int i(0); i < size.width; ++i) {
+                    const bool on(mask.onBoundary(i, j));
+                    BOOST_REQUIRE_EQUAL(hits[j * size.width + i], int(on));
+                    BOOST_REQUIRE_EQUAL(boundary.get(i, j), on);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_linearqtree)
+{
+    BOOST_TEST_MESSAGE("* Testing linear QuadTree-based rastermask.");
+
+    using imgproc::quadtree::RasterMask;
+    namespace linearqtree = imgproc::linearqtree;
+
+    math::Size2 size(1000, 700);
+    boost::random::mt19937 gen;
+
+    const auto a(randomMask(size, gen));
+    const auto b(randomMask(size, gen));
+
+    // conversions
+    const linearqtree::RasterMask la(a);
+    const linearqtree::RasterMask lb(b.asBitfield());
+    BOOST_REQUIRE_EQUAL(la.count(), whiteCount(a, size));
+    BOOST_REQUIRE_EQUAL(lb.count(), whiteCount(b, size));
+    requireSame(la, a, size);
+    requireSame(lb, b, size);
+    requireSame(la.asQuadtree(), a, size);
+    requireSame(la.asBitfield(), a.asBitfield(), size);
+
+    // serialization
+    typedef linearqtree::RasterMask::Compression Compression;
+    auto roundTrip([&](Compression compression) -> std::size_t
+    {
+        std::stringstream ss;
+        la.dump(ss, compression);
+        linearqtree::RasterMask l;
+        l.load(ss);
+        BOOST_REQUIRE_EQUAL(l.count(), la.count());
+        requireSame(l, a, size);
+        requireSame(l.asQuadtree(), a, size);
+        return ss.str().size();
+    });
+
+    {
+        std::stringstream qs;
+        a.dump(qs);
+        const auto plain(roundTrip(Compression::none));
+        BOOST_REQUIRE_LT(3 * plain, qs.str().size());
+#if IMGPROC_HAS_IOSTREAMS
+        BOOST_REQUIRE_LT(roundTrip(Compression::zlib), plain);
+#endif
+    }
+
+    {
+        // truncated data are rejected
+        std::stringstream ss;
+        la.dump(ss);
+        std::istringstream is(ss.str().substr(0, ss.str().size() - 1));
+        linearqtree::RasterMask l;
+        BOOST_REQUIRE_THROW(l.load(is), std::runtime_error);
+    }
+
+    {
+        // failed load leaves existing mask untouched
+        std::stringstream ss;
+        lb.dump(ss);
+        const auto good(ss.str());
+
+        // header: magic(5) compression(1) root(1) reserved(1) sizeX(4)
+        // sizeY(4) count(8), nodes follow
+        auto patch([&](std::size_t offset, std::uint64_t value
+                       , std::size_t bytes) -> std::string
+        {
+            auto bad(good);
+            for (std::size_t i(0); i < bytes; ++i, value >>= 8) {
+                bad[offset + i] = char(value & 0xff);
+            }
+            return bad;
+        });
+
+        std::vector<std::string> corrupted = {
+            good.substr(0, 40)
+            , patch(5, 7, 1) // compression
+            , patch(8, 0xffffffff, 4) // sizeX
+            , patch(16, std::uint64_t(1) << 40, 8) // count over depth limit
+            , patch(16, good.size(), 8) // count over stream length
+            , patch(24, 0, good.size() - 24) // all-black nodes
+        };
+
+        linearqtree::RasterMask l(la);
+        for (const auto &data : corrupted) {
+            std::istringstream is(data);
+            BOOST_REQUIRE_THROW(l.load(is), std::runtime_error);
+            BOOST_REQUIRE_EQUAL(l.dims().width, size.width);
+            BOOST_REQUIRE_EQUAL(l.dims().height, size.height);
+            BOOST_REQUIRE_EQUAL(l.count(), la.count());
+            requireSame(l, a, size);
+        }
+
+        // still usable
+        std::istringstream is(good);
+        l.load(is);
+        BOOST_REQUIRE_EQUAL(l.count(), lb.count());
+        requireSame(l, b, size);
+    }
+
+    // set operations
+    auto check([&](void (RasterMask::*op)(const RasterMask&)
+                   , void (linearqtree::RasterMask::*lop)
+                   (const linearqtree::RasterMask&))
+    {
+        RasterMask q(a);
+        (q.*op)(b);
+
+        linearqtree::RasterMask l(la);
+        (l.*lop)(lb);
+        BOOST_REQUIRE_EQUAL(l.count(), whiteCount(q, size));
+        requireSame(l, q, size);
+    });
+
+    check(&RasterMask::intersect, &linearqtree::RasterMask::intersect);
+    check(&RasterMask::subtract, &linearqtree::RasterMask::subtract);
+
+    {
+        RasterMask q(a);
+        q.merge(b);
+        linearqtree::RasterMask l(la);
+        l.merge(lb);
+        BOOST_REQUIRE_EQUAL(l.count(), whiteCount(q, size));
+        requireSame(l, q, size);
+    }
+
+    {
+        linearqtree::RasterMask l(la);
+        l.invert();
+        for (int j(0); j < size.height; ++j) {
+            for (int i(0); i < size.width; ++i) {
+                BOOST_REQUIRE(l.get(i, j) != a.get(i, j));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_quadtree_parallel)
+{
+    BOOST_TEST_MESSAGE("* Testing QuadTree-based rastermask parallel "
+                       "set operations.");
+
+    using imgproc::quadtree::RasterMask;
+
+    math::Size2 size(1000, 700);
+    boost::random::mt19937 gen;
+
+    const auto a(randomMask(size, gen, 20000));
+    const auto b(randomMask(size, gen, 20000));
+
+    const RasterMask::Parallel parallel(3);
+
+    auto check([&](void (RasterMask::*op)(const RasterMask&)
+                   , void (RasterMask::*pop)(const RasterMask&
+                                             , const RasterMask::Parallel&))
+    {
+        RasterMask serial(a);
+        (serial.*op)(b);
+
+        RasterMask par(a);
+        (par.*pop)(b, parallel);
+
+        BOOST_REQUIRE_EQUAL(serial.count(), par.count());
+        requireSame(serial, par, size);
+    });
+
+    check(&RasterMask::intersect, &RasterMask::intersect);
+    check(&RasterMask::subtract, &RasterMask::subtract);
+
+    {
+        RasterMask serial(a);
+        serial.merge(b);
+        RasterMask par(a);
+        par.merge(b, parallel);
+        BOOST_REQUIRE_EQUAL(serial.count(), par.count());
+        requireSame(serial, par, size);
+    }
+
+    {
+        RasterMask serial(a);
+        serial.invert();
+        RasterMask par(a);
+        par.invert(parallel);
+        BOOST_REQUIRE_EQUAL(serial.count(), par.count());
+        requireSame(serial, par, size);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_quadtree_shared)
+{
+    BOOST_TEST_MESSAGE("* Testing QuadTree-based rastermask copy-on-write "
+                       "subtree sharing.");
+
+    using imgproc::quadtree::RasterMask;
+
+    math::Size2 size(1000, 700);
+    boost::random::mt19937 gen;
+
+    // round trip through bitfield: quads outside of mask are black
+    const RasterMask a(randomMask(size, gen, 20000).asBitfield());
+    const RasterMask b(randomMask(size, gen, 20000).asBitfield());
+
+    // independent copies (nothing is shared)
+    const RasterMask aa(a.asBitfield());
+    const RasterMask bb(b.asBitfield());
+
+    // modifying copy must not touch the original
+    auto check([&](RasterMask &shared, RasterMask &plain)
+    {
+        BOOST_REQUIRE_EQUAL(shared.count(), plain.count());
+        requireSame(shared, plain, size);
+        BOOST_REQUIRE_EQUAL(a.count(), aa.count());
+        requireSame(a, aa, size);
+    });
+
+    {
+        RasterMask shared(a), plain(aa);
+        for (int i(0); i < 1000; ++i) {
+            const int x(gen() % size.width), y(gen() % size.height);
+            shared.set(x, y, i & 1);
+            plain.set(x, y, i & 1);
+        }
+        shared.setQuad(3, 2, 1, false);
+        plain.setQuad(3, 2, 1, false);
+        check(shared, plain);
+    }
+
+    {
+        RasterMask shared(size, RasterMask::FULL), plain(aa);
+        shared = a;
+        shared.invert();
+        plain.invert();
+        check(shared, plain);
+        shared.coarsen(8);
+        plain.coarsen(8);
+        check(shared, plain);
+    }
+
+    {
+        RasterMask shared(a), plain(aa);
+        shared.merge(b);
+        plain.merge(bb);
+        check(shared, plain);
+        shared.subtract(a);
+        plain.subtract(aa);
+        check(shared, plain);
+    }
+
+    {
+        RasterMask shared(a), plain(aa);
+        shared.intersect(b, RasterMask::Parallel(3));
+        plain.intersect(bb);
+        check(shared, plain);
+    }
+
+    {
+        // operations with itself
+        RasterMask shared(a);
+        shared.merge(a);
+        BOOST_REQUIRE_EQUAL(shared.count(), a.count());
+        requireSame(shared, a, size);
+        shared.subtract(a);
+        BOOST_REQUIRE(shared.empty());
+    }
+
+    {
+        // subtree of a (quad 1, 1 at depth 2) placed to b at quad 2, 0
+        const auto quad(1u << (a.depth() - 2));
+        auto s(a.subTree(math::Size2(quad, quad), 2, 1, 1));
+        RasterMask shared(b);
+        shared.setSubtree(2, 2, 0, s);
+        s.invert();
+
+        for (int j(0); j < size.height; ++j) {
+            for (int i(0); i < size.width; ++i) {
+                const bool inside((unsigned(i) >= 2 * quad)
+                                  && (unsigned(i) < 3 * quad)
+                                  && (unsigned(j) < quad));
+                BOOST_REQUIRE_EQUAL(shared.get(i, j)
+                                    , inside ? a.get(i - quad, j + quad)
+                                    : b.get(i, j));
+            }
+        }
+        requireSame(a, aa, size);
+        requireSame(b, bb, size);
+    }
+
+    {
+        // copies sharing one node pool are modified (partly by parallel
+        // operations) and destroyed in different threads; the remaining mask
+        // is then modified alone
+        RasterMask base(aa.asBitfield());
+        RasterMask expected(aa);
+        expected.merge(bb);
+        expected.invert();
+
+        std::vector<std::unique_ptr<RasterMask> > copies;
+        for (int t(0); t < 4; ++t) {
+            copies.emplace_back(new RasterMask(base));
+        }
+
+        std::vector<std::thread> threads;
+        std::vector<char> same(copies.size());
+        for (std::size_t t(0); t < copies.size(); ++t) {
+            threads.emplace_back([&, t]()
+            {
+                auto &copy(*copies[t]);
+                if (t & 1) {
+                    copy.merge(b, RasterMask::Parallel(2));
+                    copy.invert(RasterMask::Parallel(2));
+                } else {
+                    copy.merge(b);
+                    copy.invert();
+                }
+                // Boost.Test assertions are not thread safe
+                bool ok(copy.count() == expected.count());
+                for (int j(0); ok && (j < size.height); ++j) {
+                    for (int i(0); ok && (i < size.width); ++i) {
+                        ok = (copy.get(i, j) == expected.get(i, j));
+                    }
+                }
+                same[t] = ok;
+                copies[t].reset();
+            });
+        }
+        for (auto &thread : threads) { thread.join(); }
+        for (bool s : same) { BOOST_REQUIRE(s); }
+
+        base.merge(bb);
+        base.invert();
+        BOOST_REQUIRE_EQUAL(base.count(), expected.count());
+        requireSame(base, expected, size);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_quadtree_fromraster)
+{
+    BOOST_TEST_MESSAGE("* Testing QuadTree-based rastermask bulk "
+                       "construction.");
+
+    using imgproc::quadtree::RasterMask;
+
+    math::Size2 size(1000, 700);
+    boost::random::mt19937 gen;
+    const auto src(randomMask(size, gen));
+
+    // minimal const raster over source mask
+    struct Raster {
+        const RasterMask &mask;
+        math::Size2 size() const { return mask.dims(); }
+        int operator()(int x, int y) const { return mask.get(x, y) ? 255 : 0; }
+    } raster{src};
+
+    const auto mask(imgproc::quadtree::fromRaster
+                    (raster, [](int value) { return value > 127; }));
+
+    BOOST_REQUIRE_EQUAL(mask.count(), whiteCount(src, size));
+    requireSame(mask, src, size);
+
+    // uniform raster must end up as single node
+    const auto full(imgproc::quadtree::fromRaster
+                    (raster, [](int) { return true; }));
+    BOOST_REQUIRE(full.full());
+
+    int quads(0);
+    full.forEachQuad([&](unsigned int, unsigned int, unsigned int
+                         , unsigned int, bool) { ++quads; });
+    BOOST_REQUIRE_EQUAL(quads, 1);
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_quadtree_load_mapped)
+{
+    BOOST_TEST_MESSAGE("* Testing QuadTree-based rastermask memory-mapped "
+                       "loading.");
+
+    using imgproc::quadtree::RasterMask;
+    namespace fs = boost::filesystem;
+
+    math::Size2 size(1000, 700);
+    boost::random::mt19937 gen;
+    const auto src(randomMask(size, gen));
+
+    const auto path(fs::temp_directory_path()
+                    / fs::unique_path("rastermask-%%%%-%%%%.qmask"));
+    {
+        // place dump at non-zero offset
+        std::ofstream f(path.string(), std::ios::binary);
+        f << "prefix";
+        src.dump(f);
+    }
+
+    RasterMask mask;
+    mask.load(path, 6);
+    fs::remove(path);
+
+    BOOST_REQUIRE_EQUAL(mask.count(), whiteCount(src, size));
+    requireSame(mask, src, size);
+
+    // corrupted dump: header followed by long chain of gray nodes must be
+    // rejected instead of recursing until stack overflow
+    {
+        std::ostringstream os;
+        RasterMask(size, RasterMask::InitMode::EMPTY).dump(os);
+        auto data(os.str());
+        data.pop_back(); // drop single root node
+        data.append(1 << 20, char(2)); // GRAY
+
+        std::ofstream f(path.string(), std::ios::binary);
+        f << data;
+    }
+    BOOST_CHECK_THROW(mask.load(path), std::runtime_error);
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_mappedqtree_get)
+{
+    BOOST_TEST_MESSAGE("* Testing mapped QuadTree-based rastermask point "
+                       "queries.");
+
+    namespace fs = boost::filesystem;
+
+    math::Size2 size(1000, 700);
+    boost::random::mt19937 gen;
+    const auto src(randomMask(size, gen));
+
+    const auto path(fs::temp_directory_path()
+                    / fs::unique_path("rastermask-%%%%-%%%%.mqmask"));
+    {
+        std::ofstream f(path.string(), std::ios::binary);
+        imgproc::mappedqtree::RasterMask::write(f, src);
+    }
+
+    const imgproc::mappedqtree::RasterMask mask(path);
+    fs::remove(path);
+
+    // mapped mask covers whole tree area, compare only inside source mask
+    for (int j(0); j < size.height; ++j) {
+        for (int i(0); i < size.width; ++i) {
+            BOOST_REQUIRE_EQUAL(mask.get(i, j), src.get(i, j));
+        }
+    }
+
+    const auto treeSize(mask.size());
+    BOOST_REQUIRE(!mask.get(-1, 0));
+    BOOST_REQUIRE(!mask.get(0, -1));
+    BOOST_REQUIRE(!mask.get(treeSize.width, 0));
+    BOOST_REQUIRE(!mask.get(0, treeSize.height));
+
+    // batched queries in random order
+    std::vector<math::Point2i> points;
+    boost::random::uniform_int_distribution<> px(-1, treeSize.width);
+    boost::random::uniform_int_distribution<> py(-1, treeSize.height);
+    for (int i(0); i < 100000; ++i) { points.emplace_back(px(gen), py(gen)); }
+
+    const auto values(mask.get(points));
+    BOOST_REQUIRE_EQUAL(values.size(), points.size());
+    for (std::size_t i(0); i < points.size(); ++i) {
+        BOOST_REQUIRE_EQUAL(values[i], mask.get(points[i](0), points[i](1)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_mappedqtree_writer)
+{
+    BOOST_TEST_MESSAGE("* Testing mapped QuadTree-based rastermask "
+                       "streaming writer.");
+
+    using imgproc::quadtree::RasterMask;
+    namespace mappedqtree = imgproc::mappedqtree;
+
+    math::Size2 size(1000, 700);
+    boost::random::mt19937 gen;
+    const auto random(randomMask(size, gen));
+
+    // reference: same content, black outside mask size
+    RasterMask src(size, RasterMask::InitMode::EMPTY);
+    for (int j(0); j < size.height; ++j) {
+        for (int i(0); i < size.width; ++i) {
+            if (random.get(i, j)) { src.set(i, j, true); }
+        }
+    }
+
+    // reference writer pads by seeking past end -> needs a real file
+    namespace fs = boost::filesystem;
+    const auto path(fs::temp_directory_path()
+                    / fs::unique_path("rastermask-%%%%-%%%%.mqmask"));
+    {
+        std::ofstream f(path.string(), std::ios::binary);
+        f << "prefix";
+        mappedqtree::RasterMask::write(f, src);
+    }
+
+    std::ostringstream ref;
+    {
+        std::ifstream f(path.string(), std::ios::binary);
+        ref << f.rdbuf();
+    }
+
+    const auto sample([&](int x, int y) { return src.get(x, y); });
+
+    // out-of-order tiles are spilled here
+    const auto scratch(fs::temp_directory_path()
+                       / fs::unique_path("rastermask-%%%%-%%%%"));
+    fs::create_directory(scratch);
+
+    for (unsigned int tileDepth : { 0, 3, 6, 12 }) {
+        // rows, fed in bands of different heights
+        std::ostringstream rows;
+        rows << "prefix";
+        mappedqtree::Writer rowWriter(rows, size, tileDepth, scratch);
+        for (int y(0); y < size.height; y += 7) {
+            rowWriter.addRows(sample, std::min(7, size.height - y));
+        }
+        rowWriter.finish();
+        BOOST_REQUIRE(rows.str() == ref.str());
+
+        // scratch file is gone
+        BOOST_REQUIRE(fs::is_empty(scratch));
+
+        // tiles in random order
+        std::ostringstream tiles;
+        tiles << "prefix";
+        mappedqtree::Writer tileWriter(tiles, size, tileDepth);
+        const int ts(tileWriter.tileSize());
+        std::vector<math::Point2i> order;
+        for (int y(0); y * ts < size.height; ++y) {
+            for (int x(0); x * ts < size.width; ++x) {
+                order.emplace_back(x, y);
+            }
+        }
+        for (std::size_t i(order.size()); i > 1; --i) {
+            boost::random::uniform_int_distribution<std::size_t> pick(0, i - 1);
+            std::swap(order[i - 1], order[pick(gen)]);
+        }
+        for (const auto &t : order) { tileWriter.addTile(t(0), t(1), sample); }
+        tileWriter.finish();
+        BOOST_REQUIRE(tiles.str() == ref.str());
+    }
+
+    {
+        // duplicate tiles, both spilled and written
+        std::ostringstream out;
+        mappedqtree::Writer writer(out, size, 6, scratch);
+        writer.addTile(1, 0, sample);
+        BOOST_REQUIRE(!fs::is_empty(scratch));
+        BOOST_REQUIRE_THROW(writer.addTile(1, 0, sample), std::runtime_error);
+        writer.addTile(0, 0, sample);
+        BOOST_REQUIRE_THROW(writer.addTile(1, 0, sample), std::runtime_error);
+    }
+
+    // unfinished writer removes scratch file as well
+    BOOST_REQUIRE(fs::is_empty(scratch));
+    fs::remove_all(scratch);
+
+    const mappedqtree::RasterMask mask(path, 6);
+    fs::remove(path);
+    for (int j(0); j < size.height; ++j) {
+        for (int i(0); i < size.width; ++i) {
+            BOOST_REQUIRE_EQUAL(mask.get(i, j), src.get(i, j));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_mappedqtree_setops)
+{
+    BOOST_TEST_MESSAGE("* Testing mapped QuadTree-based rastermask set "
+                       "operations.");
+
+    using imgproc::quadtree::RasterMask;
+    namespace mappedqtree = imgproc::mappedqtree;
+    namespace fs = boost::filesystem;
+
+    math::Size2 size(1000, 700);
+    boost::random::mt19937 gen;
+    const auto srcA(randomMask(size, gen));
+    const auto srcB(randomMask(size, gen));
+
+    const auto tmp(fs::temp_directory_path()
+                   / fs::unique_path("rastermask-%%%%-%%%%"));
+    const auto write([&](const RasterMask &mask, const std::string &ext)
+                     -> mappedqtree::RasterMask
+    {
+        const auto path(tmp.string() + ext);
+        {
+            std::ofstream f(path, std::ios::binary);
+            mappedqtree::RasterMask::write(f, mask);
+        }
+        mappedqtree::RasterMask mapped(path);
+        fs::remove(path);
+        return mapped;
+    });
+
+    auto a(write(srcA, ".a"));
+    const auto b(write(srcB, ".b"));
+
+    typedef void (*StreamOp)(std::ostream&, const mappedqtree::RasterMask&
+                             , const mappedqtree::RasterMask&);
+    typedef void (*QuadtreeOp)(RasterMask&, const mappedqtree::RasterMask&
+                               , const mappedqtree::RasterMask&);
+
+    const auto check([&](StreamOp streamOp, QuadtreeOp quadtreeOp
+                         , const RasterMask &expected)
+    {
+        const auto path(tmp.string() + ".out");
+        {
+            std::ofstream f(path, std::ios::binary);
+            streamOp(f, a, b);
+        }
+        const mappedqtree::RasterMask mapped(path);
+        fs::remove(path);
+
+        RasterMask quad(size, RasterMask::InitMode::FULL);
+        quadtreeOp(quad, a, b);
+
+        for (int j(0); j < size.height; ++j) {
+            for (int i(0); i < size.width; ++i) {
+                BOOST_REQUIRE_EQUAL(mapped.get(i, j), expected.get(i, j));
+                BOOST_REQUIRE_EQUAL(quad.get(i, j), expected.get(i, j));
+            }
+        }
+
+        // quads crossing mask border must not inflate pixel count
+        BOOST_REQUIRE_EQUAL(expected.count(), whiteCount(expected, size));
+        BOOST_REQUIRE_EQUAL(quad.count(), expected.count());
+        BOOST_REQUIRE_EQUAL(quad.full(), expected.full());
+        BOOST_REQUIRE_EQUAL(quad.empty(), expected.empty());
+    });
+
+    {
+        auto expected(srcA);
+        expected.merge(srcB);
+        check(&mappedqtree::merge, &mappedqtree::merge, expected);
+    }
+
+    {
+        auto expected(srcA);
+        expected.intersect(srcB);
+        check(&mappedqtree::intersect, &mappedqtree::intersect, expected);
+    }
+
+    {
+        auto expected(srcA);
+        expected.subtract(srcB);
+        check(&mappedqtree::subtract, &mappedqtree::subtract, expected);
+    }
+
+    {
+        // full minus b -> copies inverted subtrees of b
+        const RasterMask full(size, RasterMask::InitMode::FULL);
+        a = write(full, ".full");
+        auto expected(full);
+        expected.subtract(srcB);
+        check(&mappedqtree::subtract, &mappedqtree::subtract, expected);
+    }
+}
+
+#if IMGPROC_HAS_OPENCV
+
+BOOST_AUTO_TEST_CASE(rastermask_quadtree_transform)
+{
+    BOOST_TEST_MESSAGE("* Testing QuadTree-based rastermask "
+                       "transformation.");
+
+    using imgproc::quadtree::RasterMask;
+    using imgproc::quadtree::Matrix2x3;
+
+    // reference: output pixel is white iff all source pixels in its kernel
+    // window (clamped to the source) are white
+    auto reference([](const RasterMask &mask, const math::Size2 &size
+                      , const Matrix2x3 &trafo) -> RasterMask
+    {
+        const double kw(trafo(0, 0) / 2.0);
+        const double kh(trafo(1, 1) / 2.0);
+        const int xMax(mask.dims().width - 1);
+        const int yMax(mask.dims().height - 1);
+        auto clamp([](int i, int max) {
+                return std::max(0, std::min(i, max));
+            });
+
+        RasterMask out(size, RasterMask::EMPTY);
+        for (int j(0); j < size.height; ++j) {
+            for (int i(0); i < size.width; ++i) {
+                const double px(trafo(0, 0) * i + trafo(0, 1) * j
+                                + trafo(0, 2));
+                const double py(trafo(1, 0) * i + trafo(1, 1) * j
+                                + trafo(1, 2));
+                bool white(true);
+                for (int y(clamp(std::floor(py - kh), yMax))
+                         , ey(clamp(std::ceil(py + kh), yMax));
+                     white && (y <= ey); ++y)
+                {
+                    for (int x(clamp(std::floor(px - kw), xMax))
+                             , ex(clamp(std::ceil(px + kw), xMax));
+                         white && (x <= ex); ++x)
+                    {
+                        white = mask.get(x, y);
+                    }
+                }
+                if (white) { out.set(i, j); }
+            }
+        }
+        return out;
+    });
+
+    auto trafo([](double a, double b, double c, double d, double e, double f)
+    {
+        Matrix2x3 m(2, 3);
+        m(0, 0) = a; m(0, 1) = b; m(0, 2) = c;
+        m(1, 0) = d; m(1, 1) = e; m(1, 2) = f;
+        return m;
+    });
+
+    // non-power-of-two source
+    const math::Size2 srcSize(300, 200);
+    boost::random::mt19937 gen;
+    const RasterMask src(randomMask(srcSize, gen, 300).asBitfield());
+
+    const double angle(M_PI / 6.0);
+    const std::vector<std::pair<math::Size2, Matrix2x3> > cases = {
+        // scale < 1 (upscaling) with offset
+        { math::Size2(811, 541), trafo(0.37, 0, -3.2, 0, 0.37, 5.7) }
+        // scale 1, subpixel offset
+        , { srcSize, trafo(1, 0, 0.5, 0, 1, -0.5) }
+        // scale > 1 (downscaling), output reaches past the source
+        , { math::Size2(123, 87), trafo(2.6, 0, 1.3, 0, 2.6, 0.4) }
+        // different scale in each axis
+        , { math::Size2(177, 251), trafo(1.7, 0, 0, 0, 0.8, -2.0) }
+        // rotation -> generic (parallel) path
+        , { math::Size2(251, 233)
+            , trafo(1.2 * std::cos(angle), -1.2 * std::sin(angle), 100.0
+                    , 1.2 * std::sin(angle), 1.2 * std::cos(angle), -50.0) }
+    };
+
+    for (const auto &c : cases) {
+        const auto out(imgproc::quadtree::transform(src, c.first, c.second));
+        BOOST_REQUIRE_EQUAL(out.dims().width, c.first.width);
+        BOOST_REQUIRE_EQUAL(out.dims().height, c.first.height);
+        requireSame(out, reference(src, c.first, c.second), c.first);
+        BOOST_REQUIRE_EQUAL(out.count(), whiteCount(out, c.first));
+    }
+}
+
+#endif // IMGPROC_HAS_OPENCV
+
+BOOST_AUTO_TEST_CASE(rastermask_bitfield_wordops)
+{
+    BOOST_TEST_MESSAGE("* Testing bitfield rastermask word-level "
+                       "operations.");
+
+    using imgproc::bitfield::RasterMask;
+
+    // odd width -> rows are not aligned to bytes nor words
+    math::Size2 size(1001, 703);
+    boost::random::mt19937 gen;
+
+    const auto bitfield([&](const imgproc::quadtree::RasterMask &src)
+                        -> RasterMask
+    {
+        RasterMask mask(size, RasterMask::EMPTY);
+        for (int j(0); j < size.height; ++j) {
+            for (int i(0); i < size.width; ++i) {
+                if (src.get(i, j)) { mask.set(i, j); }
+            }
+        }
+        return mask;
+    });
+
+    const auto a(bitfield(randomMask(size, gen)));
+    const auto b(bitfield(randomMask(size, gen)));
+
+    const auto check([&](const RasterMask &mask, bool (*op)(bool, bool))
+    {
+        std::size_t count(0);
+        for (int j(0); j < size.height; ++j) {
+            for (int i(0); i < size.width; ++i) {
+                const bool value(op(a.get(i, j), b.get(i, j)));
+                BOOST_REQUIRE_EQUAL(mask.get(i, j), value);
+                count += value;
+            }
+        }
+        BOOST_REQUIRE_EQUAL(mask.size(), count);
+
+        auto recounted(mask);
+        recounted.recount();
+        BOOST_REQUIRE_EQUAL(recounted.size(), count);
+    });
+
+    {
+        auto mask(a);
+        mask.merge(b);
+        check(mask, [](bool a, bool b) { return a || b; });
+    }
+
+    {
+        auto mask(a);
+        mask.intersect(b);
+        check(mask, [](bool a, bool b) { return a && b; });
+    }
+
+    {
+        auto mask(a);
+        mask.subtract(b);
+        check(mask, [](bool a, bool b) { return a && !b; });
+    }
+
+    {
+        auto mask(a);
+        mask.invert();
+        check(mask, [](bool a, bool) { return !a; });
+    }
+
+    {
+        const auto boundary(a.boundary());
+        std::size_t count(0);
+        for (int j(0); j < size.height; ++j) {
+            for (int i(0); i < size.width; ++i) {
+                BOOST_REQUIRE_EQUAL(boundary.get(i, j), a.onBoundary(i, j));
+                count += boundary.get(i, j);
+            }
+        }
+        BOOST_REQUIRE_EQUAL(boundary.size(), count);
+    }
+
+    RasterMask other(size.width + 1, size.height);
+    BOOST_REQUIRE_THROW(other.merge(a), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_quadtree_bitfield_conversion)
+{
+    BOOST_TEST_MESSAGE("* Testing QuadTree-based rastermask <-> bitfield "
+                       "conversion.");
+
+    using imgproc::quadtree::RasterMask;
+    const RasterMask::Parallel parallel(3);
+
+    for (const math::Size2 size : { math::Size2(1001, 703)
+                                    , math::Size2(1024, 1024)
+                                    , math::Size2(3, 700) })
+    {
+        boost::random::mt19937 gen;
+        const auto src(randomMask(size, gen));
+
+        for (const auto &bf : { src.asBitfield(), src.asBitfield(parallel) }) {
+            BOOST_REQUIRE_EQUAL(bf.size(), whiteCount(src, size));
+            requireSame(bf, src, size);
+
+            const RasterMask serial(bf);
+            BOOST_REQUIRE_EQUAL(serial.count(), bf.size());
+            requireSame(serial, src, size);
+
+            const RasterMask par(bf, parallel);
+            BOOST_REQUIRE_EQUAL(par.count(), bf.size());
+            requireSame(par, src, size);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_quadtree_morphology)
+{
+    BOOST_TEST_MESSAGE("* Testing QuadTree-based rastermask erosion and "
+                       "dilation.");
+
+    using imgproc::quadtree::RasterMask;
+
+    for (const math::Size2 size : { math::Size2(257, 130)
+                                    , math::Size2(128, 128) })
+    {
+        boost::random::mt19937 gen;
+        // round trip through bitfield drops white quads outside of mask
+        const RasterMask src(randomMask(size, gen, 300).asBitfield());
+
+        for (unsigned int radius : { 0, 1, 3, 17 }) {
+            const int r(radius);
+
+            // brute force: any/all pixels in clamped window
+            RasterMask dilated(size, RasterMask::EMPTY);
+            RasterMask eroded(size, RasterMask::EMPTY);
+            for (int j(0); j < size.height; ++j) {
+                for (int i(0); i < size.width; ++i) {
+                    bool any(false), all(true);
+                    for (int y(std::max(0, j - r))
+                             , ey(std::min(size.height - 1, j + r));
+                         y <= ey; ++y)
+                    {
+                        for (int x(std::max(0, i - r))
+                                 , ex(std::min(size.width - 1, i + r));
+                             x <= ex; ++x)
+                        {
+                            const bool value(src.get(x, y));
+                            any |= value;
+                            all &= value;
+                        }
+                    }
+                    dilated.set(i, j, any);
+                    eroded.set(i, j, all);
+                }
+            }
+
+            RasterMask d(src);
+            dilate(d, radius);
+            BOOST_REQUIRE_EQUAL(d.count(), dilated.count());
+            requireSame(d, dilated, size);
+
+            RasterMask e(src);
+            erode(e, radius);
+            BOOST_REQUIRE_EQUAL(e.count(), eroded.count());
+            requireSame(e, eroded, size);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_distance_transform)
+{
+    BOOST_TEST_MESSAGE("* Testing distance transform of raster masks.");
+
+    using imgproc::quadtree::RasterMask;
+    namespace gil = boost::gil;
+
+    for (const math::Size2 size : { math::Size2(301, 97)
+                                    , math::Size2(64, 64) })
+    {
+        boost::random::mt19937 gen;
+        const RasterMask src(randomMask(size, gen, 60).asBitfield());
+
+        gil::gray32f_image_t f(size.width, size.height);
+        gil::gray16_image_t u(size.width, size.height);
+        gil::gray16_image_t uq(size.width, size.height);
+        imgproc::distanceTransform(src, gil::view(f));
+        imgproc::distanceTransform(src.asBitfield(), gil::view(u));
+        imgproc::distanceTransform(src, gil::view(uq));
+
+        // brute force
+        std::vector<math::Point2i> valid;
+        src.forEach([&](int x, int y, bool)
+        {
+            if ((x < size.width) && (y < size.height)) {
+                valid.emplace_back(x, y);
+            }
+        }, RasterMask::Filter::white);
+        BOOST_REQUIRE(!valid.empty());
+
+        for (int j(0); j < size.height; ++j) {
+            for (int i(0); i < size.width; ++i) {
+                double d2(std::numeric_limits<double>::max());
+                for (const auto &p : valid) {
+                    const double dx(p(0) - i), dy(p(1) - j);
+                    d2 = std::min(d2, dx * dx + dy * dy);
+                }
+                const auto d(std::sqrt(d2));
+                BOOST_REQUIRE_CLOSE(double(gil::view(f)(i, j)[0]) + 1.0
+                                    , d + 1.0, 1e-4);
+                BOOST_REQUIRE_EQUAL(gil::view(u)(i, j)[0], std::round(d));
+                BOOST_REQUIRE_EQUAL(gil::view(uq)(i, j)[0], std::round(d));
+            }
+        }
+    }
+
+    {
+        // empty mask
+        const imgproc::bitfield::RasterMask empty
+            (math::Size2(10, 5), imgproc::bitfield::RasterMask::EMPTY);
+        gil::gray32f_image_t f(10, 5);
+        gil::gray16_image_t u(10, 5);
+        imgproc::distanceTransform(empty, gil::view(f));
+        imgproc::distanceTransform(empty, gil::view(u));
+        BOOST_REQUIRE(std::isinf(float(gil::view(f)(3, 2)[0])));
+        BOOST_REQUIRE_EQUAL(gil::view(u)(3, 2)[0], 65535);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_quadtree_pyramid)
+{
+    BOOST_TEST_MESSAGE("* Testing QuadTree-based rastermask pyramid.");
+
+    using imgproc::quadtree::RasterMask;
+
+    for (const math::Size2 size : { math::Size2(301, 97)
+                                    , math::Size2(128, 128)
+                                    , math::Size2(1, 5) })
+    {
+        boost::random::mt19937 gen;
+        const RasterMask src(randomMask(size, gen, 500).asBitfield());
+
+        for (const RasterMask::Coverage coverage
+                 : { RasterMask::Coverage(RasterMask::Coverage::any)
+                     , RasterMask::Coverage(RasterMask::Coverage::all)
+                     , RasterMask::Coverage
+                     (RasterMask::Coverage::threshold, 0.3) })
+        {
+            const auto levels(src.pyramid(coverage));
+            const auto bfLevels(src.bitfieldPyramid(coverage));
+            BOOST_REQUIRE_EQUAL(levels.size(), src.depth() + 1);
+            BOOST_REQUIRE_EQUAL(bfLevels.size(), levels.size());
+
+            for (std::size_t l(0); l < levels.size(); ++l) {
+                const auto &level(levels[l]);
+                const int block(1 << l);
+                const math::Size2 ls((size.width + block - 1) / block
+                                     , (size.height + block - 1) / block);
+                BOOST_REQUIRE_EQUAL(level.dims().width, ls.width);
+                BOOST_REQUIRE_EQUAL(level.dims().height, ls.height);
+
+                // brute force
+                RasterMask expect(ls, RasterMask::EMPTY);
+                for (int j(0); j < ls.height; ++j) {
+                    for (int i(0); i < ls.width; ++i) {
+                        unsigned long long white(0), total(0);
+                        for (int y(j * block)
+                                 , ey(std::min(size.height, y + block));
+                             y < ey; ++y)
+                        {
+                            for (int x(i * block)
+                                     , ex(std::min(size.width, x + block));
+                                 x < ex; ++x)
+                            {
+                                white += src.get(x, y);
+                                ++total;
+                            }
+                        }
+                        expect.set(i, j, coverage(white, total));
+                    }
+                }
+
+                BOOST_REQUIRE_EQUAL(level.count(), expect.count());
+                requireSame(level, expect, ls);
+                BOOST_REQUIRE_EQUAL(bfLevels[l].size(), expect.count());
+                requireSame(bfLevels[l], expect, ls);
+            }
+        }
+    }
+}
+
+namespace {
+
+struct Span {
+    unsigned int y, x0, x1;
+    bool white;
+};
+
+/** Collects spans generated by forEachSpan.
+ */
+struct SpanCollector {
+    std::vector<Span> &spans;
+
+    void operator()(unsigned int y, unsigned int x0, unsigned int x1
+                    , bool white) const
+    {
+        spans.push_back({ y, x0, x1, white });
+    }
+};
+
+/** Checks that spans cover rows [y0, y1) x [x0, x1) of mask exactly and are
+ *  maximal.
+ */
+template <typename Mask>
+void checkSpans(const Mask &mask, int x0, int y0, int x1, int y1
+                , const std::vector<Span> &spans)
+{
+    int y(y0 - 1), x(x1);
+    bool last(false);
+    for (const auto &span : spans) {
+        if (int(span.y) != y) {
+            BOOST_REQUIRE_EQUAL(x, x1);
+            BOOST_REQUIRE_EQUAL(int(span.y), y + 1);
+            y = span.y;
+            x = x0;
+        } else {
+            BOOST_REQUIRE(span.white != last);
+        }
+
+        BOOST_REQUIRE_EQUAL(int(span.x0), x);
+        BOOST_REQUIRE(span.x1 > span.x0);
+        for (; x < int(span.x1); ++x) {
+            BOOST_REQUIRE_EQUAL(mask.get(x, y), span.white);
+        }
+        last = span.white;
+    }
+    BOOST_REQUIRE_EQUAL(y, y1 - 1);
+    BOOST_REQUIRE_EQUAL(x, x1);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(rastermask_spans)
+{
+    BOOST_TEST_MESSAGE("* Testing span iteration over QuadTree-based "
+                       "rastermasks.");
+
+    namespace fs = boost::filesystem;
+    using imgproc::quadtree::RasterMask;
+
+    math::Size2 size(1000, 700);
+    boost::random::mt19937 gen;
+    const auto src(randomMask(size, gen));
+
+    std::vector<Span> spans;
+    src.forEachSpan(SpanCollector{spans});
+    checkSpans(src, 0, 0, size.width, size.height, spans);
+
+    // white spans only
+    unsigned long long white(0);
+    src.forEachSpan([&](unsigned int, unsigned int x0, unsigned int x1
+                        , bool value)
+    {
+        BOOST_REQUIRE(value);
+        white += x1 - x0;
+    }, RasterMask::Filter::white);
+    BOOST_REQUIRE_EQUAL(white, whiteCount(src, size));
+
+    const auto path(fs::temp_directory_path()
+                    / fs::unique_path("rastermask-%%%%-%%%%.mqmask"));
+    {
+        std::ofstream f(path.string(), std::ios::binary);
+        imgproc::mappedqtree::RasterMask::write(f, src);
+    }
+
+    const imgproc::mappedqtree::RasterMask mask(path);
+    fs::remove(path);
+
+    typedef imgproc::mappedqtree::RasterMask::Extents Extents;
+    const auto treeSize(mask.size());
+
+    spans.clear();
+    mask.forEachSpan(SpanCollector{spans});
+    checkSpans(mask, 0, 0, treeSize.width, treeSize.height, spans);
+
+    spans.clear();
+    mask.forEachSpan(SpanCollector{spans}, Extents(13, 100, 517, 513));
+    checkSpans(mask, 13, 100, 517, 513, spans);
+
+    // extents are clipped to tree
+    spans.clear();
+    mask.forEachSpan(SpanCollector{spans}, Extents(900, 600, 5000, 5000));
+    checkSpans(mask, 900, 600, treeSize.width, treeSize.height, spans);
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_frozenqtree)
+{
+    BOOST_TEST_MESSAGE("* Testing frozen QuadTree-based rastermask.");
+
+    namespace frozenqtree = imgproc::frozenqtree;
+
+    boost::random::mt19937 gen;
+
+    // small mask gets table at full depth, large one does not
+    for (const auto &size : { math::Size2(50, 30), math::Size2(1000, 700) }) {
+        const imgproc::quadtree::RasterMask
+            src(randomMask(size, gen).asBitfield());
+        const frozenqtree::RasterMask mask(src);
+
+        BOOST_REQUIRE_EQUAL(mask.count(), src.count());
+        requireSame(mask, src, size);
+        requireSame(mask.asQuadtree(), src, size);
+
+        unsigned long long white(0);
+        mask.forEachQuad([&](unsigned int x, unsigned int y
+                             , unsigned int xsize, unsigned int ysize, bool)
+        {
+            for (unsigned int j(y); j < y + ysize; ++j) {
+                for (unsigned int i(x); i < x + xsize; ++i) {
+                    BOOST_REQUIRE(src.get(i, j));
+                }
+            }
+            white += (unsigned long long)(xsize) * ysize;
+        }, frozenqtree::RasterMask::Filter::white);
+        BOOST_REQUIRE_EQUAL(white, whiteCount(src, size));
+
+        std::vector<Span> spans;
+        mask.forEachSpan(SpanCollector{spans});
+        checkSpans(src, 0, 0, size.width, size.height, spans);
+
+        // concurrent readers of one snapshot (and its copies)
+        std::vector<unsigned long long> counts(4);
+        std::vector<std::thread> threads;
+        for (std::size_t t(0); t < counts.size(); ++t) {
+            threads.emplace_back([&, t]()
+            {
+                const frozenqtree::RasterMask copy(mask);
+                counts[t] = whiteCount((t & 1) ? copy : mask, size);
+            });
+        }
+        for (auto &thread : threads) { thread.join(); }
+        for (auto count : counts) {
+            BOOST_REQUIRE_EQUAL(count, src.count());
+        }
+    }
+}
+
+namespace {
+
+/** Reference point in polygon test (even-odd rule, same half-open sampling
+ *  as imgproc::Rasterizer).
+ */
+bool insideRing(const math::Points2 &ring, double x, double y)
+{
+    bool inside(false);
+    for (std::size_t i(0), e(ring.size()); i < e; ++i) {
+        const auto &a(ring[i]);
+        const auto &b(ring[(i + 1) % e]);
+        if ((a(1) <= y) == (b(1) <= y)) { continue; }
+        const auto cx(a(0) + (y - a(1)) * (b(0) - a(0)) / (b(1) - a(1)));
+        if (cx <= x) { inside = !inside; }
+    }
+    return inside;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(rastermask_rasterize)
+{
+    BOOST_TEST_MESSAGE("* Testing polygon rasterization into QuadTree-based "
+                       "rastermask.");
+
+    using imgproc::quadtree::RasterMask;
+
+    const math::Size2 size(300, 200);
+    boost::random::mt19937 gen;
+
+    // coordinates on quarter-pixel grid, partly outside of mask: many
+    // samples lie exactly on edges or vertices
+    boost::random::uniform_int_distribution<> xDist(-40, 4 * 340);
+    boost::random::uniform_int_distribution<> yDist(-40, 4 * 240);
+    auto point([&]() { return math::Point2(xDist(gen) / 4.0
+                                           , yDist(gen) / 4.0); });
+
+    auto check([&](const RasterMask &src, const RasterMask &mask, bool value
+                   , const std::function<bool(double, double)> &inside)
+    {
+        for (int j(0); j < size.height; ++j) {
+            for (int i(0); i < size.width; ++i) {
+                BOOST_REQUIRE_EQUAL(mask.get(i, j)
+                                    , inside(i, j) ? value : src.get(i, j));
+            }
+        }
+        BOOST_REQUIRE_EQUAL(mask.count(), whiteCount(mask, size));
+    });
+
+    for (int round(0); round < 20; ++round) {
+        const RasterMask src(randomMask(size, gen, 200).asBitfield());
+
+        // self-intersecting polygon and polygon with hole
+        math::Polygon polygon;
+        for (int i(0); i < 3 + round; ++i) { polygon.push_back(point()); }
+        const math::MultiPolygon rings{ polygon, { point(), point(), point() }
+                                        , { point(), point(), point() } };
+
+        for (bool value : { true, false }) {
+            RasterMask mask(src);
+            imgproc::quadtree::rasterizePolygon(mask, polygon, value);
+            check(src, mask, value, [&](double x, double y) {
+                    return insideRing(polygon, x, y);
+                });
+
+            mask = src;
+            imgproc::quadtree::rasterizePolygon(mask, rings, value);
+            check(src, mask, value, [&](double x, double y) {
+                    bool inside(false);
+                    for (const auto &ring : rings) {
+                        inside ^= insideRing(ring, x, y);
+                    }
+                    return inside;
+                });
+        }
+
+        // regular grid mesh (shared edges) and random overlapping triangles
+        // of both orientations
+        math::Points2 vertices;
+        for (int j(0); j < 5; ++j) {
+            for (int i(0); i < 5; ++i) {
+                vertices.emplace_back(-10.5 + i * 63.25, -3 + j * 47.75);
+            }
+        }
+        std::vector<std::size_t> indices;
+        for (int j(0); j < 4; ++j) {
+            for (int i(0); i < 4; ++i) {
+                const std::size_t v(j * 5 + i);
+                indices.insert(indices.end(), { v, v + 1, v + 6 });
+                indices.insert(indices.end(), { v, v + 6, v + 5 });
+            }
+        }
+        for (int i(0); i < round; ++i) {
+            for (int k(0); k < 3; ++k) {
+                indices.push_back(vertices.size());
+                vertices.push_back(point());
+            }
+        }
+
+        RasterMask mask(src);
+        imgproc::quadtree::rasterizeTriangles(mask, vertices, indices);
+        check(src, mask, true, [&](double x, double y) {
+                for (std::size_t i(0); i < indices.size(); i += 3) {
+                    if (insideRing({ vertices[indices[i]]
+                                    , vertices[indices[i + 1]]
+                                    , vertices[indices[i + 2]] }, x, y))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            });
+    }
+
+    // huge polygon covering whole mask
+    RasterMask mask(size, RasterMask::EMPTY);
+    imgproc::quadtree::rasterizePolygon
+        (mask, math::Polygon{ { -1e6, -1e6 }, { 1e6, -1e6 }, { 0, 1e6 } });
+    BOOST_REQUIRE(mask.full());
+
+    BOOST_CHECK_THROW(imgproc::quadtree::rasterizeTriangles
+                      (mask, { { 0, 0 }, { 1, 1 } }, { 0, 1 })
+                      , std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(rastermask_coverage)
+{
+    BOOST_TEST_MESSAGE("* Testing tile coverage of QuadTree-based "
+                       "rastermask.");
+
+    using imgproc::quadtree::RasterMask;
+    using imgproc::quadtree::MaskCoverage;
+    using imgproc::quadtree::TileCoverage;
+
+    boost::random::mt19937 gen;
+
+    // brute force coverage of window (pixels outside of mask are invalid)
+    auto coverage([](const RasterMask &mask, int x1, int y1, int x2, int y2)
+                  -> TileCoverage
+    {
+        bool valid(false), invalid(false);
+        for (int j(y1); j <= y2; ++j) {
+            for (int i(x1); i <= x2; ++i) {
+                (mask.get(i, j) ? valid : invalid) = true;
+            }
+        }
+        return (valid ? (invalid ? TileCoverage::mixed : TileCoverage::valid)
+                : TileCoverage::invalid);
+    });
+
+    for (const auto &size : { math::Size2(50, 30), math::Size2(300, 200) }) {
+        const RasterMask src(randomMask(size, gen, 300).asBitfield());
+
+        for (unsigned int tileDepth : { 0, 2, 4, 5 }) {
+            const MaskCoverage mc(src, tileDepth);
+            const int ts(mc.tileSize());
+            requireSame(mc, src, size);
+
+            // tiles clipped by mask
+            for (int y(0); y < size.height; y += ts) {
+                for (int x(0); x < size.width; x += ts) {
+                    const int x2(std::min(x + ts, size.width) - 1);
+                    const int y2(std::min(y + ts, size.height) - 1);
+                    const auto c(coverage(src, x, y, x2, y2));
+                    BOOST_REQUIRE(mc.tile(x, y) == c);
+                    BOOST_REQUIRE(mc.tile(x2, y2) == c);
+                    BOOST_REQUIRE(mc.window(x, y, x2, y2) == c);
+                }
+            }
+            BOOST_REQUIRE(mc.tile(-1, 0) == TileCoverage::invalid);
+            BOOST_REQUIRE(mc.tile(0, size.height) == TileCoverage::invalid);
+
+            // random windows, partly outside of mask: valid/invalid must be
+            // exact, mixed is always allowed
+            boost::random::uniform_int_distribution<>
+                xDist(-8, size.width + 8), yDist(-8, size.height + 8)
+                , sDist(0, 12);
+            for (int i(0); i < 2000; ++i) {
+                const int x1(xDist(gen)), y1(yDist(gen));
+                const int x2(x1 + sDist(gen)), y2(y1 + sDist(gen));
+                const auto c(mc.window(x1, y1, x2, y2));
+                if (c != TileCoverage::mixed) {
+                    BOOST_REQUIRE(c == coverage(src, x1, y1, x2, y2));
+                }
+            }
+        }
+    }
+
+    const RasterMask full(math::Size2(40, 40), RasterMask::FULL);
+    const MaskCoverage mc(full);
+    BOOST_REQUIRE(mc.window(0, 0, 39, 39) == TileCoverage::valid);
+    BOOST_REQUIRE(mc.window(-1, 0, 39, 39) == TileCoverage::mixed);
+    BOOST_REQUIRE(mc.window(40, 0, 45, 39) == TileCoverage::invalid);
+
+    BOOST_CHECK_THROW(MaskCoverage(full, 16), std::runtime_error);
+}
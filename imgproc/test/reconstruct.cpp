@@ -0,0 +1,459 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <cstdlib>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+#if IMGPROC_HAS_OPENCV
+#include <opencv2/core/core.hpp>
+#endif
+
+#include "math/filters.hpp"
+
+#include "imgproc/reconstruct.hpp"
+#include "imgproc/rastermask/quadtree.hpp"
+#include "imgproc/rastermask/frozenqtree.hpp"
+#include "imgproc/rastermask/coverage.hpp"
+
+namespace gil = boost::gil;
+
+namespace {
+
+/** Fills image with random noise over a smooth gradient.
+ */
+template <typename View>
+void randomImage(const View &view, boost::random::mt19937 &gen)
+{
+    typedef typename gil::channel_type<View>::type channel_type;
+    const int max(gil::channel_traits<channel_type>::max_value());
+    boost::random::uniform_int_distribution<> noise(0, max / 4);
+
+    for (int y(0); y < view.height(); ++y) {
+        for (int x(0); x < view.width(); ++x) {
+            auto &pixel(view(x, y));
+            for (int c(0); c < int(gil::num_channels<View>::value); ++c) {
+                pixel[c] = ((x * 37 + y * 11 + c * 101) % (max / 2))
+                    + noise(gen);
+            }
+        }
+    }
+}
+
+/** Generates partly valid mask from random quads.
+ */
+imgproc::quadtree::RasterMask randomMask(const math::Size2 &size
+                                         , boost::random::mt19937 &gen
+                                         , int quads = 300)
+{
+    using imgproc::quadtree::RasterMask;
+    RasterMask mask(size, RasterMask::InitMode::EMPTY);
+
+    const int depth(mask.depth());
+    boost::random::uniform_int_distribution<> depthDist
+        (std::max(0, depth - 6), depth);
+    boost::random::uniform_int_distribution<> valueDist(0, 1);
+
+    for (int i(0); i < quads; ++i) {
+        const auto d(depthDist(gen));
+        boost::random::uniform_int_distribution<> xyDist(0, (1 << d) - 1);
+        const auto x(xyDist(gen));
+        const auto y(xyDist(gen));
+        mask.setQuad(d, x, y, valueDist(gen));
+    }
+
+    return mask;
+}
+
+/** Random sampling positions, some windows reach outside of the raster.
+ */
+std::vector<math::Point2> randomPositions(const math::Size2 &size
+                                          , boost::random::mt19937 &gen
+                                          , int count = 20000)
+{
+    boost::random::uniform_real_distribution<> xDist(-3.0, size.width + 2.0);
+    boost::random::uniform_real_distribution<> yDist(-3.0, size.height + 2.0);
+    std::vector<math::Point2> positions;
+    for (int i(0); i < count; ++i) {
+        positions.emplace_back(xDist(gen), yDist(gen));
+    }
+    return positions;
+}
+
+/** Reconstructed pixel: validity and channel values.
+ */
+struct Sample {
+    bool valid;
+    double value[4];
+
+    bool operator==(const Sample &o) const {
+        if (valid != o.valid) { return false; }
+        if (!valid) { return true; }
+        return std::equal(value, value + 4, o.value);
+    }
+};
+
+template <typename ConstRaster, typename Filter2>
+Sample sample(const ConstRaster &raster, const Filter2 &filter
+              , const math::Point2 &pos)
+{
+    Sample s{ false, { 0.0, 0.0, 0.0, 0.0 } };
+    s.valid = imgproc::reconstruct
+        (raster, filter, pos, [&](int c, double value) {
+            s.value[c] = value;
+        });
+    return s;
+}
+
+/** Compares reconstruction of raster with reconstruction of the same data
+ *  behind a full mask. Interior windows take the interleaved fast path in
+ *  the former and the generic path in the latter, windows reaching outside
+ *  take the generic path in both.
+ */
+template <typename Raster, typename MaskedRaster>
+void checkInterleaved(const Raster &raster, const MaskedRaster &masked
+                      , boost::random::mt19937 &gen)
+{
+    static_assert(imgproc::detail::InterleavedRaster<Raster>::value
+                  , "Raster must be interleaved.");
+    static_assert(!imgproc::detail::InterleavedRaster<MaskedRaster>::value
+                  , "Masked raster must not be interleaved.");
+
+    const math::Size2 size(raster.width(), raster.height());
+    const auto positions(randomPositions(size, gen, 5000));
+    int interleaved(0), uncapped(0), different(0), total(0);
+    double maxDiff(0.0);
+
+    // last filter is too tall for the fast path
+    const std::pair<double, double> windows[] = {
+        { 2.0, 2.0 }, { 5.3, 5.3 }, { 11.7, 11.7 }, { 2.0, 17.5 }
+    };
+
+    for (const auto &window : windows) {
+        const math::SincHamming2 filter(window.first, window.second);
+
+        for (const auto &pos : positions) {
+            // window as computed by reconstruct()
+            const int x1(std::floor(pos(0) - filter.halfwinx()));
+            const int x2(std::ceil (pos(0) + filter.halfwinx()));
+            const int y1(std::floor(pos(1) - filter.halfwiny()));
+            const int y2(std::ceil (pos(1) + filter.halfwiny()));
+            double weight, value[4];
+            const bool fastPath(imgproc::detail::reconstructInterleaved
+                                (raster, filter, pos, x1, y1, x2, y2
+                                 , weight, value, std::true_type()));
+
+            if (((x2 - x1 + 1) > imgproc::detail::InterleavedMaxTaps)
+                || ((y2 - y1 + 1) > imgproc::detail::InterleavedMaxTaps))
+            {
+                // window exceeds fast path limits
+                BOOST_REQUIRE(!fastPath);
+            } else {
+                interleaved += fastPath;
+                ++uncapped;
+            }
+
+            const auto fast(sample(raster, filter, pos));
+            const auto generic(sample(masked, filter, pos));
+            BOOST_REQUIRE(fast.valid == generic.valid);
+            if (!fast.valid) { continue; }
+            ++total;
+
+            // value variant gives the same as the write variant
+            const auto v(imgproc::reconstruct(raster, filter, pos));
+            double diff(0.0);
+            for (int c(0); c < raster.channels(); ++c) {
+                BOOST_REQUIRE(double(v[c]) == fast.value[c]);
+                diff = std::max(diff, std::abs(fast.value[c]
+                                               - generic.value[c]));
+            }
+            maxDiff = std::max(maxDiff, diff);
+            different += (diff > 0.0);
+        }
+    }
+
+    BOOST_TEST_MESSAGE("    " << raster.channels() << " channel(s): "
+                       << interleaved << " of " << total
+                       << " fast, " << different << " different");
+
+    // most windows within fast path limits are interior
+    BOOST_REQUIRE(interleaved > uncapped / 2);
+
+    // fast path gives exactly the same result
+    BOOST_REQUIRE_EQUAL(maxDiff, 0.0);
+    BOOST_REQUIRE_EQUAL(different, 0);
+}
+
+template <typename Image>
+void checkInterleavedGil(const math::Size2 &size
+                         , const imgproc::quadtree::RasterMask &full
+                         , boost::random::mt19937 &gen)
+{
+    Image image(size.width, size.height);
+    randomImage(gil::view(image), gen);
+    const auto view(gil::const_view(image));
+
+    checkInterleaved(imgproc::gilConstRaster(view)
+                     , imgproc::gilConstRaster(view, full), gen);
+}
+
+#if IMGPROC_HAS_OPENCV
+
+template <typename ValueType, typename Channel>
+void checkInterleavedCv(const math::Size2 &size, int type
+                        , const imgproc::quadtree::RasterMask &full
+                        , boost::random::mt19937 &gen)
+{
+    typedef typename imgproc::CvConstRaster<ValueType>::value_type Pixel;
+    const int max(std::numeric_limits<Channel>::max());
+    boost::random::uniform_int_distribution<> noise(0, max / 4);
+
+    cv::Mat mat(size.height, size.width, type);
+    for (int y(0); y < size.height; ++y) {
+        for (int x(0); x < size.width; ++x) {
+            auto &pixel(mat.at<Pixel>(y, x));
+            for (int c(0); c < mat.channels(); ++c) {
+                pixel[c] = ((x * 37 + y * 11 + c * 101) % (max / 2))
+                    + noise(gen);
+            }
+        }
+    }
+
+    checkInterleaved(imgproc::CvConstRaster<ValueType>(mat)
+                     , imgproc::cvConstRaster<ValueType>(mat, full), gen);
+}
+
+#endif // IMGPROC_HAS_OPENCV
+
+/** Raster wrapper counting valid() calls.
+ */
+template <typename Raster>
+class CountingRaster : public Raster {
+public:
+    CountingRaster(const Raster &raster) : Raster(raster), calls_() {}
+
+    bool valid(int x, int y) const {
+        ++calls_;
+        return Raster::valid(x, y);
+    }
+
+    int calls() const { return calls_; }
+    void reset() const { calls_ = 0; }
+
+private:
+    mutable int calls_;
+};
+
+/** Compares reconstruction of coverage-masked raster with reconstruction of
+ *  masked raster with the same data and mask. Checks that windows fully
+ *  outside of mask are undefined without any pixel validation and that
+ *  pixels are not validated in fully valid windows either.
+ */
+template <typename CoverageRaster, typename MaskedRaster>
+void checkCoverage(const CoverageRaster &coverageRaster
+                   , const MaskedRaster &masked
+                   , boost::random::mt19937 &gen)
+{
+    const CountingRaster<CoverageRaster> raster(coverageRaster);
+
+    const math::Size2 size(raster.width(), raster.height());
+    const auto positions(randomPositions(size, gen));
+    int invalid(0), valid(0), defined(0);
+
+    for (const double window : { 2.0, 5.3 }) {
+        const math::SincHamming2 filter(window, window);
+
+        for (const auto &pos : positions) {
+            // window as computed by reconstruct()
+            const int x1(std::floor(pos(0) - filter.halfwinx()));
+            const int x2(std::ceil (pos(0) + filter.halfwinx()));
+            const int y1(std::floor(pos(1) - filter.halfwiny()));
+            const int y2(std::ceil (pos(1) + filter.halfwiny()));
+            const int total((x2 - x1 + 1) * (y2 - y1 + 1));
+            const auto coverage(raster.coverage(x1, y1, x2, y2));
+
+            raster.reset();
+            const auto s(sample(raster, filter, pos));
+            BOOST_REQUIRE(s == sample(masked, filter, pos));
+            defined += s.valid;
+
+            switch (coverage) {
+            case imgproc::quadtree::TileCoverage::invalid:
+                ++invalid;
+                BOOST_REQUIRE(!s.valid);
+                BOOST_REQUIRE(!raster.calls());
+                break;
+
+            case imgproc::quadtree::TileCoverage::valid:
+                ++valid;
+                BOOST_REQUIRE(!raster.calls());
+                break;
+
+            case imgproc::quadtree::TileCoverage::mixed:
+                BOOST_REQUIRE(raster.calls() == total);
+                break;
+            }
+
+            // value variant
+            const auto v1(imgproc::reconstruct(raster, filter, pos));
+            const auto v2(imgproc::reconstruct(masked, filter, pos));
+            for (int c(0); c < raster.channels(); ++c) {
+                BOOST_REQUIRE(v1[c] == v2[c]);
+            }
+        }
+    }
+
+    BOOST_TEST_MESSAGE("    " << invalid << " invalid, " << valid
+                       << " valid windows, " << defined
+                       << " defined pixels of " << (2 * positions.size()));
+    BOOST_REQUIRE(invalid > 0);
+    BOOST_REQUIRE(valid > 0);
+    BOOST_REQUIRE(defined > 0);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(reconstruct_frozen_mask)
+{
+    BOOST_TEST_MESSAGE("* Testing reconstruction through frozen quadtree "
+                       "mask.");
+
+    const math::Size2 size(301, 203);
+    boost::random::mt19937 gen;
+
+    gil::rgb8_image_t image(size.width, size.height);
+    randomImage(gil::view(image), gen);
+    const auto view(gil::const_view(image));
+
+    const auto mask(randomMask(size, gen));
+    const imgproc::frozenqtree::RasterMask frozen(mask);
+
+    const auto reference(imgproc::gilConstRaster(view, mask));
+    const auto raster(imgproc::gilConstRaster(view, frozen));
+
+    const math::SincHamming2 filter(4.0, 4.0);
+    const auto positions(randomPositions(size, gen));
+
+    int valid(0);
+    for (const auto &pos : positions) {
+        const auto expected(sample(reference, filter, pos));
+        BOOST_REQUIRE(sample(raster, filter, pos) == expected);
+        valid += expected.valid;
+    }
+
+    // both defined and undefined pixels were sampled
+    BOOST_REQUIRE(valid > 0);
+    BOOST_REQUIRE(valid < int(positions.size()));
+
+    // one snapshot shared by concurrent readers
+    std::vector<std::thread> threads;
+    std::vector<char> same(4);
+    for (std::size_t t(0); t < same.size(); ++t) {
+        threads.emplace_back([&, t]()
+        {
+            const auto r(imgproc::gilConstRaster(view, frozen));
+            bool ok(true);
+            for (std::size_t i(t); i < positions.size(); i += same.size()) {
+                ok = ok && (sample(r, filter, positions[i])
+                            == sample(reference, filter, positions[i]));
+            }
+            same[t] = ok;
+        });
+    }
+    for (auto &thread : threads) { thread.join(); }
+    for (char s : same) { BOOST_REQUIRE(s); }
+}
+
+BOOST_AUTO_TEST_CASE(reconstruct_interleaved)
+{
+    BOOST_TEST_MESSAGE("* Testing interleaved reconstruction fast path.");
+
+    const math::Size2 size(131, 97);
+    boost::random::mt19937 gen;
+
+    using imgproc::quadtree::RasterMask;
+    const RasterMask full(size, RasterMask::InitMode::FULL);
+
+    checkInterleavedGil<gil::gray8_image_t>(size, full, gen);
+    checkInterleavedGil<gil::rgb8_image_t>(size, full, gen);
+    checkInterleavedGil<gil::rgba8_image_t>(size, full, gen);
+    checkInterleavedGil<gil::gray16_image_t>(size, full, gen);
+    checkInterleavedGil<gil::rgb16_image_t>(size, full, gen);
+    checkInterleavedGil<gil::rgba16_image_t>(size, full, gen);
+
+#if IMGPROC_HAS_OPENCV
+    checkInterleavedCv<std::uint8_t, std::uint8_t>
+        (size, CV_8UC1, full, gen);
+    checkInterleavedCv<cv::Vec3b, std::uint8_t>(size, CV_8UC3, full, gen);
+    checkInterleavedCv<cv::Vec4b, std::uint8_t>(size, CV_8UC4, full, gen);
+    checkInterleavedCv<std::uint16_t, std::uint16_t>
+        (size, CV_16UC1, full, gen);
+    checkInterleavedCv<cv::Vec3w, std::uint16_t>(size, CV_16UC3, full, gen);
+    checkInterleavedCv<cv::Vec4w, std::uint16_t>(size, CV_16UC4, full, gen);
+#endif // IMGPROC_HAS_OPENCV
+}
+
+BOOST_AUTO_TEST_CASE(reconstruct_coverage)
+{
+    BOOST_TEST_MESSAGE("* Testing reconstruction with mask coverage.");
+
+    const math::Size2 size(301, 203);
+    boost::random::mt19937 gen;
+
+    const auto mask(randomMask(size, gen));
+    const imgproc::quadtree::MaskCoverage coverage(mask);
+
+    gil::rgb8_image_t image(size.width, size.height);
+    randomImage(gil::view(image), gen);
+    const auto view(gil::const_view(image));
+
+    checkCoverage(imgproc::gilConstRaster(view, coverage)
+                  , imgproc::gilConstRaster(view, mask), gen);
+
+#if IMGPROC_HAS_OPENCV
+    cv::Mat mat(size.height, size.width, CV_16UC3);
+    boost::random::uniform_int_distribution<> noise(0, 65535);
+    for (int y(0); y < size.height; ++y) {
+        for (int x(0); x < size.width; ++x) {
+            auto &pixel(mat.at<cv::Vec3w>(y, x));
+            for (int c(0); c < 3; ++c) { pixel[c] = noise(gen); }
+        }
+    }
+
+    checkCoverage(imgproc::cvConstRaster<cv::Vec3w>(mat, coverage)
+                  , imgproc::cvConstRaster<cv::Vec3w>(mat, mask), gen);
+#endif // IMGPROC_HAS_OPENCV
+}
@@ -0,0 +1,355 @@
+/**
+ * Copyright (c) 2017 Melown Technologies SE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * *  Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#include "imgproc/transformation.hpp"
+#include "imgproc/tabulated-filter.hpp"
+
+namespace gil = boost::gil;
+
+namespace {
+
+/** Fills image with random noise over a smooth gradient.
+ */
+template <typename View>
+void randomImage(const View &view, boost::random::mt19937 &gen, int max)
+{
+    boost::random::uniform_int_distribution<> noise(0, max / 4);
+
+    for (int y(0); y < view.height(); ++y) {
+        for (int x(0); x < view.width(); ++x) {
+            auto &pixel(view(x, y));
+            for (int c(0); c < int(gil::num_channels<View>::value); ++c) {
+                pixel[c] = ((x * 37 + y * 11 + c * 101) % (max / 2))
+                    + noise(gen);
+            }
+        }
+    }
+}
+
+/** Non-separable (radial) filter.
+ */
+class ConeFilter2 {
+public:
+    ConeFilter2(double winx, double winy)
+        : halfwinx_(winx / 2.0), halfwiny_(winy / 2.0)
+    {}
+
+    double halfwinx() const { return halfwinx_; }
+    double halfwiny() const { return halfwiny_; }
+
+    double operator()(double x, double y) const {
+        const double dx(x / halfwinx_);
+        const double dy(y / halfwiny_);
+        return std::max(0.0, 1.0 - std::sqrt(dx * dx + dy * dy));
+    }
+
+private:
+    double halfwinx_;
+    double halfwiny_;
+};
+
+/** Returns maximum absolute channel difference between two views.
+ */
+template <typename View1, typename View2>
+double maxDifference(const View1 &v1, const View2 &v2)
+{
+    double diff(0.0);
+    for (int y(0); y < v1.height(); ++y) {
+        for (int x(0); x < v1.width(); ++x) {
+            for (int c(0); c < int(gil::num_channels<View1>::value); ++c) {
+                diff = std::max(diff, std::abs(double(v1(x, y)[c])
+                                               - double(v2(x, y)[c])));
+            }
+        }
+    }
+    return diff;
+}
+
+/** Resamples src by separable filtering and by reconstruct() in each pixel
+ *  and checks that the results differ by at most tolerance.
+ */
+template <typename Image, typename Mapping2>
+void checkSeparable(const Mapping2 &mapping, const Image &src
+                    , const math::Size2 &dstSize, double tolerance)
+{
+    const imgproc::detail::Tile tile{ 0, 0, dstSize.width, dstSize.height };
+
+    Image separable(dstSize.width, dstSize.height);
+    const imgproc::detail::SeparableFilter<imgproc::DefaultFilter>
+        filter(mapping, dstSize.width, dstSize.height);
+    imgproc::detail::separableTile
+        (filter, gil::const_view(src), gil::view(separable), tile);
+
+    Image generic(dstSize.width, dstSize.height);
+    imgproc::detail::genericTile<imgproc::DefaultFilter>
+        (mapping, gil::const_view(src), gil::view(generic), tile);
+
+    const auto diff(maxDifference(gil::const_view(separable)
+                                  , gil::const_view(generic)));
+    BOOST_TEST_MESSAGE("    " << src.width() << "x" << src.height()
+                       << " -> " << dstSize.width << "x" << dstSize.height
+                       << ": max difference " << diff);
+    BOOST_REQUIRE(diff <= tolerance);
+}
+
+/** Checks separable filtering against reconstruct() for all axis-aligned
+ *  mappings, down- and upscaling. Windows at destination border sample
+ *  outside of source.
+ */
+template <typename Image>
+void checkSeparable(int max, double tolerance)
+{
+    boost::random::mt19937 gen;
+    const math::Size2 srcSize(97, 61);
+    Image src(srcSize.width, srcSize.height);
+    randomImage(gil::view(src), gen, max);
+
+    for (const math::Size2 dstSize
+             : { math::Size2(31, 23), math::Size2(211, 157)
+                 , math::Size2(97, 61) })
+    {
+        checkSeparable(imgproc::Scaling2(dstSize, srcSize)
+                       , src, dstSize, tolerance);
+        checkSeparable(imgproc::GridScaling2(dstSize, srcSize)
+                       , src, dstSize, tolerance);
+
+        // inside, touching top-left corner, touching bottom-right corner
+        for (const imgproc::Crop2 crop
+                 : { imgproc::Crop2(50, 40, 20, 10)
+                     , imgproc::Crop2(30, 20, 0, 0)
+                     , imgproc::Crop2(60, 40, 37, 21) })
+        {
+            checkSeparable(imgproc::ReverseCroppingAndScaling2
+                           (crop, dstSize)
+                           , src, dstSize, tolerance);
+        }
+    }
+}
+
+/** Rotation and scaling around image center, generic (not axis-aligned)
+ *  mapping.
+ */
+class Rotation2 {
+public:
+    Rotation2(const math::Size2 &srcSize, const math::Size2 &dstSize
+              , double angle, double scale)
+        : cos_(std::cos(angle) * scale), sin_(std::sin(angle) * scale)
+        , scale_(scale)
+        , srcCx_(srcSize.width / 2.0), srcCy_(srcSize.height / 2.0)
+        , dstCx_(dstSize.width / 2.0), dstCy_(dstSize.height / 2.0)
+    {}
+
+    math::Point2 map(const math::Point2i &op) const {
+        const double x(op(0) - dstCx_);
+        const double y(op(1) - dstCy_);
+        return math::Point2(srcCx_ + cos_ * x - sin_ * y
+                            , srcCy_ + sin_ * x + cos_ * y);
+    }
+
+    math::Point2 derivatives(const math::Point2i&) const {
+        return math::Point2(scale_, scale_);
+    }
+
+private:
+    double cos_, sin_, scale_;
+    double srcCx_, srcCy_, dstCx_, dstCy_;
+};
+
+/** Checks that tiled parallel transform() gives the same result as the
+ *  serial one.
+ */
+template <typename Image, typename Mapping2>
+void checkParallel(const Mapping2 &mapping, const Image &src
+                   , const math::Size2 &dstSize)
+{
+    Image serial(dstSize.width, dstSize.height);
+    imgproc::transform(mapping, gil::const_view(src), gil::view(serial));
+
+    // tiles not dividing destination, one tile, one pixel wide tiles
+    for (const auto &parallel
+             : { imgproc::TransformParallel(37, 53)
+                 , imgproc::TransformParallel(dstSize.width, dstSize.height)
+                 , imgproc::TransformParallel(1, 19) })
+    {
+        Image tiled(dstSize.width, dstSize.height);
+        imgproc::transform(mapping, gil::const_view(src), gil::view(tiled)
+                           , parallel);
+        BOOST_REQUIRE(maxDifference(gil::const_view(serial)
+                                    , gil::const_view(tiled)) == 0.0);
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(transformation_separable)
+{
+    BOOST_TEST_MESSAGE("* Testing separable filtering against "
+                       "reconstruct().");
+
+    // integral pixels are truncated, float rounding can move value by one
+    checkSeparable<gil::rgb8_image_t>(255, 1.0);
+    checkSeparable<gil::gray16_image_t>(65535, 1.0);
+
+    // float ring holds horizontally filtered values
+    checkSeparable<gil::gray32f_image_t>(255, 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(transformation_nonseparable_filter)
+{
+    BOOST_TEST_MESSAGE("* Testing that non-separable filter is evaluated "
+                       "per pixel.");
+
+    static_assert(imgproc::SeparableFilter2<imgproc::DefaultFilter>::value
+                  , "Default filter is separable.");
+    static_assert(!imgproc::SeparableFilter2<ConeFilter2>::value
+                  , "Cone filter is not separable.");
+
+    boost::random::mt19937 gen;
+    const math::Size2 srcSize(97, 61);
+    const math::Size2 dstSize(41, 29);
+    gil::rgb8_image_t src(srcSize.width, srcSize.height);
+    randomImage(gil::view(src), gen, 255);
+
+    const imgproc::Scaling2 mapping(dstSize, srcSize);
+
+    gil::rgb8_image_t dst(dstSize.width, dstSize.height);
+    imgproc::transform<ConeFilter2>
+        (mapping, gil::const_view(src), gil::view(dst));
+
+    gil::rgb8_image_t expected(dstSize.width, dstSize.height);
+    imgproc::detail::genericTile<ConeFilter2>
+        (mapping, gil::const_view(src), gil::view(expected)
+         , imgproc::detail::Tile{ 0, 0, dstSize.width, dstSize.height });
+
+    BOOST_REQUIRE(maxDifference(gil::const_view(dst)
+                                , gil::const_view(expected)) == 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(transformation_parallel)
+{
+    BOOST_TEST_MESSAGE("* Testing tiled parallel transformation.");
+
+    static_assert(!imgproc::AxisAlignedMapping<Rotation2>::value
+                  , "Rotation is not axis-aligned.");
+
+    boost::random::mt19937 gen;
+    const math::Size2 srcSize(301, 203);
+    gil::rgb8_image_t src(srcSize.width, srcSize.height);
+    randomImage(gil::view(src), gen, 255);
+
+    // destination size and rotation scale (rotated destination stays
+    // inside source)
+    for (const auto &dst
+             : { std::make_pair(math::Size2(113, 71), 1.8)
+                 , std::make_pair(math::Size2(419, 331), 0.4) })
+    {
+        const auto &dstSize(dst.first);
+
+        // separable filtering
+        checkParallel(imgproc::Scaling2(dstSize, srcSize), src, dstSize);
+
+        // per-pixel reconstruction
+        checkParallel(Rotation2(srcSize, dstSize, 0.3, dst.second)
+                      , src, dstSize);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(transformation_tabulated_filter)
+{
+    BOOST_TEST_MESSAGE("* Testing tabulated filter against wrapped filter.");
+
+    typedef imgproc::TabulatedFilter2<math::SincHamming2> Tabulated;
+
+    // linear interpolation with step 1/256 px
+    const double tolerance(1e-4);
+
+    // windows are interleaved to exercise per-thread table cache, each
+    // filter keeps its own tables
+    const std::vector<std::pair<double, double> > windows
+        = { { 2.0, 2.0 }, { 3.7, 5.3 }, { 2.0, 2.0 }, { 8.0, 2.5 } };
+    std::vector<Tabulated> tabulated;
+    for (const auto &w : windows) { tabulated.emplace_back(w.first, w.second); }
+
+    double diff(0.0);
+    for (std::size_t i(0); i < windows.size(); ++i) {
+        const math::SincHamming2 filter(windows[i].first, windows[i].second);
+        const auto &tab(tabulated[i]);
+        BOOST_REQUIRE(tab.halfwinx() == filter.halfwinx());
+        BOOST_REQUIRE(tab.halfwiny() == filter.halfwiny());
+
+        // whole reconstruct() window, i.e. one pixel beyond filter window
+        const double hx(filter.halfwinx() + 1.0);
+        const double hy(filter.halfwiny() + 1.0);
+        for (double y(-hy); y <= hy; y += 0.0173) {
+            for (double x(-hx); x <= hx; x += 0.0131) {
+                diff = std::max(diff, std::abs(tab(x, y) - filter(x, y)));
+            }
+        }
+    }
+    BOOST_TEST_MESSAGE("    max weight difference " << diff);
+    BOOST_REQUIRE(diff <= tolerance);
+
+    boost::random::mt19937 gen;
+    const math::Size2 srcSize(301, 203);
+    gil::rgb8_image_t src(srcSize.width, srcSize.height);
+    randomImage(gil::view(src), gen, 255);
+
+    for (const math::Size2 dstSize
+             : { math::Size2(113, 71), math::Size2(419, 331) })
+    {
+        // separable filtering
+        gil::rgb8_image_t expected(dstSize.width, dstSize.height);
+        imgproc::scale<math::SincHamming2>
+            (gil::const_view(src), gil::view(expected));
+
+        gil::rgb8_image_t dst(dstSize.width, dstSize.height);
+        imgproc::scale<Tabulated>(gil::const_view(src), gil::view(dst));
+
+        BOOST_REQUIRE(maxDifference(gil::const_view(expected)
+                                    , gil::const_view(dst)) <= 1.0);
+
+        // per-pixel reconstruction
+        const Rotation2 rotation
+            (srcSize, dstSize, 0.3, 0.4 * srcSize.width / dstSize.width);
+        imgproc::transform<math::SincHamming2>
+            (rotation, gil::const_view(src), gil::view(expected));
+        imgproc::transform<Tabulated>
+            (rotation, gil::const_view(src), gil::view(dst));
+
+        BOOST_REQUIRE(maxDifference(gil::const_view(expected)
+                                    , gil::const_view(dst)) <= 1.0);
+    }
+}
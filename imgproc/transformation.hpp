@@ -33,14 +33,20 @@
 #ifndef IMGPROC_TRANSFORMATION_HPP
 #define IMGPROC_TRANSFORMATION_HPP
 
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
 #include <type_traits>
 
 #include "dbglog/dbglog.hpp"
+#include "utility/openmp.hpp"
 
 #include "math/math_all.hpp"
 #include "math/boost_gil_all.hpp"
 
 #include "filtering.hpp"
+#include "filter-traits.hpp"
 #include "crop.hpp"
 
 namespace imgproc {
@@ -141,10 +147,29 @@ private:
     float offY_;
 };
 
+/** Marks axis-aligned mappings: mapped x depends only on destination column,
+ *  mapped y only on destination row and derivatives are constant. Such
+ *  mappings are resampled by separable filtering in transform(): filter
+ *  weights are computed once per column and row and image is filtered
+ *  horizontally and then vertically.
+ *
+ *  Separable filtering is used only for filters marked by SeparableFilter2,
+ *  other filters are evaluated per pixel.
+ */
+template <typename Mapping2>
+struct AxisAlignedMapping : std::false_type {};
+
+template <> struct AxisAlignedMapping<Scaling2> : std::true_type {};
+template <> struct AxisAlignedMapping<GridScaling2> : std::true_type {};
+template <>
+struct AxisAlignedMapping<ReverseCroppingAndScaling2> : std::true_type {};
+
 typedef math::SincHamming2 DefaultFilter;
 
 /*
- * Transform between two views using a generic reverse mapping function
+ * Transform between two views using a generic reverse mapping function.
+ * Axis-aligned mappings (see AxisAlignedMapping) are resampled by separable
+ * filtering when filter is separable (see SeparableFilter2).
  */
 template <typename LowPassFilter2, typename Mapping2
           , typename SrcView, typename DstView>
@@ -159,6 +184,35 @@ inline void transform(
         const Mapping2 & mapping,
         const SrcView & view1, const DstView & view2 );
 
+/** Parallel execution settings for transform(), scale() and cropAndScale().
+ *
+ *  Destination view is split into tiles of given size which are processed
+ *  by OpenMP threads. Result is the same as from the serial version.
+ */
+struct TransformParallel {
+    int tileWidth;
+    int tileHeight;
+
+    explicit TransformParallel(int tileWidth = 256, int tileHeight = 256)
+        : tileWidth(tileWidth), tileHeight(tileHeight)
+    {}
+};
+
+/** Transform between two views, parallel version.
+ */
+template <typename LowPassFilter2, typename Mapping2
+          , typename SrcView, typename DstView>
+inline void transform(const Mapping2 &mapping
+                      , const SrcView &view1, const DstView &view2
+                      , const TransformParallel &parallel);
+
+/** Same as above, use DefaultFilter.
+ */
+template <typename Mapping2, typename SrcView, typename DstView>
+inline void transform(const Mapping2 &mapping
+                      , const SrcView &view1, const DstView &view2
+                      , const TransformParallel &parallel);
+
 template <typename LowPassFilter2, typename SrcView, typename DstView>
 inline void scale(const SrcView & view1, const DstView & view2);
 
@@ -167,6 +221,16 @@ inline void scale(const SrcView & view1, const DstView & view2);
 template <typename SrcView, typename DstView>
 inline void scale(const SrcView &view1, const DstView &view2);
 
+/** Parallel versions of the above.
+ */
+template <typename LowPassFilter2, typename SrcView, typename DstView>
+inline void scale(const SrcView &view1, const DstView &view2
+                  , const TransformParallel &parallel);
+
+template <typename SrcView, typename DstView>
+inline void scale(const SrcView &view1, const DstView &view2
+                  , const TransformParallel &parallel);
+
 /** Crop area from src and scale it to fit to dstview.
  *
  *  \param LowPassFilter (template) filter used to reconstruct value in each
@@ -192,20 +256,202 @@ template <typename SrcView, typename DstView, typename T>
 inline void cropAndScale(const SrcView &view1, const DstView &view2
                          , const imgproc::Crop2_<T> &srcCrop);
 
+/** Parallel versions of the above.
+ */
+template <typename LowPassFilter2, typename SrcView, typename DstView
+          , typename T>
+inline void cropAndScale(const SrcView &view1, const DstView &view2
+                         , const imgproc::Crop2_<T> &srcCrop
+                         , const TransformParallel &parallel);
+
+template <typename SrcView, typename DstView, typename T>
+inline void cropAndScale(const SrcView &view1, const DstView &view2
+                         , const imgproc::Crop2_<T> &srcCrop
+                         , const TransformParallel &parallel);
+
 /* implementation */
 
+namespace detail {
+
+/** Filter taps of one axis: source window [lo, lo + size) and its weights
+ *  for each destination column (row). Weight sum includes taps outside of
+ *  source (which sample zero).
+ */
+struct FilterTaps {
+    std::vector<int> lo;
+    std::vector<int> size;
+    std::vector<std::size_t> offset;
+    std::vector<double> weights;
+    std::vector<double> sum;
+    int maxSize;
+
+    template <typename Map, typename Weight>
+    FilterTaps(int count, double halfwin, const Map &map
+               , const Weight &weight)
+        : lo(count), size(count), offset(count), sum(count), maxSize()
+    {
+        for (int i(0); i < count; ++i) {
+            const double pos(map(i));
+            const int l(std::floor(pos - halfwin));
+            const int h(std::ceil(pos + halfwin));
+            lo[i] = l;
+            size[i] = h - l + 1;
+            offset[i] = weights.size();
+            maxSize = std::max(maxSize, size[i]);
+
+            double s(0);
+            for (int t(l); t <= h; ++t) {
+                weights.push_back(weight(t - pos));
+                s += weights.back();
+            }
+            sum[i] = s;
+        }
+    }
+};
+
+/** Filter taps of axis-aligned mapping for all destination columns and rows.
+ *  Valid only for separable filters (weight(x, y) is taken as
+ *  filter(x, 0) * filter(0, y) = filter(x, y) * filter(0, 0); the constant
+ *  factor is normalized out).
+ */
+template <typename LowPassFilter2>
+struct SeparableFilter {
+    LowPassFilter2 filter;
+    FilterTaps x;
+    FilterTaps y;
+
+    template <typename Mapping2>
+    SeparableFilter(const Mapping2 &mapping, int width, int height)
+        : filter(std::max(2.0, 2.0 * mapping.derivatives
+                          (math::Point2i(0, 0))(0))
+                 , std::max(2.0, 2.0 * mapping.derivatives
+                            (math::Point2i(0, 0))(1)))
+        , x(width, filter.halfwinx()
+            , [&](int j) { return mapping.map(math::Point2i(j, 0))(0); }
+            , [this](double d) { return filter(d, 0.0); })
+        , y(height, filter.halfwiny()
+            , [&](int i) { return mapping.map(math::Point2i(0, i))(1); }
+            , [this](double d) { return filter(0.0, d); })
+    {}
+};
+
+/** Destination window [x0, x1) x [y0, y1).
+ */
+struct Tile {
+    int x0, y0, x1, y1;
+};
+
+/** Transformation of one tile by axis-aligned mapping: source rows are
+ *  filtered horizontally into a float scratch ring (each source row once),
+ *  output rows are then filtered vertically from the ring.
+ *
+ *  Gives the same result as filtering each pixel by 2D filter in
+ *  reconstruct() (up to rounding).
+ */
+template <typename LowPassFilter2, typename SrcView, typename DstView>
+inline void separableTile(const SeparableFilter<LowPassFilter2> &filter
+                          , const SrcView &view1, const DstView &view2
+                          , const Tile &tile)
+{
+    typedef typename SrcView::value_type pixel_type;
+    const int numChannels(gil::num_channels<SrcView>::value);
+
+    const int width(tile.x1 - tile.x0);
+    if ((width <= 0) || (tile.y1 <= tile.y0)) { return; }
+
+    const int srcWidth(view1.width());
+    const int srcHeight(view1.height());
+    const auto &xtaps(filter.x);
+    const auto &ytaps(filter.y);
+
+    // ring of horizontally filtered source rows, big enough to hold any
+    // vertical window
+    const int ringSize(ytaps.maxSize);
+    const std::size_t rowSize(std::size_t(width) * numChannels);
+    std::vector<float> ring(ringSize * rowSize);
+    std::vector<int> ringRow(ringSize, std::numeric_limits<int>::min());
+
+    auto filterRow([&](int y) -> const float*
+    {
+        const int slot(y % ringSize);
+        float *out(&ring[slot * rowSize]);
+        if (ringRow[slot] == y) { return out; }
+        ringRow[slot] = y;
+
+        const auto src(view1.row_begin(y));
+        for (int j(tile.x0); j < tile.x1; ++j) {
+            const int lo(xtaps.lo[j]);
+            const double *w(&xtaps.weights[xtaps.offset[j]]);
+
+            // taps outside of source sample zero
+            const int t0(std::max(0, -lo));
+            const int t1(std::min(xtaps.size[j], srcWidth - lo));
+
+            double acc[10] = { 0.0 };
+            for (int t(t0); t < t1; ++t) {
+                const auto &px(src[lo + t]);
+                for (int k(0); k < numChannels; ++k) {
+                    acc[k] += w[t] * px[k];
+                }
+            }
+            for (int k(0); k < numChannels; ++k) { *out++ = acc[k]; }
+        }
+        return &ring[slot * rowSize];
+    });
+
+    PixelLimits<pixel_type> pl;
+    const auto &zero(pl.zero());
+    std::vector<double> acc(rowSize);
+
+    for (int i(tile.y0); i < tile.y1; ++i) {
+        const int lo(ytaps.lo[i]);
+        const double *w(&ytaps.weights[ytaps.offset[i]]);
+        const int t0(std::max(0, -lo));
+        const int t1(std::min(ytaps.size[i], srcHeight - lo));
+
+        std::fill(acc.begin(), acc.end(), 0.0);
+        for (int t(t0); t < t1; ++t) {
+            const float *row(filterRow(lo + t));
+            const double wt(w[t]);
+            for (std::size_t k(0); k < rowSize; ++k) {
+                acc[k] += wt * row[k];
+            }
+        }
+
+        auto dstit(view2.row_begin(i) + tile.x0);
+        const double *a(acc.data());
+        for (int j(tile.x0); j < tile.x1; ++j, a += numChannels) {
+            const double weightSum(xtaps.sum[j] * ytaps.sum[i]);
+
+            pixel_type retval;
+            for (int k(0); k < numChannels; ++k) {
+                if (weightSum > 1E-15) {
+                    retval[k] = pl.clamp(a[k] / weightSum);
+                } else {
+                    retval[k] = zero[k];
+                }
+            }
+            *dstit++ = retval;
+        }
+    }
+}
+
+/** Transformation of one tile by generic mapping: each pixel is
+ *  reconstructed separately.
+ */
 template <typename LowPassFilter2, typename Mapping2
           , typename SrcView, typename DstView>
-inline void transform(
+inline void genericTile(
         const Mapping2 & mapping,
         const SrcView & view1,
-        const DstView & view2 ) {
+        const DstView & view2,
+        const Tile & tile ) {
 
-    for ( int i = 0, ei(view2.height()); i < ei; i++ ) {
+    for ( int i = tile.y0; i < tile.y1; i++ ) {
 
-        typename DstView::x_iterator dstit = view2.row_begin( i );
+        typename DstView::x_iterator dstit = view2.row_begin( i ) + tile.x0;
 
-        for ( int j = 0, ej(view2.width()); j < ej; j++ ) {
+        for ( int j = tile.x0; j < tile.x1; j++ ) {
 
             math::Point2i dstpos( j, i );
 
@@ -221,6 +467,111 @@ inline void transform(
     }
 }
 
+/** Runs op(tile) for whole destination view at once.
+ */
+struct SingleTile {
+    int width, height;
+
+    template <typename Op>
+    void operator()(const Op &op) const {
+        op(Tile{ 0, 0, width, height });
+    }
+};
+
+/** Runs op(tile) for each tile of destination view in parallel. Tiles are
+ *  handed out in row-major order, i.e. threads running at the same time
+ *  read nearby parts of source view.
+ */
+struct ParallelTiles {
+    int width, height;
+    TransformParallel parallel;
+
+    template <typename Op>
+    void operator()(const Op &op) const {
+        const int tw(std::max(1, parallel.tileWidth));
+        const int th(std::max(1, parallel.tileHeight));
+        const int cols((width + tw - 1) / tw);
+        const int count(cols * ((height + th - 1) / th));
+
+        UTILITY_OMP(parallel for schedule(dynamic))
+        for (int t = 0; t < count; ++t) {
+            const int x0((t % cols) * tw);
+            const int y0((t / cols) * th);
+            op(Tile{ x0, y0, std::min(x0 + tw, width)
+                        , std::min(y0 + th, height) });
+        }
+    }
+};
+
+template <typename LowPassFilter2, typename Mapping2
+          , typename SrcView, typename DstView, typename Tiles>
+inline void transform(const Mapping2 &mapping
+                      , const SrcView &view1, const DstView &view2
+                      , const Tiles &tiles, std::true_type)
+{
+    const SeparableFilter<LowPassFilter2>
+        filter(mapping, view2.width(), view2.height());
+
+    tiles([&](const Tile &tile) {
+            separableTile(filter, view1, view2, tile);
+        });
+}
+
+template <typename LowPassFilter2, typename Mapping2
+          , typename SrcView, typename DstView, typename Tiles>
+inline void transform(const Mapping2 &mapping
+                      , const SrcView &view1, const DstView &view2
+                      , const Tiles &tiles, std::false_type)
+{
+    tiles([&](const Tile &tile) {
+            genericTile<LowPassFilter2>(mapping, view1, view2, tile);
+        });
+}
+
+/** Selects separable filtering for axis-aligned mappings and separable
+ *  filters.
+ */
+template <typename LowPassFilter2, typename Mapping2>
+using UseSeparable = std::integral_constant
+    <bool, (AxisAlignedMapping<Mapping2>::value
+            && SeparableFilter2<LowPassFilter2>::value)>;
+
+} // namespace detail
+
+template <typename LowPassFilter2, typename Mapping2
+          , typename SrcView, typename DstView>
+inline void transform(
+        const Mapping2 & mapping,
+        const SrcView & view1,
+        const DstView & view2 )
+{
+    detail::transform<LowPassFilter2>
+        (mapping, view1, view2
+         , detail::SingleTile{ int(view2.width()), int(view2.height()) }
+         , detail::UseSeparable<LowPassFilter2, Mapping2>());
+}
+
+template <typename LowPassFilter2, typename Mapping2
+          , typename SrcView, typename DstView>
+inline void transform(const Mapping2 &mapping
+                      , const SrcView &view1, const DstView &view2
+                      , const TransformParallel &parallel)
+{
+    detail::transform<LowPassFilter2>
+        (mapping, view1, view2
+         , detail::ParallelTiles{ int(view2.width()), int(view2.height())
+                                  , parallel }
+         , detail::UseSeparable<LowPassFilter2, Mapping2>());
+}
+
+template <typename Mapping2, typename SrcView, typename DstView>
+inline void transform(const Mapping2 &mapping
+                      , const SrcView &view1, const DstView &view2
+                      , const TransformParallel &parallel)
+{
+    return transform<DefaultFilter>(mapping, view1, view2, parallel);
+}
+
 template <typename Mapping2, typename SrcView, typename DstView>
 inline void transform(
         const Mapping2 & mapping,
@@ -244,6 +595,23 @@ inline void scale(const SrcView &view1, const DstView &view2)
     return scale<DefaultFilter>(view1, view2);
 }
 
+template <typename LowPassFilter2, typename SrcView, typename DstView>
+inline void scale(const SrcView &view1, const DstView &view2
+                  , const TransformParallel &parallel)
+{
+    Scaling2 scaling(math::Size2(view2.width(), view2.height())
+                     , math::Size2(view1.width(), view1.height()));
+
+    transform<LowPassFilter2>(scaling, view1, view2, parallel);
+}
+
+template <typename SrcView, typename DstView>
+inline void scale(const SrcView &view1, const DstView &view2
+                  , const TransformParallel &parallel)
+{
+    return scale<DefaultFilter>(view1, view2, parallel);
+}
+
 template <typename LowPassFilter2, typename SrcView, typename DstView
           , typename T>
 inline void cropAndScale(const SrcView & view1, const DstView &view2
@@ -264,6 +632,25 @@ inline void cropAndScale(const SrcView &view1, const DstView &view2
     return cropAndScale<DefaultFilter>(view1, view2, srcCrop);
 }
 
+template <typename LowPassFilter2, typename SrcView, typename DstView
+          , typename T>
+inline void cropAndScale(const SrcView &view1, const DstView &view2
+                         , const imgproc::Crop2_<T> &srcCrop
+                         , const TransformParallel &parallel)
+{
+    ReverseCroppingAndScaling2
+        op(srcCrop, math::Size2(view2.width(), view2.height()));
+    transform<LowPassFilter2>(op, view1, view2, parallel);
+}
+
+template <typename SrcView, typename DstView, typename T>
+inline void cropAndScale(const SrcView &view1, const DstView &view2
+                         , const imgproc::Crop2_<T> &srcCrop
+                         , const TransformParallel &parallel)
+{
+    return cropAndScale<DefaultFilter>(view1, view2, srcCrop, parallel);
+}
+
 } // namespace imgproc
 
 